@@ -24,6 +24,7 @@ def cc_embed_data(
         strip_prefix = None,
         flatten = False,
         identifier = None,
+        compress = False,
         **kwargs):
     """Embeds 'srcs' into a C++ module.
 
@@ -37,11 +38,19 @@ def cc_embed_data(
       }
       namespace foo {
       extern const struct ::gutil::FileToc* this_rule_name_create();
+      extern const struct ::gutil::FileToc* this_rule_name_find(
+          const char* name);
       }
-    The 'this_rule_name()' function will return an array of FileToc
+    The 'this_rule_name_create()' function will return an array of FileToc
     structs terminated by one that has nullptr 'name' and 'data' fields.
+    The 'this_rule_name_find()' function returns the FileToc of one file, or
+    nullptr if no file has that name.
     The 'data' field always has an extra null terminator at the end (which
     is not included in the size).
+    With 'compress', files are embedded zlib compressed and decompressed the
+    first time they are accessed: 'this_rule_name_find()' decompresses only
+    the file it returns, 'this_rule_name_create()' every file. Decompressed
+    files are kept for the lifetime of the program.
     Args:
       name: The rule name, which will also be the identifier of the generated
         code symbol.
@@ -53,6 +62,8 @@ def cc_embed_data(
       strip_prefix: Strips this verbatim prefix from filenames (in the TOC).
       flatten: Removes all directory components from filenames (in the TOC).
       identifier: The identifier to use in generated names (defaults to name).
+      compress: Embeds the files compressed, to keep large files from growing
+        the binary and its compile time.
       **kwargs: Args to pass to the cc_library.
     """
     generator = "//gutil/embed_data:generate_cc_embed_data"
@@ -70,6 +81,10 @@ def cc_embed_data(
         flags += " --strip_prefix='%s'" % (strip_prefix,)
     if flatten:
         flags += " --flatten"
+    deps = kwargs.pop("deps", [])
+    if compress:
+        flags += " --compress"
+        deps = deps + ["@zlib//:zlib"]
 
     native.genrule(
         name = name + "__generator",
@@ -87,5 +102,6 @@ def cc_embed_data(
         hdrs = [h_file_output],
         srcs = [cc_file_output],
         testonly = testonly,
+        deps = deps,
         **kwargs
     )
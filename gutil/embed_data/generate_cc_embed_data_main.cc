@@ -17,6 +17,8 @@
 #include <iomanip>
 #include <iostream>
 
+#include <zlib.h>
+
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/strings/escaping.h"
@@ -32,6 +34,8 @@ ABSL_FLAG(std::string, cpp_namespace, "", "generate in a c++ namespace");
 ABSL_FLAG(std::string, strip_prefix, "", "strip prefix from filenames");
 ABSL_FLAG(bool, flatten, false,
           "whether to flatten the directory structure (only include basename)");
+ABSL_FLAG(bool, compress, false,
+          "whether to embed zlib compressed files, decompressed on first use");
 
 void GenerateNamespaceOpen(std::ofstream& f) {
   const auto& ns = absl::GetFlag(FLAGS_cpp_namespace);
@@ -77,6 +81,8 @@ bool GenerateHeader(const std::string& header_file,
   GenerateNamespaceOpen(f);
   f << "extern const struct ::gutil::FileToc* "
     << absl::GetFlag(FLAGS_identifier) << "_create();\n";
+  f << "extern const struct ::gutil::FileToc* "
+    << absl::GetFlag(FLAGS_identifier) << "_find(const char* name);\n";
   f << "static inline std::size_t " << absl::GetFlag(FLAGS_identifier)
     << "_size() { \n";
   f << "  return " << toc_files.size() << ";\n";
@@ -112,6 +118,7 @@ bool GenerateImpl(const std::string& impl_file,
                   const std::vector<std::string>& toc_files) {
   std::ofstream f(impl_file, std::ios::out | std::ios::trunc);
   f << "#include <cstddef>\n";
+  f << "#include <cstring>\n";
   GenerateTocStruct(f);
   GenerateNamespaceOpen(f);
   for (size_t i = 0, e = input_files.size(); i < e; ++i) {
@@ -145,6 +152,119 @@ bool GenerateImpl(const std::string& impl_file,
     << "_create() {\n";
   f << "  return &toc[0];\n";
   f << "}\n";
+  f << "const struct ::gutil::FileToc* " << absl::GetFlag(FLAGS_identifier)
+    << "_find(const char* name) {\n";
+  f << "  for (const auto* file = &toc[0]; file->name != nullptr; ++file) {\n";
+  f << "    if (std::strcmp(file->name, name) == 0) return file;\n";
+  f << "  }\n";
+  f << "  return nullptr;\n";
+  f << "}\n";
+
+  GenerateNamespaceClose(f);
+  f.close();
+  return f.good();
+}
+
+bool Compress(const std::string& contents, std::string* compressed) {
+  uLongf compressed_size = compressBound(contents.size());
+  compressed->resize(compressed_size);
+  if (compress2(reinterpret_cast<Bytef*>(&(*compressed)[0]), &compressed_size,
+                reinterpret_cast<const Bytef*>(contents.data()),
+                contents.size(), Z_BEST_COMPRESSION) != Z_OK) {
+    return false;
+  }
+  compressed->resize(compressed_size);
+  return true;
+}
+
+// Like GenerateImpl, but embeds the files zlib compressed, as byte arrays
+// instead of string literals, and decompresses each file the first time it is
+// accessed.
+bool GenerateCompressedImpl(const std::string& impl_file,
+                            const std::vector<std::string>& input_files,
+                            const std::vector<std::string>& toc_files) {
+  const std::string& identifier = absl::GetFlag(FLAGS_identifier);
+  std::ofstream f(impl_file, std::ios::out | std::ios::trunc);
+  f << "#include <cstddef>\n";
+  f << "#include <cstdlib>\n";
+  f << "#include <cstring>\n";
+  f << "#include <mutex>\n";
+  f << "#include <zlib.h>\n";
+  GenerateTocStruct(f);
+  GenerateNamespaceOpen(f);
+  std::vector<size_t> sizes;
+  for (size_t i = 0, e = input_files.size(); i < e; ++i) {
+    std::string contents;
+    if (!SlurpFile(input_files[i], &contents)) {
+      std::cerr << "Error reading file " << input_files[i] << "\n";
+      return false;
+    }
+    std::string compressed;
+    if (!Compress(contents, &compressed)) {
+      std::cerr << "Error compressing file " << input_files[i] << "\n";
+      return false;
+    }
+    sizes.push_back(contents.size());
+    f << "static const unsigned char file_" << i << "[] = {\n";
+    constexpr int kMaxBytesPerLine = 32;
+    for (size_t j = 0; j < compressed.size(); ++j) {
+      f << static_cast<int>(static_cast<unsigned char>(compressed[j])) << ",";
+      if ((j + 1) % kMaxBytesPerLine == 0) f << "\n";
+    }
+    f << "};\n";
+  }
+  f << "struct CompressedFile {\n";
+  f << "  const unsigned char* data;\n";
+  f << "  std::size_t compressed_size;\n";
+  f << "  std::size_t size;\n";
+  f << "};\n";
+  f << "static const CompressedFile compressed_files[] = {\n";
+  assert(input_files.size() == toc_files.size());
+  for (size_t i = 0, e = input_files.size(); i < e; ++i) {
+    f << "  {file_" << i << ", sizeof(file_" << i << "), " << sizes[i]
+      << "},\n";
+  }
+  f << "  {nullptr, 0, 0},\n";
+  f << "};\n";
+  // Names are set up front so files can be looked up without decompressing
+  // them; data is filled in when a file is decompressed.
+  f << "static struct ::gutil::FileToc toc[] = {\n";
+  for (size_t i = 0, e = toc_files.size(); i < e; ++i) {
+    f << "  {\"" << absl::CEscape(toc_files[i]) << "\", nullptr, " << sizes[i]
+      << "},\n";
+  }
+  f << "  {nullptr, nullptr, 0},\n";
+  f << "};\n";
+  f << "static std::once_flag decompressed[" << toc_files.size() + 1
+    << "];\n";
+  f << "static void Decompress(std::size_t i) {\n";
+  f << "  std::call_once(decompressed[i], [i]() {\n";
+  f << "    const CompressedFile& file = compressed_files[i];\n";
+  f << "    // Kept for the lifetime of the program, with a null terminator.\n";
+  f << "    char* data = new char[file.size + 1];\n";
+  f << "    uLongf size = file.size;\n";
+  f << "    if (uncompress(reinterpret_cast<Bytef*>(data), &size, file.data,\n";
+  f << "                   file.compressed_size) != Z_OK ||\n";
+  f << "        size != file.size) {\n";
+  f << "      std::abort();\n";
+  f << "    }\n";
+  f << "    data[file.size] = '\\0';\n";
+  f << "    toc[i].data = data;\n";
+  f << "  });\n";
+  f << "}\n";
+  f << "const struct ::gutil::FileToc* " << identifier << "_create() {\n";
+  f << "  for (std::size_t i = 0; toc[i].name != nullptr; ++i) Decompress(i);\n";
+  f << "  return &toc[0];\n";
+  f << "}\n";
+  f << "const struct ::gutil::FileToc* " << identifier
+    << "_find(const char* name) {\n";
+  f << "  for (std::size_t i = 0; toc[i].name != nullptr; ++i) {\n";
+  f << "    if (std::strcmp(toc[i].name, name) != 0) continue;\n";
+  f << "    Decompress(i);\n";
+  f << "    return &toc[i];\n";
+  f << "  }\n";
+  f << "  return nullptr;\n";
+  f << "}\n";
 
   GenerateNamespaceClose(f);
   f.close();
@@ -186,8 +306,13 @@ int main(int argc, char** argv) {
   }
 
   if (!absl::GetFlag(FLAGS_output_impl).empty()) {
-    if (!GenerateImpl(absl::GetFlag(FLAGS_output_impl), input_files,
-                      toc_files)) {
+    bool generated =
+        absl::GetFlag(FLAGS_compress)
+            ? GenerateCompressedImpl(absl::GetFlag(FLAGS_output_impl),
+                                     input_files, toc_files)
+            : GenerateImpl(absl::GetFlag(FLAGS_output_impl), input_files,
+                           toc_files);
+    if (!generated) {
       std::cerr << "Error generating impl.\n";
       return 2;
     }
@@ -14,10 +14,16 @@
 
 #include "gutil/io.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <cerrno>
 #include <fstream>
 #include <streambuf>
 #include <string>
+#include <utility>
 
 #include "absl/strings/str_format.h"
 #include "gutil/status.h"
@@ -56,6 +62,64 @@ absl::StatusOr<std::string> ReadFile(const std::string &path) {
   return result;
 }
 
+MappedFile::MappedFile(MappedFile &&other)
+    : data_(other.data_), size_(other.size_), copy_(std::move(other.copy_)) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+  if (this != &other) {
+    if (data_ != nullptr) munmap(data_, size_);
+    data_ = other.data_;
+    size_ = other.size_;
+    copy_ = std::move(other.copy_);
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) munmap(data_, size_);
+}
+
+absl::string_view MappedFile::contents() const {
+  if (data_ == nullptr) return copy_;
+  return absl::string_view(static_cast<const char *>(data_), size_);
+}
+
+absl::StatusOr<MappedFile> MapFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return ErrorNoToAbsl("open", path);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    absl::Status status = ErrorNoToAbsl("stat", path);
+    close(fd);
+    return status;
+  }
+  // Only regular files have a size to map; mmap rejects empty ones.
+  if (!S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+    close(fd);
+    ASSIGN_OR_RETURN(std::string contents, ReadFile(path));
+    return MappedFile(std::move(contents));
+  }
+  size_t size = file_stat.st_size;
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    absl::Status status = ErrorNoToAbsl("map", path);
+    close(fd);
+    return status;
+  }
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  // Configs are parsed front to back, so let the kernel read ahead.
+  madvise(data, size, MADV_SEQUENTIAL);
+  return MappedFile(data, size);
+}
+
 absl::Status WriteFile(const std::string &content, const std::string &path) {
   std::ofstream f;
   f.open(path.c_str());
@@ -70,4 +134,45 @@ absl::Status WriteFile(const std::string &content, const std::string &path) {
   return absl::OkStatus();
 }
 
+absl::Status WriteFileAndSync(const std::string &content,
+                              const std::string &path) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return ErrorNoToAbsl("open", path);
+  }
+  for (size_t written = 0; written < content.size();) {
+    ssize_t n = write(fd, content.data() + written, content.size() - written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      absl::Status status = ErrorNoToAbsl("write", path);
+      close(fd);
+      return status;
+    }
+    written += n;
+  }
+  if (fsync(fd) != 0) {
+    absl::Status status = ErrorNoToAbsl("sync", path);
+    close(fd);
+    return status;
+  }
+  if (close(fd) != 0) {
+    return ErrorNoToAbsl("close", path);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SyncDirectory(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return ErrorNoToAbsl("open", path);
+  }
+  if (fsync(fd) != 0) {
+    absl::Status status = ErrorNoToAbsl("sync", path);
+    close(fd);
+    return status;
+  }
+  close(fd);
+  return absl::OkStatus();
+}
+
 }  // namespace gutil
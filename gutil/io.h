@@ -15,9 +15,12 @@
 #ifndef P4_SYMBOLIC_UTIL_IO_H_
 #define P4_SYMBOLIC_UTIL_IO_H_
 
+#include <cstddef>
 #include <string>
+#include <utility>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "gutil/status.h"
 
@@ -26,9 +29,47 @@ namespace gutil {
 // Reads the entire content of the file and returns it (or an error status).
 absl::StatusOr<std::string> ReadFile(const std::string &path);
 
+// Read-only view of the entire content of a file. Regular files are mapped
+// into memory instead of copied; other files, e.g. pipes, are read into the
+// object. The content stays valid for the lifetime of the object.
+class MappedFile {
+ public:
+  MappedFile(MappedFile &&other);
+  MappedFile &operator=(MappedFile &&other);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  absl::string_view contents() const;
+
+ private:
+  friend absl::StatusOr<MappedFile> MapFile(const std::string &path);
+
+  MappedFile(void *data, size_t size) : data_(data), size_(size) {}
+  explicit MappedFile(std::string contents) : copy_(std::move(contents)) {}
+
+  // The mapping, if the file is mapped.
+  void *data_ = nullptr;
+  size_t size_ = 0;
+  // The content of files that cannot be mapped.
+  std::string copy_;
+};
+
+// Maps the entire content of the file into memory (or returns an error
+// status). Use it instead of ReadFile for large files that are only read.
+absl::StatusOr<MappedFile> MapFile(const std::string &path);
+
 // Writes the content of the string to the file.
 absl::Status WriteFile(const std::string &content, const std::string &path);
 
+// Like WriteFile, but only returns once the content reached the disk.
+absl::Status WriteFileAndSync(const std::string &content,
+                              const std::string &path);
+
+// Flushes the entries of a directory to the disk, e.g. to make a file renamed
+// into it survive a crash.
+absl::Status SyncDirectory(const std::string &path);
+
 }  // namespace gutil
 
 #endif  // P4_SYMBOLIC_UTIL_IO_H_
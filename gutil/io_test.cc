@@ -0,0 +1,106 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gutil/io.h"
+
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/duration.pb.h"
+#include "gtest/gtest.h"
+#include "gutil/proto.h"
+#include "gutil/status_matchers.h"
+
+namespace gutil {
+namespace {
+
+std::string TestFile(const std::string &name) {
+  return ::testing::TempDir() + "/" + name;
+}
+
+TEST(MapFileTest, MapsContent) {
+  std::string path = TestFile("map_file_test");
+  std::string content(1 << 20, 'x');
+  content += "end";
+  ASSERT_OK(WriteFile(content, path));
+  absl::StatusOr<MappedFile> file = MapFile(path);
+  ASSERT_OK(file.status());
+  EXPECT_EQ(file->contents(), content);
+
+  // The mapping moves with the object.
+  MappedFile moved = std::move(file).value();
+  EXPECT_EQ(moved.contents(), content);
+}
+
+TEST(MapFileTest, MapsEmptyFile) {
+  std::string path = TestFile("map_empty_file_test");
+  ASSERT_OK(WriteFile("", path));
+  absl::StatusOr<MappedFile> file = MapFile(path);
+  ASSERT_OK(file.status());
+  EXPECT_TRUE(file->contents().empty());
+}
+
+TEST(MapFileTest, MissingFileIsNotFound) {
+  EXPECT_THAT(MapFile(TestFile("does_not_exist")).status(),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(WriteFileAndSyncTest, ReplacesContent) {
+  std::string path = TestFile("write_file_and_sync_test");
+  ASSERT_OK(WriteFile("a longer previous content", path));
+  ASSERT_OK(WriteFileAndSync("new content", path));
+  absl::StatusOr<std::string> content = ReadFile(path);
+  ASSERT_OK(content.status());
+  EXPECT_EQ(*content, "new content");
+  EXPECT_OK(SyncDirectory(::testing::TempDir()));
+}
+
+TEST(SyncDirectoryTest, MissingDirectoryIsNotFound) {
+  EXPECT_THAT(SyncDirectory(TestFile("does_not_exist")),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(ReadProtoFromFileTest, ReadsTextFormat) {
+  std::string path = TestFile("text_proto_test");
+  ASSERT_OK(WriteFile("seconds: 5 nanos: 7", path));
+  google::protobuf::Duration duration;
+  ASSERT_OK(ReadProtoFromFile(path, &duration));
+  EXPECT_EQ(duration.seconds(), 5);
+  EXPECT_EQ(duration.nanos(), 7);
+}
+
+TEST(ReadProtoFromFileTest, ReadsBinaryFormat) {
+  std::string path = TestFile("binary_proto_test");
+  google::protobuf::Duration written;
+  written.set_seconds(12345);
+  written.set_nanos(678);
+  ASSERT_OK(WriteFile(written.SerializeAsString(), path));
+  google::protobuf::Duration duration;
+  ASSERT_OK(ReadProtoFromFile(path, &duration));
+  EXPECT_EQ(duration.seconds(), 12345);
+  EXPECT_EQ(duration.nanos(), 678);
+}
+
+TEST(ReadProtoFromFileTest, RejectsInvalidContent) {
+  std::string path = TestFile("invalid_proto_test");
+  ASSERT_OK(WriteFile("seconds: not_a_number", path));
+  google::protobuf::Duration duration;
+  EXPECT_THAT(ReadProtoFromFile(path, &duration),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+}  // namespace
+}  // namespace gutil
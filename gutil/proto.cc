@@ -14,37 +14,78 @@
 
 #include "gutil/proto.h"
 
-#include <fcntl.h>
-
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "google/protobuf/descriptor.h"
-#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/message.h"
 #include "google/protobuf/text_format.h"
+#include "gutil/io.h"
 #include "gutil/status.h"
 
 namespace gutil {
 
+namespace {
+
+// Returns true if the message or any message in it has fields that are not in
+// its descriptor.
+bool HasUnknownFields(const google::protobuf::Message &message) {
+  const google::protobuf::Reflection *reflection = message.GetReflection();
+  if (!reflection->GetUnknownFields(message).empty()) return true;
+  std::vector<const google::protobuf::FieldDescriptor *> fields;
+  reflection->ListFields(message, &fields);
+  for (const auto *field : fields) {
+    if (field->cpp_type() !=
+        google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+      continue;
+    }
+    if (field->is_repeated()) {
+      for (int i = 0; i < reflection->FieldSize(message, field); ++i) {
+        if (HasUnknownFields(
+                reflection->GetRepeatedMessage(message, field, i))) {
+          return true;
+        }
+      }
+    } else if (HasUnknownFields(reflection->GetMessage(message, field))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
 absl::Status ReadProtoFromFile(absl::string_view filename,
                                google::protobuf::Message *message) {
   // Verifies that the version of the library that we linked against is
   // compatible with the version of the headers we compiled against.
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
-  int fd = open(std::string(filename).c_str(), O_RDONLY);
-  if (fd < 0) {
+  absl::StatusOr<MappedFile> file = MapFile(std::string(filename));
+  if (!file.ok()) {
     return InvalidArgumentErrorBuilder()
-           << "Error opening the file " << filename;
+           << "Error opening the file " << filename << ": "
+           << file.status().message();
   }
+  absl::string_view contents = file->contents();
 
-  google::protobuf::io::FileInputStream file_stream(fd);
-  file_stream.SetCloseOnDelete(true);
+  // Text rarely parses as wire format, and when it does it shows up as
+  // unknown fields, so binary files are tried first.
+  google::protobuf::io::ArrayInputStream binary_stream(contents.data(),
+                                                       contents.size());
+  if (message->ParseFromZeroCopyStream(&binary_stream) &&
+      !HasUnknownFields(*message)) {
+    return absl::OkStatus();
+  }
+  message->Clear();
 
-  if (!google::protobuf::TextFormat::Parse(&file_stream, message)) {
+  google::protobuf::io::ArrayInputStream text_stream(contents.data(),
+                                                     contents.size());
+  if (!google::protobuf::TextFormat::Parse(&text_stream, message)) {
     return InvalidArgumentErrorBuilder() << "Failed to parse file " << filename;
   }
 
@@ -25,7 +25,10 @@
 
 namespace gutil {
 
-// Read the contents of the file into a protobuf.
+// Read the contents of the file into a protobuf. The file is mapped into
+// memory and parsed in place, as binary wire format or, failing that, as text
+// format. Binary files with fields this message does not know are read as
+// text, and fail to parse.
 absl::Status ReadProtoFromFile(absl::string_view filename,
                                google::protobuf::Message *message);
 
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "admission_controller.h"
+
+#include <algorithm>
+
+#include "absl/memory/memory.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+namespace {
+
+   const char* RequestTypeName(RequestType type) {
+     switch (type) {
+       case RequestType::kPacketOut:
+         return "PacketOut";
+       case RequestType::kWrite:
+         return "Write";
+       case RequestType::kSetPipelineConfig:
+         return "SetForwardingPipelineConfig";
+       case RequestType::kGetPipelineConfig:
+         return "GetForwardingPipelineConfig";
+       case RequestType::kRead:
+         return "Read";
+     }
+     return "Unknown";
+   }
+
+}  // namespace
+
+AdmissionLimits DefaultAdmissionLimits(RequestType type) {
+  AdmissionLimits limits;
+  switch (type) {
+    case RequestType::kPacketOut:
+      limits.priority = 0;
+      limits.max_queue_delay = absl::Seconds(1);
+      break;
+    case RequestType::kWrite:
+    case RequestType::kSetPipelineConfig:
+      limits.priority = 1;
+      break;
+    case RequestType::kGetPipelineConfig:
+      limits.priority = 2;
+      break;
+    case RequestType::kRead:
+      limits.priority = 3;
+      limits.max_queue_delay = absl::Seconds(1);
+      break;
+  }
+  return limits;
+}
+
+AdmissionController::Ticket::Ticket(Ticket&& other)
+    : controller_(other.controller_), request_class_(other.request_class_) {
+  other.controller_ = nullptr;
+}
+
+AdmissionController::Ticket& AdmissionController::Ticket::operator=(
+    Ticket&& other) {
+  if (this != &other) {
+    if (controller_ != nullptr) controller_->Release(request_class_);
+    controller_ = other.controller_;
+    request_class_ = other.request_class_;
+    other.controller_ = nullptr;
+  }
+  return *this;
+}
+
+AdmissionController::Ticket::~Ticket() {
+  if (controller_ != nullptr) controller_->Release(request_class_);
+}
+
+AdmissionController::AdmissionController(
+    const AdmissionControlOptions& options, LimitsFor limits,
+    MetricsRegistry* metrics)
+    : options_(options) {
+  std::vector<absl::optional<std::string>> roles = {absl::nullopt,
+                                                    std::string()};
+  roles.insert(roles.end(), options_.roles.begin(), options_.roles.end());
+  for (int type = 0; type < kNumRequestTypes; ++type) {
+    RequestType request_type = static_cast<RequestType>(type);
+    MetricLabels labels = {{"type", RequestTypeName(request_type)}};
+    metrics_[type] = {
+        metrics->GetGauge("p4rt_admission_queued_requests", labels),
+        metrics->GetCounter("p4rt_admission_shed_requests", labels),
+        metrics->GetHistogram("p4rt_admission_queue_delay_seconds", labels)};
+    for (const absl::optional<std::string>& role : roles) {
+      auto request_class = absl::make_unique<RequestClass>();
+      request_class->limits = limits(request_type, role);
+      classes_.emplace(std::make_pair(request_type, role),
+                       std::move(request_class));
+    }
+  }
+}
+
+absl::StatusOr<AdmissionController::Ticket> AdmissionController::Admit(
+    RequestType type, const absl::optional<std::string>& role,
+    absl::Time deadline) {
+  const TypeMetrics& metrics = metrics_[static_cast<int>(type)];
+  RequestClass* request_class = FindClass(type, role);
+  absl::MutexLock l(&lock_);
+  // Whoever is still waiting is held back by the limit of its own type and
+  // role, so a request that fits does not jump ahead of anyone who could run.
+  if (HasRoom(*request_class)) {
+    Start(request_class);
+    metrics.queue_delay->Record(absl::ZeroDuration());
+    return Ticket(this, request_class);
+  }
+
+  absl::Time start = absl::Now();
+  deadline = std::min(deadline, start + request_class->limits.max_queue_delay);
+  Waiter waiter{request_class};
+  auto position = waiting_
+                      .emplace(std::make_pair(request_class->limits.priority,
+                                              next_arrival_++),
+                               &waiter)
+                      .first;
+  metrics.queued->Add(1);
+  lock_.AwaitWithDeadline(absl::Condition(&waiter.admitted), deadline);
+  metrics.queued->Add(-1);
+  if (!waiter.admitted) {
+    waiting_.erase(position);
+    metrics.shed->Increment();
+    return gutil::ResourceExhaustedErrorBuilder()
+           << "The server is busy: " << RequestTypeName(type)
+           << " waited " << absl::FormatDuration(absl::Now() - start)
+           << " to be admitted.";
+  }
+  metrics.queue_delay->Record(absl::Now() - start);
+  return Ticket(this, request_class);
+}
+
+AdmissionController::RequestClass* AdmissionController::FindClass(
+    RequestType type, const absl::optional<std::string>& role) const {
+  auto request_class = classes_.find({type, role});
+  // Roles without limits of their own share the class of the empty name.
+  if (request_class == classes_.end()) {
+    request_class = classes_.find({type, std::string()});
+  }
+  return request_class->second.get();
+}
+
+bool AdmissionController::HasRoom(const RequestClass& request_class) const {
+  return running_ < options_.max_concurrent_requests &&
+         (request_class.limits.max_concurrent <= 0 ||
+          request_class.running < request_class.limits.max_concurrent);
+}
+
+void AdmissionController::Start(RequestClass* request_class) {
+  ++running_;
+  ++request_class->running;
+}
+
+void AdmissionController::AdmitWaiting() {
+  for (auto waiter = waiting_.begin();
+       waiter != waiting_.end() &&
+       running_ < options_.max_concurrent_requests;) {
+    if (!HasRoom(*waiter->second->request_class)) {
+      ++waiter;
+      continue;
+    }
+    Start(waiter->second->request_class);
+    waiter->second->admitted = true;
+    waiter = waiting_.erase(waiter);
+  }
+}
+
+void AdmissionController::Release(RequestClass* request_class) {
+  absl::MutexLock l(&lock_);
+  --running_;
+  --request_class->running;
+  AdmitWaiting();
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _ADMISSION_CONTROLLER_H_
+#define _ADMISSION_CONTROLLER_H_
+
+#include "metrics.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+
+namespace p4rt_server{
+
+// The work the AdmissionController schedules.
+enum class RequestType {
+  // A batch of PacketOuts handed to the switch provider.
+  kPacketOut,
+  kWrite,
+  kSetPipelineConfig,
+  kGetPipelineConfig,
+  kRead,
+};
+constexpr int kNumRequestTypes = 5;
+
+// Scheduling of the requests of one type and role. See
+// SwitchProviderBase::AdmissionLimitsFor.
+struct AdmissionLimits {
+  // Waiting requests with a lower priority are admitted first, requests of
+  // the same priority in arrival order.
+  int priority = 0;
+  // Most requests of the type and role running at once. 0 only applies the
+  // limit of the server.
+  int max_concurrent = 0;
+  // How long a request may wait for a slot before it is rejected with
+  // RESOURCE_EXHAUSTED. Requests also stop waiting at their gRPC deadline.
+  absl::Duration max_queue_delay = absl::InfiniteDuration();
+};
+
+// Stream traffic first, then the Writes and pipeline changes of the primary,
+// then GetForwardingPipelineConfig, and Reads last. PacketOut batches, which
+// have no gRPC deadline, and Reads are shed after a second in the queue.
+AdmissionLimits DefaultAdmissionLimits(RequestType type);
+
+struct AdmissionControlOptions {
+  // Requests of every type running at once. 0 disables admission control.
+  int max_concurrent_requests = 0;
+  // Roles scheduled with limits of their own. The requests of every other
+  // role share one class per type, whose limits are those of the empty role
+  // name.
+  std::vector<std::string> roles;
+};
+
+// Bounds the requests that run at once and decides which waiting request
+// runs next, so heavy reads from monitoring tools cannot starve the
+// PacketOuts and Writes of the primary controller.
+//
+// A request that finds a free slot runs right away. Otherwise it waits in a
+// queue ordered by priority; whenever a request finishes, the first waiting
+// requests whose type and role are below their own limit are admitted.
+class AdmissionController {
+ private:
+  struct RequestClass;
+
+ public:
+  using LimitsFor = std::function<AdmissionLimits(
+      RequestType type, const absl::optional<std::string>& role)>;
+
+  // Holds a slot from Admit until it is destroyed.
+  class Ticket {
+   public:
+    Ticket(Ticket&& other);
+    Ticket& operator=(Ticket&& other);
+    ~Ticket();
+
+   private:
+    friend class AdmissionController;
+    Ticket(AdmissionController* controller, RequestClass* request_class)
+        : controller_(controller), request_class_(request_class) {}
+
+    AdmissionController* controller_;
+    RequestClass* request_class_;
+  };
+
+  // limits is only called here: per type, for requests without a role, for
+  // each of options.roles and for the empty role name.
+  AdmissionController(const AdmissionControlOptions& options,
+                      LimitsFor limits, MetricsRegistry* metrics);
+
+  AdmissionController(const AdmissionController&) = delete;
+  AdmissionController& operator=(const AdmissionController&) = delete;
+
+  // Waits for a slot. Returns RESOURCE_EXHAUSTED once the request waited its
+  // max_queue_delay or the deadline passed.
+  absl::StatusOr<Ticket> Admit(RequestType type,
+                               const absl::optional<std::string>& role,
+                               absl::Time deadline = absl::InfiniteFuture())
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  // The requests of one type and role.
+  struct RequestClass {
+    AdmissionLimits limits;
+    int running = 0;
+  };
+
+  struct Waiter {
+    RequestClass* request_class;
+    bool admitted = false;
+  };
+
+  struct TypeMetrics {
+    // Requests waiting for a slot.
+    Gauge* queued;
+    // Requests rejected after waiting too long.
+    Counter* shed;
+    // Time from Admit to admission.
+    Histogram* queue_delay;
+  };
+
+  RequestClass* FindClass(RequestType type,
+                          const absl::optional<std::string>& role) const;
+  bool HasRoom(const RequestClass& request_class) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void Start(RequestClass* request_class) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  // Admits the waiting requests that fit, in priority order.
+  void AdmitWaiting() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void Release(RequestClass* request_class) ABSL_LOCKS_EXCLUDED(lock_);
+
+  const AdmissionControlOptions options_;
+  TypeMetrics metrics_[kNumRequestTypes];
+  // Built by the constructor and never changed, so it is read without the
+  // lock; the running counts of the classes are guarded by lock_.
+  absl::flat_hash_map<std::pair<RequestType, absl::optional<std::string>>,
+                      std::unique_ptr<RequestClass>>
+      classes_;
+
+  absl::Mutex lock_;
+  // By priority, then arrival.
+  std::map<std::pair<int, uint64_t>, Waiter*> waiting_ ABSL_GUARDED_BY(lock_);
+  uint64_t next_arrival_ ABSL_GUARDED_BY(lock_) = 0;
+  int running_ ABSL_GUARDED_BY(lock_) = 0;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _ADMISSION_CONTROLLER_H_
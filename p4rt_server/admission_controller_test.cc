@@ -0,0 +1,156 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "admission_controller.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "gtest/gtest.h"
+#include "gutil/status_matchers.h"
+
+namespace p4rt_server {
+namespace {
+
+const char* TypeLabel(RequestType type) {
+  switch (type) {
+    case RequestType::kPacketOut:
+      return "PacketOut";
+    case RequestType::kWrite:
+      return "Write";
+    case RequestType::kRead:
+      return "Read";
+    default:
+      return "";
+  }
+}
+
+class AdmissionControllerTest : public testing::Test {
+ protected:
+  AdmissionControllerTest()
+      : controller_(Options(), &AdmissionControllerTest::Limits, &metrics_) {}
+
+  // Two requests run at once.
+  static AdmissionControlOptions Options() {
+    AdmissionControlOptions options;
+    options.max_concurrent_requests = 2;
+    options.roles = {"monitor"};
+    return options;
+  }
+
+  // The "monitor" role and the unlisted roles each run one read at a time
+  // and shed reads after 50ms; reads without a role wait as long as they
+  // have to.
+  static AdmissionLimits Limits(RequestType type,
+                                const absl::optional<std::string>& role) {
+    AdmissionLimits limits = DefaultAdmissionLimits(type);
+    if (type == RequestType::kRead && (role == "monitor" || role == "")) {
+      limits.max_concurrent = 1;
+      limits.max_queue_delay = absl::Milliseconds(50);
+    }
+    if (type == RequestType::kRead && !role.has_value()) {
+      limits.max_queue_delay = absl::InfiniteDuration();
+    }
+    return limits;
+  }
+
+  // Waits until count requests of the type are queued.
+  void AwaitQueued(RequestType type, int count) {
+    Gauge* queued = metrics_.GetGauge("p4rt_admission_queued_requests",
+                                      {{"type", TypeLabel(type)}});
+    while (queued->Value() < count) absl::SleepFor(absl::Milliseconds(1));
+  }
+
+  int64_t Shed(RequestType type) {
+    return metrics_.GetCounter("p4rt_admission_shed_requests",
+                               {{"type", TypeLabel(type)}})->Value();
+  }
+
+  MetricsRegistry metrics_;
+  AdmissionController controller_;
+};
+
+TEST_F(AdmissionControllerTest, AdmitsWaitingRequestsByPriority) {
+  absl::StatusOr<AdmissionController::Ticket> first =
+      controller_.Admit(RequestType::kRead, absl::nullopt);
+  absl::StatusOr<AdmissionController::Ticket> second =
+      controller_.Admit(RequestType::kRead, absl::nullopt);
+  ASSERT_OK(first.status());
+  ASSERT_OK(second.status());
+
+  // Queued in the reverse order of their priority.
+  absl::Mutex lock;
+  std::vector<std::string> admitted;
+  std::vector<std::thread> threads;
+  for (RequestType type : {RequestType::kRead, RequestType::kWrite,
+                           RequestType::kPacketOut}) {
+    threads.emplace_back([&, type] {
+      absl::StatusOr<AdmissionController::Ticket> ticket =
+          controller_.Admit(type, absl::nullopt);
+      EXPECT_OK(ticket.status());
+      absl::MutexLock l(&lock);
+      admitted.push_back(TypeLabel(type));
+    });
+    AwaitQueued(type, 1);
+  }
+
+  // The waiting requests take turns on the slot that is freed.
+  { AdmissionController::Ticket done = std::move(first).value(); }
+  for (std::thread& thread : threads) thread.join();
+  EXPECT_EQ(admitted,
+            std::vector<std::string>({"PacketOut", "Write", "Read"}));
+}
+
+TEST_F(AdmissionControllerTest, ShedsRequestsAtTheirDeadline) {
+  absl::StatusOr<AdmissionController::Ticket> first =
+      controller_.Admit(RequestType::kRead, absl::nullopt);
+  absl::StatusOr<AdmissionController::Ticket> second =
+      controller_.Admit(RequestType::kRead, absl::nullopt);
+  absl::StatusOr<AdmissionController::Ticket> shed =
+      controller_.Admit(RequestType::kWrite, absl::nullopt,
+                        absl::Now() + absl::Milliseconds(10));
+  EXPECT_EQ(shed.status().code(), absl::StatusCode::kResourceExhausted);
+  EXPECT_EQ(Shed(RequestType::kWrite), 1);
+}
+
+TEST_F(AdmissionControllerTest, AppliesTheLimitsOfTheRole) {
+  absl::StatusOr<AdmissionController::Ticket> monitor =
+      controller_.Admit(RequestType::kRead, std::string("monitor"));
+  ASSERT_OK(monitor.status());
+  // The second read of the role waits its max_queue_delay and is shed, while
+  // the free slot is still given to other requests.
+  absl::StatusOr<AdmissionController::Ticket> second_monitor =
+      controller_.Admit(RequestType::kRead, std::string("monitor"));
+  EXPECT_EQ(second_monitor.status().code(),
+            absl::StatusCode::kResourceExhausted);
+  EXPECT_OK(controller_.Admit(RequestType::kWrite, absl::nullopt).status());
+  EXPECT_EQ(Shed(RequestType::kRead), 1);
+}
+
+TEST_F(AdmissionControllerTest, UnlistedRolesShareOneClass) {
+  absl::StatusOr<AdmissionController::Ticket> first =
+      controller_.Admit(RequestType::kRead, std::string("a"));
+  ASSERT_OK(first.status());
+  absl::StatusOr<AdmissionController::Ticket> second =
+      controller_.Admit(RequestType::kRead, std::string("b"));
+  EXPECT_EQ(second.status().code(), absl::StatusCode::kResourceExhausted);
+  // The listed role keeps its own limit.
+  EXPECT_OK(controller_.Admit(RequestType::kRead, std::string("monitor"))
+                .status());
+}
+
+TEST_F(AdmissionControllerTest, ReleasesSlotsWithTheTickets) {
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_OK(controller_.Admit(RequestType::kRead, absl::nullopt,
+                                absl::Now()).status());
+  }
+}
+
+}  // namespace
+}  // namespace p4rt_server
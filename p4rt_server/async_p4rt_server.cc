@@ -0,0 +1,621 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "async_p4rt_server.h"
+#include "sdn_controller_manager.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "glog/logging.h"
+#include "google/protobuf/arena.h"
+#include "grpcpp/grpcpp.h"
+#include "p4/v1/p4runtime.grpc.pb.h"
+
+namespace p4rt_server{
+namespace{
+  using p4::v1::P4Runtime;
+
+  // Every tag handed to a completion queue is an AsyncTag. Proceed is called
+  // with the result of the operation the tag was registered for.
+  class AsyncTag {
+    public:
+      virtual ~AsyncTag() = default;
+      virtual void Proceed(bool ok) = 0;
+  };
+
+  // Forwards completion queue events to a member function, so one call object
+  // can have several operations (e.g. a read and a write) in flight.
+  template <typename Call>
+  class MemberTag final : public AsyncTag {
+    public:
+      MemberTag(Call* call, void (Call::*handler)(bool))
+          : call_(call), handler_(handler) {}
+      void Proceed(bool ok) override { (call_->*handler_)(ok); }
+
+    private:
+      Call* call_;
+      void (Call::*handler_)(bool);
+  };
+
+  template <typename Call>
+  void* Tag(MemberTag<Call>* tag) {
+    return static_cast<AsyncTag*>(tag);
+  }
+
+  /*
+   * UnaryCall
+   * Serves Write, SetForwardingPipelineConfig and GetForwardingPipelineConfig
+   * by forwarding to the matching P4RtServer method on the unary worker pool:
+   * admission, group commit windows and provider calls may block, and the
+   * completion queue thread must keep delivering the completions that the
+   * requests they wait for depend on. The request and response
+   * are allocated on the call's arena, so a WriteRequest with thousands of
+   * nested updates is parsed without a malloc per message and freed at once.
+   */
+  template <typename Request, typename Response>
+  class UnaryCall final : public AsyncTag {
+    public:
+      using RequestMethod = void (AsyncP4RtServer::Service::*)(
+          grpc::ServerContext*, Request*,
+          grpc::ServerAsyncResponseWriter<Response>*, grpc::CompletionQueue*,
+          grpc::ServerCompletionQueue*, void*);
+      using HandlerMethod = grpc::Status (P4RtServer::*)(
+          grpc::ServerContext*, const Request*, Response*);
+
+      UnaryCall(AsyncP4RtServer::Service* service,
+                grpc::ServerCompletionQueue* cq, P4RtServer* server,
+                WorkerPool* workers, RequestMethod request_method,
+                HandlerMethod handler_method)
+          : service_(service), cq_(cq), server_(server), workers_(workers),
+            request_method_(request_method), handler_method_(handler_method),
+            responder_(&context_) {
+        (service_->*request_method_)(&context_, request_, &responder_, cq_,
+                                     cq_, static_cast<AsyncTag*>(this));
+      }
+
+      void Proceed(bool ok) override {
+        if (finishing_ || !ok) {
+          delete this;
+          return;
+        }
+        // Wait for the next request before handling this one.
+        new UnaryCall(service_, cq_, server_, workers_, request_method_,
+                      handler_method_);
+        workers_->Schedule([this]() { HandleAndFinish(); });
+      }
+
+    private:
+      // Runs on the unary worker pool.
+      void HandleAndFinish() {
+        auto status = (server_->*handler_method_)(&context_, request_,
+                                                  response_);
+        finishing_ = true;
+        responder_.Finish(*response_, status, static_cast<AsyncTag*>(this));
+      }
+
+      AsyncP4RtServer::Service* service_;
+      grpc::ServerCompletionQueue* cq_;
+      P4RtServer* server_;
+      WorkerPool* workers_;
+      RequestMethod request_method_;
+      HandlerMethod handler_method_;
+
+      grpc::ServerContext context_;
+      google::protobuf::Arena arena_;
+      Request* request_ =
+          google::protobuf::Arena::CreateMessage<Request>(&arena_);
+      Response* response_ =
+          google::protobuf::Arena::CreateMessage<Response>(&arena_);
+      grpc::ServerAsyncResponseWriter<Response> responder_;
+      bool finishing_ = false;
+  };
+
+  /*
+   * ReadCall
+   * Serves Read through P4RtServer::HandleRead. HandleRead runs on the read
+   * worker pool, and every chunk it produces is written before it returns to
+   * read the next one: gRPC only allows a single outstanding write per call,
+   * and a slow client then holds back the read instead of having every chunk
+   * queued in memory. The request lives on the call's arena. The chunks do
+   * not: they are built in the ReadResponseChunker's reused ReadResponse and
+   * serialized by the write, so no chunk is ever copied or kept.
+   */
+  class ReadCall final : public AsyncTag {
+    public:
+      ReadCall(AsyncP4RtServer::Service* service,
+               grpc::ServerCompletionQueue* cq, P4RtServer* server,
+               WorkerPool* read_workers)
+          : service_(service), cq_(cq), server_(server),
+            read_workers_(read_workers), writer_(&context_) {
+        service_->RequestRead(&context_, request_, &writer_, cq_, cq_,
+                              static_cast<AsyncTag*>(this));
+      }
+
+      void Proceed(bool ok) override {
+        switch (state_) {
+          case State::kWaitingForRequest:
+            if (!ok) {
+              delete this;
+              return;
+            }
+            new ReadCall(service_, cq_, server_, read_workers_);
+            state_ = State::kReading;
+            read_workers_->Schedule([this]() { ReadAndFinish(); });
+            return;
+          case State::kReading: {
+            absl::MutexLock l(&lock_);
+            write_in_flight_ = false;
+            // The client went away; nothing left to deliver.
+            if (!ok) write_failed_ = true;
+            return;
+          }
+          case State::kFinishing:
+            delete this;
+            return;
+        }
+      }
+
+    private:
+      enum class State { kWaitingForRequest, kReading, kFinishing };
+
+      // Runs on the read worker pool.
+      void ReadAndFinish() {
+        grpc::Status status = server_->HandleRead(
+            &context_, request_, [this](const p4::v1::ReadResponse& response) {
+              return WriteAndWait(response);
+            });
+        state_ = State::kFinishing;
+        writer_.Finish(status, static_cast<AsyncTag*>(this));
+      }
+
+      // Writes a chunk and returns once the write completed. Returns false if
+      // the chunk could not be written.
+      bool WriteAndWait(const p4::v1::ReadResponse& response)
+          ABSL_LOCKS_EXCLUDED(lock_) {
+        absl::MutexLock l(&lock_);
+        if (write_failed_) return false;
+        write_in_flight_ = true;
+        writer_.Write(response, static_cast<AsyncTag*>(this));
+        ScopedSpan::AddCurrentEvent("response_written");
+        auto write_done = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+          return !write_in_flight_;
+        };
+        lock_.Await(absl::Condition(&write_done));
+        return !write_failed_;
+      }
+
+      AsyncP4RtServer::Service* service_;
+      grpc::ServerCompletionQueue* cq_;
+      P4RtServer* server_;
+      WorkerPool* read_workers_;
+
+      grpc::ServerContext context_;
+      google::protobuf::Arena arena_;
+      p4::v1::ReadRequest* request_ =
+          google::protobuf::Arena::CreateMessage<p4::v1::ReadRequest>(&arena_);
+      grpc::ServerAsyncWriter<p4::v1::ReadResponse> writer_;
+      State state_ = State::kWaitingForRequest;
+
+      // Shared between the read worker writing chunks and the completion
+      // queue thread reporting that a write completed.
+      absl::Mutex lock_;
+      bool write_in_flight_ ABSL_GUARDED_BY(lock_) = false;
+      bool write_failed_ ABSL_GUARDED_BY(lock_) = false;
+  };
+
+  /*
+   * StreamChannelCall
+   * Serves one StreamChannel. A read is always outstanding while the stream is
+   * open, and responses (arbitration updates, PacketIns, errors) can be sent
+   * from any thread: they are queued and written in order by chaining writes
+   * on the completion queue.
+   */
+  class StreamChannelCall final {
+    public:
+      StreamChannelCall(AsyncP4RtServer::Service* service,
+                        grpc::ServerCompletionQueue* cq, P4RtServer* server,
+                        WorkerPool* packet_out_workers)
+          : service_(service), cq_(cq), server_(server),
+            packet_out_workers_(packet_out_workers), stream_(&context_),
+            connection_(&context_, this),
+            connect_tag_(this, &StreamChannelCall::OnConnect),
+            read_tag_(this, &StreamChannelCall::OnRead),
+            write_tag_(this, &StreamChannelCall::OnWrite),
+            finish_tag_(this, &StreamChannelCall::OnFinish),
+            packet_ins_(server->packet_in_options()) {
+        service_->RequestStreamChannel(&context_, &stream_, cq_, cq_,
+                                       Tag(&connect_tag_));
+      }
+
+    private:
+      // The SdnConnection handed to the SdnControllerManager for this stream.
+      class AsyncSdnConnection final : public SdnConnection {
+        public:
+          AsyncSdnConnection(grpc::ServerContext* context,
+                             StreamChannelCall* call)
+              : SdnConnection(context, call->server_->stream_metrics()),
+                call_(call) {}
+
+          bool SendStreamMessageResponse(
+              const p4::v1::StreamMessageResponse& response) override {
+            std::vector<OutboundResponse> responses;
+            responses.emplace_back(response);
+            return call_->QueueResponses(std::move(responses)) == 1;
+          }
+
+          int SendStreamMessageResponses(
+              std::vector<p4::v1::StreamMessageResponse> responses) override {
+            std::vector<OutboundResponse> outbound;
+            outbound.reserve(responses.size());
+            for (auto& response : responses) {
+              outbound.emplace_back(std::move(response));
+            }
+            return call_->QueueResponses(std::move(outbound));
+          }
+
+          bool SendSharedStreamMessageResponse(
+              std::shared_ptr<const SharedStreamResponse> response) override {
+            std::vector<OutboundResponse> responses;
+            responses.emplace_back(std::move(response));
+            return call_->QueueResponses(std::move(responses)) == 1;
+          }
+
+          PacketInResult SendPacketIns(
+              std::vector<OutboundResponse> packets,
+              absl::Span<const int> priorities) override {
+            return call_->QueuePacketIns(std::move(packets), priorities);
+          }
+
+        private:
+          StreamChannelCall* call_;
+      };
+
+      void OnConnect(bool ok) {
+        if (!ok) {
+          delete this;
+          return;
+        }
+        new StreamChannelCall(service_, cq_, server_, packet_out_workers_);
+        packet_out_dispatcher_ = server_->CreatePacketOutDispatcher(
+            &connection_, packet_out_workers_);
+        ReadNext();
+      }
+
+      void ReadNext() { stream_.Read(&request_buffer_, Tag(&read_tag_)); }
+
+      // The waits of the synchronous server on the PacketOut dispatcher are
+      // callbacks here, so the completion queue thread never blocks: an
+      // arbitration update is handled once the PacketOuts before it are
+      // dispatched, and the next message is only read once the PacketOut
+      // queue has room.
+      void OnRead(bool ok) {
+        grpc::Status status;
+        if (ok) {
+          status = grpc::SerializationTraits<p4::v1::StreamMessageRequest>::
+              Deserialize(&request_buffer_, &request_);
+          if (status.ok()) {
+            if (request_.has_arbitration() &&
+                !packet_out_dispatcher_->NotifyWhenFlushed(
+                    [this]() { HandleRequest(); })) {
+              return;
+            }
+            HandleRequest();
+            return;
+          }
+        }
+        Close(status);
+      }
+
+      void HandleRequest() {
+        grpc::Status status = server_->HandleStreamMessage(
+            &connection_, packet_out_dispatcher_.get(), &request_);
+        if (!status.ok()) {
+          Close(status);
+          return;
+        }
+        if (packet_out_dispatcher_->NotifyWhenRoom([this]() { ReadNext(); })) {
+          ReadNext();
+        }
+      }
+
+      // The controller closed the stream, or the stream must be closed
+      // because of an error. PacketOuts still queued are dispatched first.
+      void Close(grpc::Status status) {
+        if (!packet_out_dispatcher_->NotifyWhenFlushed(
+                [this, status]() { FinishReading(status); })) {
+          return;
+        }
+        FinishReading(status);
+      }
+
+      // Once the connection is removed from the SdnControllerManager no other
+      // thread can queue responses. Runs on a PacketOut worker if the
+      // dispatcher had to be flushed first.
+      void FinishReading(const grpc::Status& status) {
+        server_->Disconnect(&connection_, packet_out_dispatcher_.get());
+        {
+          absl::MutexLock l(&lock_);
+          reading_done_ = true;
+          finish_status_ = status;
+          if (!StartFinishing()) return;
+        }
+        Finish();
+      }
+
+      // Bounded the same way as the synchronous SdnConnection queue. Returns
+      // how many of the responses were queued.
+      int QueueResponses(std::vector<OutboundResponse> responses) {
+        ScopedSpan::AddCurrentEvent("response_queued");
+        absl::MutexLock l(&lock_);
+        if (reading_done_ || write_failed_) return 0;
+        int queued = std::min<int>(
+            responses.size(), SdnConnection::kDefaultMaxOutboundQueueSize -
+                                  pending_responses_.size());
+        for (int i = 0; i < queued; ++i) {
+          pending_responses_.push_back(std::move(responses[i]));
+        }
+        const StreamMetrics& metrics = connection_.metrics();
+        if (metrics.outbound_queue_depth != nullptr) {
+          metrics.outbound_queue_depth->Add(queued);
+        }
+        if (static_cast<size_t>(queued) < responses.size()) {
+          if (metrics.dropped_queue_full != nullptr) {
+            metrics.dropped_queue_full->Increment(responses.size() - queued);
+          }
+          LOG_EVERY_N(WARNING, 1000)
+              << "Outbound queue for gRPC context '" << &context_
+              << "' is full. Dropping stream responses.";
+        }
+        if (queued > 0 && !write_in_flight_) {
+          write_in_flight_ = true;
+          WriteNextResponse();
+        }
+        return queued;
+      }
+
+      // Same as the synchronous SdnConnection::SendPacketIns.
+      PacketInResult QueuePacketIns(std::vector<OutboundResponse> packets,
+                                    absl::Span<const int> priorities) {
+        absl::MutexLock l(&lock_);
+        PacketInResult result;
+        if (reading_done_ || write_failed_) {
+          result.overflow = packets.size();
+          return result;
+        }
+        result = packet_ins_.Push(std::move(packets), priorities);
+        const StreamMetrics& metrics = connection_.metrics();
+        if (metrics.outbound_queue_depth != nullptr) {
+          metrics.outbound_queue_depth->Add(result.queued - result.evicted);
+        }
+        if (result.overflow > 0 || result.evicted > 0) {
+          LOG_EVERY_N(WARNING, 1000)
+              << "PacketIn queue for gRPC context '" << &context_
+              << "' is full. Dropping PacketIns.";
+        }
+        if (result.queued > 0 && !write_in_flight_) {
+          write_in_flight_ = true;
+          WriteNextResponse();
+        }
+        return result;
+      }
+
+      // Writes the front of pending_responses_, or ends the write chain once
+      // nothing is left. PacketIns are only moved there once every other
+      // response has been written, so arbitration updates and errors go ahead
+      // of them. Responses with more queued behind them are written with a
+      // buffer hint, so a burst is coalesced and flushed by its last response.
+      void WriteNextResponse() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+        const StreamMetrics& metrics = connection_.metrics();
+        while (true) {
+          if (pending_responses_.empty()) {
+            packet_ins_.Pop(1, &pending_responses_);
+          }
+          if (pending_responses_.empty()) {
+            write_in_flight_ = false;
+            return;
+          }
+          // Shared responses are serialized once for every stream they are
+          // written to.
+          grpc::ByteBuffer buffer;
+          grpc::Status status = pending_responses_.front().Serialize(&buffer);
+          if (status.ok()) {
+            grpc::WriteOptions options;
+            if (pending_responses_.size() > 1 || !packet_ins_.empty()) {
+              options.set_buffer_hint();
+            }
+            stream_.Write(buffer, options, Tag(&write_tag_));
+            return;
+          }
+          LOG(ERROR) << "Could not serialize stream response for gRPC context '"
+                     << &context_ << "': " << status.error_message();
+          pending_responses_.pop_front();
+          if (metrics.dropped_write_failed != nullptr) {
+            metrics.dropped_write_failed->Increment();
+          }
+          if (metrics.outbound_queue_depth != nullptr) {
+            metrics.outbound_queue_depth->Add(-1);
+          }
+        }
+      }
+
+      void OnWrite(bool ok) {
+        {
+          absl::MutexLock l(&lock_);
+          CompleteWrite(ok);
+          if (!StartFinishing()) return;
+        }
+        Finish();
+      }
+
+      void CompleteWrite(bool ok) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+        pending_responses_.pop_front();
+        // The written response, and everything dropped after a failure.
+        int dequeued = 1;
+        const StreamMetrics& metrics = connection_.metrics();
+        if (!ok) {
+          LOG(ERROR) << "Could not send stream response to gRPC context '"
+                     << &context_ << "'.";
+          dequeued += pending_responses_.size() + packet_ins_.Clear();
+          if (metrics.dropped_write_failed != nullptr) {
+            metrics.dropped_write_failed->Increment(dequeued);
+          }
+          write_failed_ = true;
+          pending_responses_.clear();
+        }
+        if (metrics.outbound_queue_depth != nullptr) {
+          metrics.outbound_queue_depth->Add(-dequeued);
+        }
+        WriteNextResponse();
+      }
+
+      // Returns true once reading is done and every queued response has been
+      // written, and only to the first caller, which must then call Finish.
+      bool StartFinishing() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+        if (!reading_done_ || write_in_flight_ || finishing_) return false;
+        finishing_ = true;
+        return true;
+      }
+
+      // Must be called without lock_ held, and must be the last use of the
+      // call: OnFinish may delete it on the completion queue thread before
+      // Finish even returns.
+      void Finish() ABSL_LOCKS_EXCLUDED(lock_) {
+        grpc::Status status;
+        {
+          absl::MutexLock l(&lock_);
+          status = finish_status_;
+        }
+        stream_.Finish(status, Tag(&finish_tag_));
+      }
+
+      void OnFinish(bool /*ok*/) { delete this; }
+
+      AsyncP4RtServer::Service* service_;
+      grpc::ServerCompletionQueue* cq_;
+      P4RtServer* server_;
+      WorkerPool* packet_out_workers_;
+
+      grpc::ServerContext context_;
+      grpc::ServerAsyncReaderWriter<grpc::ByteBuffer, grpc::ByteBuffer> stream_;
+      AsyncSdnConnection connection_;
+      // Created once the stream is connected, destroyed before connection_.
+      std::unique_ptr<PacketOutDispatcher> packet_out_dispatcher_;
+      // Reused for every message so its nested fields are reallocated only
+      // when a message outgrows them. Not on an arena, which would only grow
+      // over the lifetime of the stream.
+      grpc::ByteBuffer request_buffer_;
+      p4::v1::StreamMessageRequest request_;
+
+      MemberTag<StreamChannelCall> connect_tag_;
+      MemberTag<StreamChannelCall> read_tag_;
+      MemberTag<StreamChannelCall> write_tag_;
+      MemberTag<StreamChannelCall> finish_tag_;
+
+      // Protects the write chain, which is shared between the completion
+      // queue thread and any thread sending a response.
+      absl::Mutex lock_;
+      std::deque<OutboundResponse> pending_responses_ ABSL_GUARDED_BY(lock_);
+      PacketInQueue packet_ins_ ABSL_GUARDED_BY(lock_);
+      bool write_in_flight_ ABSL_GUARDED_BY(lock_) = false;
+      bool write_failed_ ABSL_GUARDED_BY(lock_) = false;
+      bool reading_done_ ABSL_GUARDED_BY(lock_) = false;
+      bool finishing_ ABSL_GUARDED_BY(lock_) = false;
+      grpc::Status finish_status_ ABSL_GUARDED_BY(lock_);
+  };
+}
+
+AsyncP4RtServer::AsyncP4RtServer(
+    std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider,
+    int num_threads, int num_read_threads, int num_unary_threads)
+    : server_(std::move(switch_provider)),
+      num_threads_(num_threads > 0 ? num_threads : 1),
+      num_read_threads_(num_read_threads > 0 ? num_read_threads : 1),
+      num_unary_threads_(num_unary_threads > 0 ? num_unary_threads : 1) {}
+
+AsyncP4RtServer::~AsyncP4RtServer() { Shutdown(); }
+
+void AsyncP4RtServer::RegisterService(grpc::ServerBuilder* builder) {
+  builder->RegisterService(&service_);
+  for (int i = 0; i < num_threads_; ++i) {
+    completion_queues_.push_back(builder->AddCompletionQueue());
+  }
+}
+
+void AsyncP4RtServer::Start() {
+  read_workers_ = absl::make_unique<WorkerPool>(num_read_threads_);
+  unary_workers_ = absl::make_unique<WorkerPool>(num_unary_threads_);
+  packet_out_workers_ = absl::make_unique<WorkerPool>(num_threads_);
+  for (auto& cq : completion_queues_) {
+    // Every completion queue has one call of each type waiting for a new
+    // request. Calls re-arm themselves as requests arrive.
+    new UnaryCall<p4::v1::WriteRequest, p4::v1::WriteResponse>(
+        &service_, cq.get(), &server_, unary_workers_.get(),
+        &AsyncP4RtServer::Service::RequestWrite, &P4RtServer::Write);
+    new UnaryCall<p4::v1::SetForwardingPipelineConfigRequest,
+                  p4::v1::SetForwardingPipelineConfigResponse>(
+        &service_, cq.get(), &server_, unary_workers_.get(),
+        &AsyncP4RtServer::Service::RequestSetForwardingPipelineConfig,
+        &P4RtServer::SetForwardingPipelineConfig);
+    new UnaryCall<p4::v1::GetForwardingPipelineConfigRequest,
+                  p4::v1::GetForwardingPipelineConfigResponse>(
+        &service_, cq.get(), &server_, unary_workers_.get(),
+        &AsyncP4RtServer::Service::RequestGetForwardingPipelineConfig,
+        &P4RtServer::GetForwardingPipelineConfig);
+    new ReadCall(&service_, cq.get(), &server_, read_workers_.get());
+    new StreamChannelCall(&service_, cq.get(), &server_,
+                          packet_out_workers_.get());
+    auto* queue = cq.get();
+    workers_.emplace_back([this, queue]() { PollCompletionQueue(queue); });
+  }
+}
+
+void AsyncP4RtServer::Shutdown() {
+  // The grpc::Server is already shut down, so every Read in progress fails
+  // its next write and finishes, and unary calls finish once their handler
+  // returns. Their completions still need the queues.
+  read_workers_.reset();
+  unary_workers_.reset();
+  // Shutting down the completion queues fails every pending request, which
+  // lets the calls waiting on them clean up. The loops in PollCompletionQueue
+  // return once the queues are drained.
+  for (auto& cq : completion_queues_) {
+    cq->Shutdown();
+    if (workers_.empty()) PollCompletionQueue(cq.get());
+  }
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  completion_queues_.clear();
+  // Every stream, and with it its PacketOut dispatcher, is gone.
+  packet_out_workers_.reset();
+}
+
+void AsyncP4RtServer::PollCompletionQueue(grpc::ServerCompletionQueue* cq) {
+  void* tag;
+  bool ok;
+  while (cq->Next(&tag, &ok)) {
+#ifdef __EXCEPTIONS
+    try {
+#endif
+      static_cast<AsyncTag*>(tag)->Proceed(ok);
+#ifdef __EXCEPTIONS
+    } catch (const std::exception& e) {
+      LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
+    } catch (...) {
+      LOG(FATAL) << "Unknown exception caught in " << __func__;
+    }
+#endif
+  }
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ASYNC_P4RT_SERVER_H_
+#define ASYNC_P4RT_SERVER_H_
+
+#include "p4rt_server.h"
+#include "switch_provider_base.h"
+#include "worker_pool.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "grpcpp/grpcpp.h"
+#include "grpcpp/server_builder.h"
+#include "p4/v1/p4runtime.grpc.pb.h"
+
+namespace p4rt_server{
+
+/*
+ * AsyncP4RtServer serves the P4Runtime service through the gRPC completion
+ * queue API. Unlike P4RtServer, which pins a gRPC thread for every open
+ * StreamChannel and for every in-flight RPC, a fixed number of worker threads
+ * (one per completion queue) drive all streams and RPCs. Request handling,
+ * arbitration and the SwitchProviderBase plumbing are shared with P4RtServer.
+ *
+ * The completion queue threads never block. Write, SetForwardingPipelineConfig
+ * and GetForwardingPipelineConfig run on a pool of num_unary_threads threads,
+ * since they may wait for admission, a group commit window or the provider,
+ * so num_unary_threads bounds the number of those handled at once. Reads run
+ * on a pool of num_read_threads threads, since they wait for every chunk to
+ * be written before reading the next, and the PacketOuts of every stream are
+ * dispatched on a shared pool of num_threads threads.
+ *
+ * Usage:
+ *   AsyncP4RtServer p4runtime_server(std::move(provider));
+ *   ServerBuilder builder;
+ *   builder.AddListeningPort(kServerAddress, *server_cred);
+ *   p4runtime_server.RegisterService(&builder);
+ *   std::unique_ptr<Server> server(builder.BuildAndStart());
+ *   p4runtime_server.Start();
+ *   ...
+ *   server->Shutdown();
+ *   p4runtime_server.Shutdown();
+ */
+class AsyncP4RtServer {
+  public:
+    static constexpr int kDefaultNumThreads = 2;
+    static constexpr int kDefaultNumReadThreads = 4;
+    static constexpr int kDefaultNumUnaryThreads = 4;
+
+    // StreamChannel is registered as a raw method: its messages are read and
+    // written as serialized bytes, so a response sent on several streams is
+    // serialized once. Every other method is a regular async method.
+    using Service = p4::v1::P4Runtime::WithAsyncMethod_Write<
+        p4::v1::P4Runtime::WithAsyncMethod_Read<
+            p4::v1::P4Runtime::WithAsyncMethod_SetForwardingPipelineConfig<
+                p4::v1::P4Runtime::WithAsyncMethod_GetForwardingPipelineConfig<
+                    p4::v1::P4Runtime::WithRawMethod_StreamChannel<
+                        p4::v1::P4Runtime::WithAsyncMethod_Capabilities<
+                            p4::v1::P4Runtime::Service>>>>>>;
+
+    AsyncP4RtServer(
+        std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider,
+        int num_threads = kDefaultNumThreads,
+        int num_read_threads = kDefaultNumReadThreads,
+        int num_unary_threads = kDefaultNumUnaryThreads);
+    ~AsyncP4RtServer();
+
+    AsyncP4RtServer(const AsyncP4RtServer&) = delete;
+    AsyncP4RtServer& operator=(const AsyncP4RtServer&) = delete;
+
+    // Registers the service and one completion queue per worker thread with
+    // the builder. Must be called before grpc::ServerBuilder::BuildAndStart.
+    void RegisterService(grpc::ServerBuilder* builder);
+
+    // Starts accepting RPCs on the worker threads. Must be called after
+    // grpc::ServerBuilder::BuildAndStart.
+    void Start();
+
+    // Drains the completion queues and joins the worker threads. The
+    // grpc::Server must be shut down first.
+    void Shutdown();
+
+    bool SendPacketIn(const absl::optional<std::string>& role_name,
+                      const p4::v1::StreamMessageResponse& response){
+      return server_.SendPacketIn(role_name, response);
+    }
+
+    // See P4RtServer::metrics.
+    std::shared_ptr<MetricsRegistry> metrics() const {
+      return server_.metrics();
+    }
+
+  private:
+    void PollCompletionQueue(grpc::ServerCompletionQueue* cq);
+
+    // Request handling is shared with the synchronous server. server_ itself
+    // is never registered with gRPC.
+    P4RtServer server_;
+    Service service_;
+
+    int num_threads_;
+    int num_read_threads_;
+    int num_unary_threads_;
+    // Created by Start, destroyed by Shutdown.
+    std::unique_ptr<WorkerPool> read_workers_;
+    std::unique_ptr<WorkerPool> unary_workers_;
+    std::unique_ptr<WorkerPool> packet_out_workers_;
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> completion_queues_;
+    std::vector<std::thread> workers_;
+};
+
+}
+
+#endif //ifndef ASYNC_P4RT_SERVER_H_
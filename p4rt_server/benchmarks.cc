@@ -0,0 +1,368 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// End to end benchmarks of p4rt_server. Every benchmark serves a P4RtServer
+// (or an AsyncP4RtServer) backed by a MockSwitchProvider over an in-process
+// gRPC channel, and reports its throughput plus the p50/p99 latency of the
+// measured operation.
+//
+//   bazel run -c opt //p4rt_server:benchmarks -- --benchmark_filter=Write
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_p4rt_server.h"
+#include "mock_switch_provider.h"
+#include "p4rt_server.h"
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "benchmark/benchmark.h"
+#include "glog/logging.h"
+#include "grpcpp/grpcpp.h"
+#include "p4/config/v1/p4info.pb.h"
+#include "p4/v1/p4runtime.grpc.pb.h"
+
+namespace p4rt_server{
+namespace{
+   constexpr uint32_t kTableId = 0x02000001;
+   constexpr uint32_t kMatchFieldId = 1;
+   constexpr uint32_t kActionId = 0x01000001;
+   constexpr uint32_t kParamId = 1;
+
+   using StreamChannelStream =
+       grpc::ClientReaderWriter<p4::v1::StreamMessageRequest,
+                                p4::v1::StreamMessageResponse>;
+
+   // One exact match table with a single action, so writes go through the
+   // P4Info validation like they would on a real pipeline.
+   p4::config::v1::P4Info BenchmarkP4Info() {
+     p4::config::v1::P4Info p4info;
+     auto* action = p4info.add_actions();
+     action->mutable_preamble()->set_id(kActionId);
+     action->mutable_preamble()->set_name("set_port");
+     auto* param = action->add_params();
+     param->set_id(kParamId);
+     param->set_name("port");
+     param->set_bitwidth(32);
+
+     auto* table = p4info.add_tables();
+     table->mutable_preamble()->set_id(kTableId);
+     table->mutable_preamble()->set_name("forward");
+     auto* match = table->add_match_fields();
+     match->set_id(kMatchFieldId);
+     match->set_name("dst");
+     match->set_bitwidth(32);
+     match->set_match_type(p4::config::v1::MatchField::EXACT);
+     table->add_action_refs()->set_id(kActionId);
+     return p4info;
+   }
+
+   std::string Uint32Bytes(uint32_t value) {
+     std::string bytes(4, '\0');
+     for (int i = 3; i >= 0; --i, value >>= 8) bytes[i] = value & 0xff;
+     return bytes;
+   }
+
+   p4::v1::TableEntry BenchmarkTableEntry(uint32_t key) {
+     p4::v1::TableEntry entry;
+     entry.set_table_id(kTableId);
+     auto* match = entry.add_match();
+     match->set_field_id(kMatchFieldId);
+     match->mutable_exact()->set_value(Uint32Bytes(key));
+     auto* action = entry.mutable_action()->mutable_action();
+     action->set_action_id(kActionId);
+     auto* param = action->add_params();
+     param->set_param_id(kParamId);
+     param->set_value(Uint32Bytes(key % 64));
+     return entry;
+   }
+
+   p4::v1::Uint128 ElectionId(uint64_t low) {
+     p4::v1::Uint128 id;
+     id.set_low(low);
+     return id;
+   }
+
+   // Adds throughput and latency percentiles of the measured operations to the
+   // benchmark output.
+   void ReportLatencies(benchmark::State& state,
+                        std::vector<absl::Duration> latencies,
+                        int64_t items_per_operation) {
+     state.SetItemsProcessed(latencies.size() * items_per_operation);
+     if (latencies.empty()) return;
+     std::sort(latencies.begin(), latencies.end());
+     auto percentile = [&latencies](double p) {
+       size_t index = static_cast<size_t>(p * (latencies.size() - 1));
+       return absl::ToDoubleMicroseconds(latencies[index]);
+     };
+     state.counters["p50_us"] = percentile(0.50);
+     state.counters["p99_us"] = percentile(0.99);
+   }
+
+   // A StreamChannel opened by the benchmark client.
+   class StreamChannel {
+     public:
+      explicit StreamChannel(p4::v1::P4Runtime::Stub* stub)
+          : stream_(stub->StreamChannel(&context_)) {}
+
+      ~StreamChannel() {
+        stream_->WritesDone();
+        if (drainer_.joinable()) {
+          drainer_.join();
+        } else {
+          p4::v1::StreamMessageResponse response;
+          while (stream_->Read(&response)) {}
+        }
+        stream_->Finish();
+      }
+
+      // Sends an arbitration update and waits for the server's answer.
+      bool Arbitrate(absl::optional<uint64_t> election_id) {
+        p4::v1::StreamMessageRequest request;
+        request.mutable_arbitration()->set_device_id(1);
+        if (election_id.has_value()) {
+          *request.mutable_arbitration()->mutable_election_id() =
+              ElectionId(*election_id);
+        }
+        p4::v1::StreamMessageResponse response;
+        return stream_->Write(request) && stream_->Read(&response) &&
+               response.has_arbitration();
+      }
+
+      // Reads and discards every further response in the background, like a
+      // backup controller that keeps up with its arbitration updates.
+      void DrainInBackground() {
+        drainer_ = std::thread([this]() {
+          p4::v1::StreamMessageResponse response;
+          while (stream_->Read(&response)) {}
+        });
+      }
+
+      StreamChannelStream* stream() { return stream_.get(); }
+
+     private:
+      grpc::ClientContext context_;
+      std::unique_ptr<StreamChannelStream> stream_;
+      std::thread drainer_;
+   };
+
+   // Serves p4rt_server on an in-process channel. The harness holds the
+   // primary connection of the default role (election ID 1) and the P4Info
+   // from BenchmarkP4Info is pushed.
+   class Harness {
+     public:
+      Harness(MockSwitchProvider::Options options, bool async) {
+        auto provider = absl::make_unique<MockSwitchProvider>(options);
+        grpc::ServerBuilder builder;
+        if (async) {
+          async_server_ =
+              absl::make_unique<AsyncP4RtServer>(std::move(provider));
+          async_server_->RegisterService(&builder);
+        } else {
+          sync_server_ = absl::make_unique<P4RtServer>(std::move(provider));
+          builder.RegisterService(sync_server_.get());
+        }
+        server_ = builder.BuildAndStart();
+        if (async_server_ != nullptr) async_server_->Start();
+        stub_ = p4::v1::P4Runtime::NewStub(
+            server_->InProcessChannel(grpc::ChannelArguments()));
+
+        primary_ = absl::make_unique<StreamChannel>(stub_.get());
+        CHECK(primary_->Arbitrate(1)) << "Could not become primary.";
+
+        p4::v1::SetForwardingPipelineConfigRequest request;
+        request.set_device_id(1);
+        *request.mutable_election_id() = ElectionId(1);
+        request.set_action(
+            p4::v1::SetForwardingPipelineConfigRequest::VERIFY_AND_COMMIT);
+        *request.mutable_config()->mutable_p4info() = BenchmarkP4Info();
+        grpc::ClientContext context;
+        p4::v1::SetForwardingPipelineConfigResponse response;
+        auto status =
+            stub_->SetForwardingPipelineConfig(&context, request, &response);
+        CHECK(status.ok()) << status.error_message();
+      }
+
+      ~Harness() {
+        backups_.clear();
+        primary_.reset();
+        server_->Shutdown();
+        if (async_server_ != nullptr) async_server_->Shutdown();
+      }
+
+      // Adds backup connections, which never read anything but arbitration
+      // updates.
+      void AddBackups(int count) {
+        for (int i = 0; i < count; ++i) {
+          auto backup = absl::make_unique<StreamChannel>(stub_.get());
+          CHECK(backup->Arbitrate(absl::nullopt));
+          backup->DrainInBackground();
+          backups_.push_back(std::move(backup));
+        }
+      }
+
+      p4::v1::P4Runtime::Stub* stub() { return stub_.get(); }
+      StreamChannel* primary() { return primary_.get(); }
+      void set_primary(std::unique_ptr<StreamChannel> primary) {
+        primary_ = std::move(primary);
+      }
+
+     private:
+      std::unique_ptr<P4RtServer> sync_server_;
+      std::unique_ptr<AsyncP4RtServer> async_server_;
+      std::unique_ptr<grpc::Server> server_;
+      std::unique_ptr<p4::v1::P4Runtime::Stub> stub_;
+      std::unique_ptr<StreamChannel> primary_;
+      std::vector<std::unique_ptr<StreamChannel>> backups_;
+   };
+
+   // Args: updates per WriteRequest, provider executes per update, async.
+   void BM_Write(benchmark::State& state) {
+     int batch_size = state.range(0);
+     MockSwitchProvider::Options options;
+     options.write_update_parallelism = state.range(1);
+     Harness harness(options, state.range(2));
+
+     p4::v1::WriteRequest request;
+     request.set_device_id(1);
+     *request.mutable_election_id() = ElectionId(1);
+     if (options.write_update_parallelism > 0) {
+       request.set_atomicity(p4::v1::WriteRequest::CONTINUE_ON_ERROR);
+     }
+     for (int i = 0; i < batch_size; ++i) {
+       auto* update = request.add_updates();
+       update->set_type(p4::v1::Update::INSERT);
+       *update->mutable_entity()->mutable_table_entry() =
+           BenchmarkTableEntry(i);
+     }
+
+     std::vector<absl::Duration> latencies;
+     for (auto _ : state) {
+       absl::Time start = absl::Now();
+       grpc::ClientContext context;
+       p4::v1::WriteResponse response;
+       auto status = harness.stub()->Write(&context, request, &response);
+       latencies.push_back(absl::Now() - start);
+       if (!status.ok()) {
+         state.SkipWithError(status.error_message().c_str());
+         break;
+       }
+     }
+     ReportLatencies(state, std::move(latencies), batch_size);
+   }
+   BENCHMARK(BM_Write)
+       ->ArgNames({"batch", "parallelism", "async"})
+       ->ArgsProduct({{1, 10, 100, 1000}, {0}, {0, 1}})
+       ->Args({1000, 4, 0})
+       ->UseRealTime();
+
+   // Args: table entries returned by the wildcard read, async.
+   void BM_WildcardRead(benchmark::State& state) {
+     int num_entries = state.range(0);
+     MockSwitchProvider::Options options;
+     for (int i = 0; i < num_entries; ++i) {
+       *options.read_response.add_entities()->mutable_table_entry() =
+           BenchmarkTableEntry(i);
+     }
+     Harness harness(options, state.range(1));
+
+     p4::v1::ReadRequest request;
+     request.set_device_id(1);
+     request.add_entities()->mutable_table_entry();
+
+     std::vector<absl::Duration> latencies;
+     for (auto _ : state) {
+       absl::Time start = absl::Now();
+       grpc::ClientContext context;
+       auto reader = harness.stub()->Read(&context, request);
+       p4::v1::ReadResponse response;
+       int entities = 0;
+       while (reader->Read(&response)) entities += response.entities_size();
+       auto status = reader->Finish();
+       latencies.push_back(absl::Now() - start);
+       if (!status.ok() || entities != num_entries) {
+         state.SkipWithError("Read did not return every entry.");
+         break;
+       }
+     }
+     ReportLatencies(state, std::move(latencies), num_entries);
+   }
+   BENCHMARK(BM_WildcardRead)
+       ->ArgNames({"entries", "async"})
+       ->ArgsProduct({{100, 10000}, {0, 1}})
+       ->UseRealTime();
+
+   // PacketOut to PacketIn round trips through a provider that echoes every
+   // packet. Args: packets in flight, backup connections, async.
+   void BM_PacketOutPacketIn(benchmark::State& state) {
+     int in_flight = state.range(0);
+     MockSwitchProvider::Options options;
+     options.echo_packet_outs = true;
+     Harness harness(options, state.range(2));
+     harness.AddBackups(state.range(1));
+
+     p4::v1::StreamMessageRequest request;
+     request.mutable_packet()->set_payload(std::string(256, 'p'));
+     StreamChannelStream* stream = harness.primary()->stream();
+
+     std::vector<absl::Duration> latencies;
+     for (auto _ : state) {
+       absl::Time start = absl::Now();
+       for (int i = 0; i < in_flight; ++i) stream->Write(request);
+       p4::v1::StreamMessageResponse response;
+       int packet_ins = 0;
+       while (packet_ins < in_flight && stream->Read(&response)) {
+         if (response.has_packet()) ++packet_ins;
+       }
+       latencies.push_back(absl::Now() - start);
+       if (packet_ins < in_flight) {
+         state.SkipWithError("StreamChannel closed.");
+         break;
+       }
+     }
+     ReportLatencies(state, std::move(latencies), in_flight);
+   }
+   BENCHMARK(BM_PacketOutPacketIn)
+       ->ArgNames({"in_flight", "backups", "async"})
+       ->ArgsProduct({{1, 64}, {0, 100}, {0, 1}})
+       ->UseRealTime();
+
+   // A new controller takes over as primary with a higher election ID, and the
+   // old primary disconnects. Every change is announced to the backups.
+   // Args: backup connections, async.
+   void BM_ArbitrationChurn(benchmark::State& state) {
+     Harness harness(MockSwitchProvider::Options(), state.range(1));
+     harness.AddBackups(state.range(0));
+
+     uint64_t election_id = 1;
+     std::vector<absl::Duration> latencies;
+     for (auto _ : state) {
+       absl::Time start = absl::Now();
+       auto primary = absl::make_unique<StreamChannel>(harness.stub());
+       bool ok = primary->Arbitrate(++election_id);
+       latencies.push_back(absl::Now() - start);
+       if (!ok) {
+         state.SkipWithError("Arbitration failed.");
+         break;
+       }
+       // The old primary is now a backup that receives the update.
+       harness.primary()->DrainInBackground();
+       harness.set_primary(std::move(primary));
+     }
+     ReportLatencies(state, std::move(latencies), 1);
+   }
+   BENCHMARK(BM_ArbitrationChurn)
+       ->ArgNames({"backups", "async"})
+       ->ArgsProduct({{0, 100}, {0, 1}})
+       ->UseRealTime();
+}
+}//namespace p4rt_server
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "counter_cache.h"
+#include "entity_store.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+
+namespace p4rt_server{
+namespace {
+
+   const p4::v1::CounterData& DataOf(const p4::v1::CounterEntry& entry) {
+     return entry.data();
+   }
+   const p4::v1::MeterConfig& DataOf(const p4::v1::MeterEntry& entry) {
+     return entry.config();
+   }
+
+   // Stores one array's entries, sorted by index.
+   template <typename Entry, typename Indexed>
+   void StoreIndexed(std::vector<Entry>* entries, Indexed* indexed) {
+     std::sort(entries->begin(), entries->end(),
+               [](const Entry& a, const Entry& b) {
+                 return a.index().index() < b.index().index();
+               });
+     indexed->indices.reserve(entries->size());
+     for (const Entry& entry : *entries) {
+       indexed->indices.push_back(entry.index().index());
+       indexed->columns.Append(DataOf(entry));
+     }
+   }
+
+   // Returns the positions of the indexed entries the filter selects.
+   template <typename Indexed>
+   std::pair<size_t, size_t> IndexRange(const Indexed& indexed, bool has_index,
+                                        int64_t index) {
+     if (!has_index) return {0, indexed.indices.size()};
+     auto it = std::lower_bound(indexed.indices.begin(), indexed.indices.end(),
+                                index);
+     if (it == indexed.indices.end() || *it != index) return {0, 0};
+     size_t position = it - indexed.indices.begin();
+     return {position, position + 1};
+   }
+
+}  // namespace
+
+void CounterCache::CounterColumns::Append(const p4::v1::CounterData& data) {
+  byte_counts.push_back(data.byte_count());
+  packet_counts.push_back(data.packet_count());
+}
+
+void CounterCache::CounterColumns::Fill(size_t i,
+                                        p4::v1::CounterData* data) const {
+  data->set_byte_count(byte_counts[i]);
+  data->set_packet_count(packet_counts[i]);
+}
+
+void CounterCache::MeterColumns::Append(const p4::v1::MeterConfig& config) {
+  cirs.push_back(config.cir());
+  cbursts.push_back(config.cburst());
+  pirs.push_back(config.pir());
+  pbursts.push_back(config.pburst());
+}
+
+void CounterCache::MeterColumns::Fill(size_t i,
+                                      p4::v1::MeterConfig* config) const {
+  config->set_cir(cirs[i]);
+  config->set_cburst(cbursts[i]);
+  config->set_pir(pirs[i]);
+  config->set_pburst(pbursts[i]);
+}
+
+CounterCache::CounterCache(const CounterCacheOptions& options, Reader reader)
+    : options_(options), reader_(std::move(reader)) {
+  poller_ = std::thread([this]() { RunPoller(); });
+}
+
+CounterCache::~CounterCache() {
+  {
+    absl::MutexLock l(&lock_);
+    shutdown_ = true;
+  }
+  poller_.join();
+}
+
+bool CounterCache::CanServe(const p4::v1::Entity& entity) {
+  switch (entity.entity_case()) {
+    case p4::v1::Entity::kCounterEntry:
+    case p4::v1::Entity::kMeterEntry:
+    case p4::v1::Entity::kDirectCounterEntry:
+    case p4::v1::Entity::kDirectMeterEntry:
+      return true;
+    default:
+      return false;
+  }
+}
+
+std::string CounterCache::DirectKey(const p4::v1::TableEntry& entry) {
+  if (entry.is_default_action()) return "default";
+  return absl::StrCat("entry", EntityStore::MatchKey(entry));
+}
+
+bool CounterCache::Read(const p4::v1::Entity& filter,
+                        const std::function<bool(uint32_t)>& table_visible,
+                        p4::v1::ReadResponse* response) const {
+  auto snapshot = snapshot_.Load();
+  if (snapshot == nullptr ||
+      absl::Now() - snapshot->read_time > options_.max_staleness) {
+    return false;
+  }
+
+  // Appends the entries of the indexed arrays the filter selects.
+  auto read_indexed = [](const auto& arrays, uint32_t id, bool has_index,
+                         int64_t index, const auto& append) {
+    auto read_array = [&](uint32_t array_id, const auto& indexed) {
+      auto range = IndexRange(indexed, has_index, index);
+      for (size_t i = range.first; i < range.second; ++i) {
+        append(array_id, indexed, i);
+      }
+    };
+    if (id == 0) {
+      for (const auto& array : arrays) read_array(array.first, array.second);
+      return;
+    }
+    auto it = arrays.find(id);
+    if (it != arrays.end()) read_array(id, it->second);
+  };
+
+  // Appends the direct entries of the tables the filter selects.
+  auto read_direct = [&table_visible](const auto& tables,
+                                      const p4::v1::TableEntry& entry_filter,
+                                      const auto& append) {
+    bool wildcard_entries =
+        entry_filter.match_size() == 0 && !entry_filter.is_default_action();
+    auto read_table = [&](uint32_t table_id, const auto& direct) {
+      if (table_visible && !table_visible(table_id)) return;
+      if (wildcard_entries) {
+        for (size_t i = 0; i < direct.entries.size(); ++i) append(direct, i);
+        return;
+      }
+      auto position = direct.positions.find(DirectKey(entry_filter));
+      if (position != direct.positions.end()) append(direct, position->second);
+    };
+    if (entry_filter.table_id() == 0) {
+      for (const auto& table : tables) read_table(table.first, table.second);
+      return;
+    }
+    auto it = tables.find(entry_filter.table_id());
+    if (it != tables.end()) read_table(it->first, it->second);
+  };
+
+  switch (filter.entity_case()) {
+    case p4::v1::Entity::kCounterEntry: {
+      const auto& counter = filter.counter_entry();
+      read_indexed(snapshot->counters, counter.counter_id(),
+                   counter.has_index(), counter.index().index(),
+                   [response](uint32_t id, const auto& indexed, size_t i) {
+                     auto* entry =
+                         response->add_entities()->mutable_counter_entry();
+                     entry->set_counter_id(id);
+                     entry->mutable_index()->set_index(indexed.indices[i]);
+                     indexed.columns.Fill(i, entry->mutable_data());
+                   });
+      return true;
+    }
+    case p4::v1::Entity::kMeterEntry: {
+      const auto& meter = filter.meter_entry();
+      read_indexed(snapshot->meters, meter.meter_id(), meter.has_index(),
+                   meter.index().index(),
+                   [response](uint32_t id, const auto& indexed, size_t i) {
+                     auto* entry =
+                         response->add_entities()->mutable_meter_entry();
+                     entry->set_meter_id(id);
+                     entry->mutable_index()->set_index(indexed.indices[i]);
+                     indexed.columns.Fill(i, entry->mutable_config());
+                   });
+      return true;
+    }
+    case p4::v1::Entity::kDirectCounterEntry:
+      read_direct(snapshot->direct_counters,
+                  filter.direct_counter_entry().table_entry(),
+                  [response](const auto& direct, size_t i) {
+                    auto* entry =
+                        response->add_entities()->mutable_direct_counter_entry();
+                    *entry->mutable_table_entry() = direct.entries[i];
+                    direct.columns.Fill(i, entry->mutable_data());
+                  });
+      return true;
+    case p4::v1::Entity::kDirectMeterEntry:
+      read_direct(snapshot->direct_meters,
+                  filter.direct_meter_entry().table_entry(),
+                  [response](const auto& direct, size_t i) {
+                    auto* entry =
+                        response->add_entities()->mutable_direct_meter_entry();
+                    *entry->mutable_table_entry() = direct.entries[i];
+                    direct.columns.Fill(i, entry->mutable_config());
+                  });
+      return true;
+    default:
+      return false;
+  }
+}
+
+absl::Status CounterCache::Poll() {
+  p4::v1::ReadRequest request;
+  request.add_entities()->mutable_counter_entry();
+  request.add_entities()->mutable_meter_entry();
+  request.add_entities()->mutable_direct_counter_entry()->mutable_table_entry();
+  request.add_entities()->mutable_direct_meter_entry()->mutable_table_entry();
+  uint64_t generation;
+  {
+    absl::MutexLock l(&lock_);
+    generation = generation_;
+  }
+
+  // Staleness is measured from the start of the read.
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->read_time = absl::Now();
+  // Indexed entries may arrive in any order, and are sorted once read.
+  absl::flat_hash_map<uint32_t, std::vector<p4::v1::CounterEntry>> counters;
+  absl::flat_hash_map<uint32_t, std::vector<p4::v1::MeterEntry>> meters;
+  auto add_direct = [](p4::v1::TableEntry* table_entry, const auto& data,
+                       auto* tables) {
+    auto& direct = (*tables)[table_entry->table_id()];
+    // Only the key of the entry is kept.
+    table_entry->clear_action();
+    table_entry->clear_counter_data();
+    table_entry->clear_meter_config();
+    table_entry->clear_time_since_last_hit();
+    if (!direct.positions.emplace(DirectKey(*table_entry), direct.entries.size())
+             .second) {
+      return;
+    }
+    direct.entries.push_back(std::move(*table_entry));
+    direct.columns.Append(data);
+  };
+  absl::Status status =
+      reader_(request, [&](p4::v1::Entity entity) {
+        switch (entity.entity_case()) {
+          case p4::v1::Entity::kCounterEntry:
+            counters[entity.counter_entry().counter_id()].push_back(
+                std::move(*entity.mutable_counter_entry()));
+            break;
+          case p4::v1::Entity::kMeterEntry:
+            meters[entity.meter_entry().meter_id()].push_back(
+                std::move(*entity.mutable_meter_entry()));
+            break;
+          case p4::v1::Entity::kDirectCounterEntry: {
+            auto* entry = entity.mutable_direct_counter_entry();
+            add_direct(entry->mutable_table_entry(), entry->data(),
+                       &snapshot->direct_counters);
+            break;
+          }
+          case p4::v1::Entity::kDirectMeterEntry: {
+            auto* entry = entity.mutable_direct_meter_entry();
+            add_direct(entry->mutable_table_entry(), entry->config(),
+                       &snapshot->direct_meters);
+            break;
+          }
+          default:
+            break;
+        }
+        return true;
+      });
+  if (!status.ok()) return status;
+
+  for (auto& counter : counters) {
+    StoreIndexed(&counter.second, &snapshot->counters[counter.first]);
+  }
+  for (auto& meter : meters) {
+    StoreIndexed(&meter.second, &snapshot->meters[meter.first]);
+  }
+  absl::MutexLock l(&lock_);
+  if (generation_ != generation) return absl::OkStatus();
+  snapshot_.Store(std::move(snapshot));
+  return absl::OkStatus();
+}
+
+void CounterCache::Clear() {
+  absl::MutexLock l(&lock_);
+  ++generation_;
+  snapshot_.Store(nullptr);
+}
+
+void CounterCache::RunPoller() {
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    auto stopped = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return shutdown_;
+    };
+    while (true) {
+      absl::Time next_poll = absl::Now() + options_.poll_interval;
+      absl::Status status = Poll();
+      if (!status.ok()) {
+        LOG_EVERY_N(WARNING, 100) << "Counter cache poll failed: " << status;
+      }
+      absl::MutexLock l(&lock_);
+      if (lock_.AwaitWithDeadline(absl::Condition(&stopped), next_poll)) {
+        return;
+      }
+    }
+#ifdef __EXCEPTIONS
+  } catch (const std::exception& e) {
+    LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
+  } catch (...) {
+    LOG(FATAL) << "Unknown exception caught in " << __func__;
+  }
+#endif
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _COUNTER_CACHE_H_
+#define _COUNTER_CACHE_H_
+
+#include "rcu_ptr.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+struct CounterCacheOptions {
+  // How often every counter, direct counter, meter and direct meter is read
+  // from the switch. 0 disables the cache.
+  absl::Duration poll_interval = absl::ZeroDuration();
+  // Reads are only served from the cache while its data is at most this old,
+  // and from the switch otherwise, e.g. while polls fail.
+  absl::Duration max_staleness = absl::Seconds(5);
+};
+
+// Counter and meter state of the switch, refreshed in the background.
+//
+// A poller thread reads all counter, direct counter, meter and direct meter
+// entities with one wildcard ReadRequest per poll_interval, and publishes the
+// result as an immutable snapshot. Reads of those entity types are then
+// answered from the latest snapshot without calling the switch provider, so
+// controllers polling counters do not queue up on the switch SDK behind
+// Writes. Values are kept column by column (indices, byte counts, packet
+// counts, ...), so wildcard reads scan contiguous arrays.
+class CounterCache {
+ public:
+  // Reads entities from the switch, passing them one at a time to
+  // write_entity.
+  using Reader = std::function<absl::Status(
+      const p4::v1::ReadRequest& request,
+      const std::function<bool(p4::v1::Entity)>& write_entity)>;
+
+  // Starts the poller; the first poll runs right away.
+  CounterCache(const CounterCacheOptions& options, Reader reader);
+
+  // Stops the poller.
+  ~CounterCache();
+
+  CounterCache(const CounterCache&) = delete;
+  CounterCache& operator=(const CounterCache&) = delete;
+
+  // Returns true for the entity types the cache holds.
+  static bool CanServe(const p4::v1::Entity& entity);
+
+  // Appends the cached entities matching the read filter to the response.
+  // A counter or meter ID of 0 reads every ID, an unset index every index,
+  // a table ID of 0 every table and a table entry without match fields every
+  // entry of the table. Direct entries are only appended for tables that
+  // table_visible, if set, returns true for. Returns false, and appends
+  // nothing, if the cache has no snapshot within max_staleness.
+  bool Read(const p4::v1::Entity& filter,
+            const std::function<bool(uint32_t)>& table_visible,
+            p4::v1::ReadResponse* response) const;
+
+  // Reads every counter and meter from the switch and publishes a new
+  // snapshot. Called by the poller.
+  absl::Status Poll() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Drops the snapshot, e.g. once the pipeline it was read from is replaced.
+  // Reads go to the switch until the next poll; a poll that was already
+  // running when Clear was called publishes nothing.
+  void Clear() ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  struct CounterColumns {
+    std::vector<int64_t> byte_counts;
+    std::vector<int64_t> packet_counts;
+
+    void Append(const p4::v1::CounterData& data);
+    void Fill(size_t i, p4::v1::CounterData* data) const;
+  };
+
+  struct MeterColumns {
+    std::vector<int64_t> cirs;
+    std::vector<int64_t> cbursts;
+    std::vector<int64_t> pirs;
+    std::vector<int64_t> pbursts;
+
+    void Append(const p4::v1::MeterConfig& config);
+    void Fill(size_t i, p4::v1::MeterConfig* config) const;
+  };
+
+  // Entries of one counter or meter array, sorted by index.
+  template <typename Columns>
+  struct Indexed {
+    std::vector<int64_t> indices;
+    Columns columns;
+  };
+
+  // Entries of the direct counters or meters of one table.
+  template <typename Columns>
+  struct Direct {
+    // Table entry keys only: table ID, match, priority and default flag.
+    std::vector<p4::v1::TableEntry> entries;
+    // Position in entries by EntityStore::MatchKey, and of the default entry.
+    absl::flat_hash_map<std::string, size_t> positions;
+    Columns columns;
+  };
+
+  struct Snapshot {
+    absl::Time read_time;
+    absl::flat_hash_map<uint32_t, Indexed<CounterColumns>> counters;
+    absl::flat_hash_map<uint32_t, Indexed<MeterColumns>> meters;
+    absl::flat_hash_map<uint32_t, Direct<CounterColumns>> direct_counters;
+    absl::flat_hash_map<uint32_t, Direct<MeterColumns>> direct_meters;
+  };
+
+  static std::string DirectKey(const p4::v1::TableEntry& entry);
+
+  void RunPoller() ABSL_LOCKS_EXCLUDED(lock_);
+
+  const CounterCacheOptions options_;
+  const Reader reader_;
+
+  // Poll and Clear publish while holding lock_.
+  RcuPtr<Snapshot> snapshot_;
+
+  absl::Mutex lock_;
+  bool shutdown_ ABSL_GUARDED_BY(lock_) = false;
+  // Incremented by Clear. A poll only publishes if it did not change while
+  // the poll read the switch.
+  uint64_t generation_ ABSL_GUARDED_BY(lock_) = 0;
+
+  std::thread poller_;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _COUNTER_CACHE_H_
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "counter_cache.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+p4::v1::Entity Counter(uint32_t counter_id) {
+  p4::v1::Entity entity;
+  entity.mutable_counter_entry()->set_counter_id(counter_id);
+  return entity;
+}
+
+// Returns one entry of counter 1 per read, each with the packet count of the
+// read number. The poller only polls once, when the cache is created, and the
+// tests poll themselves after that.
+class CounterCacheTest : public testing::Test {
+ protected:
+  CounterCacheTest()
+      : cache_(Options(),
+               [this](const p4::v1::ReadRequest& /*request*/,
+                      const std::function<bool(p4::v1::Entity)>&
+                          write_entity) {
+                 if (during_read_) during_read_();
+                 p4::v1::Entity entity = Counter(1);
+                 entity.mutable_counter_entry()->mutable_index()->set_index(0);
+                 entity.mutable_counter_entry()->mutable_data()
+                     ->set_packet_count(++reads_);
+                 write_entity(std::move(entity));
+                 return absl::OkStatus();
+               }) {}
+
+  void SetUp() override {
+    while (CachedPackets() == -1) absl::SleepFor(absl::Milliseconds(1));
+  }
+
+  static CounterCacheOptions Options() {
+    CounterCacheOptions options;
+    options.poll_interval = absl::Hours(1);
+    options.max_staleness = absl::Hours(1);
+    return options;
+  }
+
+  // Returns the cached packet count of counter 1, -1 if it is not cached.
+  int64_t CachedPackets() {
+    p4::v1::ReadResponse response;
+    if (!cache_.Read(Counter(1), nullptr, &response)) return -1;
+    if (response.entities_size() != 1) return 0;
+    return response.entities(0).counter_entry().data().packet_count();
+  }
+
+  std::atomic<int> reads_{0};
+  std::function<void()> during_read_;
+  CounterCache cache_;
+};
+
+TEST_F(CounterCacheTest, ServesTheLatestPoll) {
+  ASSERT_TRUE(cache_.Poll().ok());
+  EXPECT_EQ(CachedPackets(), reads_);
+}
+
+TEST_F(CounterCacheTest, ClearDropsTheSnapshot) {
+  ASSERT_TRUE(cache_.Poll().ok());
+  cache_.Clear();
+  EXPECT_EQ(CachedPackets(), -1);
+  ASSERT_TRUE(cache_.Poll().ok());
+  EXPECT_EQ(CachedPackets(), reads_);
+}
+
+TEST_F(CounterCacheTest, PollRunningDuringClearPublishesNothing) {
+  cache_.Clear();
+  during_read_ = [this]() { cache_.Clear(); };
+  ASSERT_TRUE(cache_.Poll().ok());
+  EXPECT_EQ(CachedPackets(), -1);
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "digest_manager.h"
+
+#include <algorithm>
+
+#include "glog/logging.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+
+DigestManager::DigestManager(
+    std::shared_ptr<SdnControllerManager> controller_manager)
+    : controller_manager_(std::move(controller_manager)) {
+  timer_ = std::thread([this]() { RunTimer(); });
+}
+
+DigestManager::~DigestManager() {
+  {
+    absl::MutexLock l(&lock_);
+    shutdown_ = true;
+  }
+  timer_.join();
+}
+
+void DigestManager::ApplyUpdate(const p4::v1::Update& update,
+                                const absl::optional<std::string>& role) {
+  if (!update.entity().has_digest_entry()) return;
+  const p4::v1::DigestEntry& entry = update.entity().digest_entry();
+
+  absl::MutexLock l(&lock_);
+  switch (update.type()) {
+    case p4::v1::Update::INSERT:
+    case p4::v1::Update::MODIFY: {
+      Digest& digest = digests_[entry.digest_id()];
+      digest.config = entry.config();
+      digest.role = role;
+      // The new config applies to digests that are already pending.
+      if (!digest.pending.empty()) {
+        digest.pending_deadline = absl::Now();
+        deadlines_changed_ = true;
+      }
+      break;
+    }
+    case p4::v1::Update::DELETE:
+      digests_.erase(entry.digest_id());
+      break;
+    default:
+      break;
+  }
+}
+
+void DigestManager::Erase(absl::Span<const uint32_t> digest_ids) {
+  absl::MutexLock l(&lock_);
+  for (uint32_t digest_id : digest_ids) digests_.erase(digest_id);
+}
+
+void DigestManager::Clear() {
+  absl::MutexLock l(&lock_);
+  digests_.clear();
+}
+
+int DigestManager::AddDigests(uint32_t digest_id,
+                              std::vector<p4::v1::P4Data> data) {
+  absl::MutexLock l(&lock_);
+  auto it = digests_.find(digest_id);
+  if (it == digests_.end()) {
+    LOG_EVERY_N(WARNING, 1000)
+        << "Dropping digests for digest ID " << digest_id
+        << " that no controller enabled.";
+    return 0;
+  }
+  Digest& digest = it->second;
+
+  bool track_keys = digest.config.ack_timeout_ns() > 0;
+  for (auto& digest_data : data) {
+    if (track_keys) {
+      std::string key = digest_data.SerializeAsString();
+      if (digest.unacked_keys.contains(key) ||
+          !digest.pending_keys.insert(std::move(key)).second) {
+        continue;
+      }
+    }
+    digest.pending.push_back(std::move(digest_data));
+  }
+  if (digest.pending.empty()) return data.size();
+
+  int max_list_size = digest.config.max_list_size();
+  if (digest.config.max_timeout_ns() <= 0 ||
+      (max_list_size > 0 && digest.pending.size() >= static_cast<size_t>(max_list_size))) {
+    SendPendingDigests(digest_id, &digest);
+  } else if (digest.pending_deadline == absl::InfiniteFuture()) {
+    digest.pending_deadline =
+        absl::Now() + absl::Nanoseconds(digest.config.max_timeout_ns());
+    deadlines_changed_ = true;
+  }
+  return data.size();
+}
+
+absl::Status DigestManager::HandleAck(const p4::v1::DigestListAck& ack) {
+  absl::MutexLock l(&lock_);
+  auto digest = digests_.find(ack.digest_id());
+  if (digest == digests_.end()) {
+    return gutil::NotFoundErrorBuilder()
+           << "Digest ID " << ack.digest_id() << " is not enabled.";
+  }
+  auto list = digest->second.unacked_lists.find(ack.list_id());
+  if (list == digest->second.unacked_lists.end()) {
+    // Acks that arrive after the ack timeout are expected.
+    if (ack.list_id() > 0 && ack.list_id() < digest->second.next_list_id) {
+      return absl::OkStatus();
+    }
+    return gutil::NotFoundErrorBuilder()
+           << "Digest list " << ack.list_id() << " of digest ID "
+           << ack.digest_id() << " was never sent.";
+  }
+  for (const auto& key : list->second.keys) {
+    digest->second.unacked_keys.erase(key);
+  }
+  digest->second.unacked_lists.erase(list);
+  return absl::OkStatus();
+}
+
+void DigestManager::SendPendingDigests(uint32_t digest_id, Digest* digest) {
+  digest->pending_deadline = absl::InfiniteFuture();
+  if (digest->pending.empty()) return;
+
+  size_t max_list_size = digest->config.max_list_size() > 0
+                             ? digest->config.max_list_size()
+                             : digest->pending.size();
+  int64_t timestamp = absl::ToUnixNanos(absl::Now());
+  absl::Time ack_deadline =
+      absl::Now() + absl::Nanoseconds(digest->config.ack_timeout_ns());
+  bool track_keys = digest->config.ack_timeout_ns() > 0;
+
+  std::vector<p4::v1::StreamMessageResponse> responses;
+  for (size_t start = 0; start < digest->pending.size();
+       start += max_list_size) {
+    size_t end = std::min(digest->pending.size(), start + max_list_size);
+    uint64_t list_id = digest->next_list_id++;
+
+    p4::v1::StreamMessageResponse response;
+    p4::v1::DigestList* list = response.mutable_digest();
+    list->set_digest_id(digest_id);
+    list->set_list_id(list_id);
+    list->set_timestamp(timestamp);
+    UnackedList unacked{{}, ack_deadline};
+    for (size_t i = start; i < end; ++i) {
+      if (track_keys) {
+        unacked.keys.push_back(digest->pending[i].SerializeAsString());
+      }
+      list->add_data()->Swap(&digest->pending[i]);
+    }
+    if (track_keys) {
+      digest->unacked_keys.insert(unacked.keys.begin(), unacked.keys.end());
+      digest->unacked_lists.emplace(list_id, std::move(unacked));
+      deadlines_changed_ = true;
+    }
+    responses.push_back(std::move(response));
+  }
+  digest->pending.clear();
+  digest->pending_keys.clear();
+
+  int num_lists = responses.size();
+  int sent = controller_manager_->SendStreamMessagesToPrimary(
+      digest->role, std::move(responses));
+  if (sent < num_lists) {
+    LOG_EVERY_N(WARNING, 100)
+        << "Dropped " << num_lists - sent << " digest lists of digest ID "
+        << digest_id << ", the primary controller cannot receive them.";
+    // Lists the controller never gets must not suppress their data.
+    for (uint64_t list_id = digest->next_list_id - (num_lists - sent);
+         list_id < digest->next_list_id; ++list_id) {
+      auto list = digest->unacked_lists.find(list_id);
+      if (list == digest->unacked_lists.end()) continue;
+      for (const auto& key : list->second.keys) {
+        digest->unacked_keys.erase(key);
+      }
+      digest->unacked_lists.erase(list);
+    }
+  }
+}
+
+absl::Time DigestManager::ProcessDeadlines(absl::Time now) {
+  absl::Time next_deadline = absl::InfiniteFuture();
+  for (auto& entry : digests_) {
+    Digest& digest = entry.second;
+    if (digest.pending_deadline <= now) {
+      SendPendingDigests(entry.first, &digest);
+    }
+    next_deadline = std::min(next_deadline, digest.pending_deadline);
+
+    for (auto list = digest.unacked_lists.begin();
+         list != digest.unacked_lists.end();) {
+      if (list->second.deadline > now) {
+        next_deadline = std::min(next_deadline, list->second.deadline);
+        ++list;
+        continue;
+      }
+      for (const auto& key : list->second.keys) {
+        digest.unacked_keys.erase(key);
+      }
+      digest.unacked_lists.erase(list++);
+    }
+  }
+  return next_deadline;
+}
+
+void DigestManager::RunTimer() {
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    auto wake_up = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return shutdown_ || deadlines_changed_;
+    };
+    absl::MutexLock l(&lock_);
+    while (!shutdown_) {
+      deadlines_changed_ = false;
+      absl::Time next_deadline = ProcessDeadlines(absl::Now());
+      lock_.AwaitWithDeadline(absl::Condition(&wake_up), next_deadline);
+    }
+#ifdef __EXCEPTIONS
+  } catch (const std::exception& e) {
+    LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
+  } catch (...) {
+    LOG(FATAL) << "Unknown exception caught in " << __func__;
+  }
+#endif
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _DIGEST_MANAGER_H_
+#define _DIGEST_MANAGER_H_
+
+#include "sdn_controller_manager.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "p4/v1/p4data.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// Aggregates the digests reported by the switch provider into DigestLists for
+// the primary controller.
+//
+// A digest is enabled once a controller writes its DigestEntry, and its
+// config controls the batching:
+//  * max_list_size: a DigestList is sent once it holds that many digests
+//    (0 means no limit).
+//  * max_timeout_ns: a digest waits at most that long for its list to fill
+//    (0 sends every batch from the provider right away).
+//  * ack_timeout_ns: data that is part of a DigestList is not sent again
+//    until the controller acknowledges the list or the timeout expires.
+//    Repeated learn events for the same data are suppressed in the meantime.
+//    0 disables the suppression.
+// Lists are sent to the primary connection of the role that wrote the
+// DigestEntry, with a list ID per digest that starts from 1.
+class DigestManager {
+ public:
+  explicit DigestManager(
+      std::shared_ptr<SdnControllerManager> controller_manager);
+
+  // Stops the timer thread. Pending digests are dropped.
+  ~DigestManager();
+
+  DigestManager(const DigestManager&) = delete;
+  DigestManager& operator=(const DigestManager&) = delete;
+
+  // Applies a DigestEntry update that was accepted by the switch provider.
+  // Other updates are ignored.
+  void ApplyUpdate(const p4::v1::Update& update,
+                   const absl::optional<std::string>& role)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Disables the digests, e.g. digests a reconciled pipeline removed or
+  // changed. Their pending digests are dropped.
+  void Erase(absl::Span<const uint32_t> digest_ids) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Disables every digest, e.g. when a new pipeline is committed.
+  void Clear() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Queues digest data for the digest. Returns the number of digests that
+  // were queued or suppressed as duplicates of unacknowledged data; 0 if the
+  // digest is not enabled.
+  int AddDigests(uint32_t digest_id, std::vector<p4::v1::P4Data> data)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Handles a DigestListAck from the primary controller.
+  absl::Status HandleAck(const p4::v1::DigestListAck& ack)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  struct UnackedList {
+    std::vector<std::string> keys;
+    absl::Time deadline;
+  };
+
+  struct Digest {
+    p4::v1::DigestEntry::Config config;
+    absl::optional<std::string> role;
+
+    std::vector<p4::v1::P4Data> pending;
+    // Serialized data of the pending digests and of every unacknowledged
+    // list, used to suppress duplicates.
+    absl::flat_hash_set<std::string> pending_keys;
+    absl::flat_hash_set<std::string> unacked_keys;
+    absl::Time pending_deadline = absl::InfiniteFuture();
+
+    uint64_t next_list_id = 1;
+    absl::flat_hash_map<uint64_t, UnackedList> unacked_lists;
+  };
+
+  // Sends the pending digests in lists of at most max_list_size.
+  void SendPendingDigests(uint32_t digest_id, Digest* digest)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Flushes lists that timed out and forgets unacknowledged lists whose ack
+  // timeout expired. Returns the next deadline.
+  absl::Time ProcessDeadlines(absl::Time now)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  void RunTimer() ABSL_LOCKS_EXCLUDED(lock_);
+
+  const std::shared_ptr<SdnControllerManager> controller_manager_;
+
+  absl::Mutex lock_;
+  absl::flat_hash_map<uint32_t, Digest> digests_ ABSL_GUARDED_BY(lock_);
+  // Set whenever a deadline may have moved earlier, to wake the timer.
+  bool deadlines_changed_ ABSL_GUARDED_BY(lock_) = false;
+  bool shutdown_ ABSL_GUARDED_BY(lock_) = false;
+
+  std::thread timer_;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _DIGEST_MANAGER_H_
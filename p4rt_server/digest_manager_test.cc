@@ -0,0 +1,168 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "digest_manager.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "gtest/gtest.h"
+#include "gutil/status_matchers.h"
+
+namespace p4rt_server {
+namespace {
+
+// Records the digest lists sent to the controller.
+class FakeConnection : public SdnConnection {
+ public:
+  FakeConnection() : SdnConnection(nullptr) {}
+
+  bool SendStreamMessageResponse(
+      const p4::v1::StreamMessageResponse& response) override {
+    absl::MutexLock l(&lock_);
+    if (response.has_digest()) digests_.push_back(response.digest());
+    return true;
+  }
+
+  int SendStreamMessageResponses(
+      std::vector<p4::v1::StreamMessageResponse> responses) override {
+    for (const auto& response : responses) SendStreamMessageResponse(response);
+    return responses.size();
+  }
+
+  std::vector<p4::v1::DigestList> digests() {
+    absl::MutexLock l(&lock_);
+    return digests_;
+  }
+
+  // Waits up to a second for the number of digest lists to reach count.
+  bool AwaitDigests(int count) {
+    absl::MutexLock l(&lock_);
+    auto cond = [this, count]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return static_cast<int>(digests_.size()) >= count;
+    };
+    return lock_.AwaitWithTimeout(absl::Condition(&cond), absl::Seconds(1));
+  }
+
+ private:
+  absl::Mutex lock_;
+  std::vector<p4::v1::DigestList> digests_ ABSL_GUARDED_BY(lock_);
+};
+
+p4::v1::Update DigestEntry(uint32_t digest_id, int max_list_size,
+                           absl::Duration max_timeout,
+                           absl::Duration ack_timeout) {
+  p4::v1::Update update;
+  update.set_type(p4::v1::Update::INSERT);
+  p4::v1::DigestEntry* entry = update.mutable_entity()->mutable_digest_entry();
+  entry->set_digest_id(digest_id);
+  entry->mutable_config()->set_max_list_size(max_list_size);
+  entry->mutable_config()->set_max_timeout_ns(
+      absl::ToInt64Nanoseconds(max_timeout));
+  entry->mutable_config()->set_ack_timeout_ns(
+      absl::ToInt64Nanoseconds(ack_timeout));
+  return update;
+}
+
+std::vector<p4::v1::P4Data> Data(const std::vector<std::string>& values) {
+  std::vector<p4::v1::P4Data> data(values.size());
+  for (size_t i = 0; i < values.size(); ++i) data[i].set_bitstring(values[i]);
+  return data;
+}
+
+class DigestManagerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    p4::v1::MasterArbitrationUpdate arbitration;
+    arbitration.set_device_id(1);
+    arbitration.mutable_election_id()->set_low(1);
+    ASSERT_OK(controller_manager_->HandleArbitrationUpdate(arbitration,
+                                                           &primary_));
+  }
+
+  std::shared_ptr<SdnControllerManager> controller_manager_ =
+      std::make_shared<SdnControllerManager>();
+  FakeConnection primary_;
+  DigestManager digest_manager_{controller_manager_};
+};
+
+TEST_F(DigestManagerTest, DropsDigestsWithoutAnEntry) {
+  EXPECT_EQ(digest_manager_.AddDigests(1, Data({"a"})), 0);
+  EXPECT_TRUE(primary_.digests().empty());
+}
+
+TEST_F(DigestManagerTest, SplitsListsAtTheMaxListSize) {
+  digest_manager_.ApplyUpdate(
+      DigestEntry(1, 2, absl::ZeroDuration(), absl::ZeroDuration()),
+      absl::nullopt);
+  EXPECT_EQ(digest_manager_.AddDigests(1, Data({"a", "b", "c"})), 3);
+  std::vector<p4::v1::DigestList> digests = primary_.digests();
+  ASSERT_EQ(digests.size(), 2);
+  EXPECT_EQ(digests[0].data_size(), 2);
+  EXPECT_EQ(digests[1].list_id(), 2);
+  EXPECT_EQ(digests[1].data_size(), 1);
+}
+
+TEST_F(DigestManagerTest, SendsAFullListRightAway) {
+  digest_manager_.ApplyUpdate(
+      DigestEntry(3, 2, absl::Seconds(10), absl::ZeroDuration()),
+      absl::nullopt);
+  digest_manager_.AddDigests(3, Data({"p", "q"}));
+  EXPECT_EQ(primary_.digests().size(), 1);
+}
+
+TEST_F(DigestManagerTest, SuppressesUnackedDataUntilTheAck) {
+  digest_manager_.ApplyUpdate(
+      DigestEntry(2, 10, absl::Milliseconds(50), absl::Seconds(10)),
+      absl::nullopt);
+  // Duplicates of pending data are suppressed, but still counted.
+  EXPECT_EQ(digest_manager_.AddDigests(2, Data({"x", "y"})), 2);
+  EXPECT_EQ(digest_manager_.AddDigests(2, Data({"x"})), 1);
+  EXPECT_TRUE(primary_.digests().empty());
+  ASSERT_TRUE(primary_.AwaitDigests(1));
+  p4::v1::DigestList first = primary_.digests()[0];
+  EXPECT_EQ(first.digest_id(), 2);
+  EXPECT_EQ(first.list_id(), 1);
+  EXPECT_EQ(first.data_size(), 2);
+
+  // Data of the unacked list is not sent again.
+  digest_manager_.AddDigests(2, Data({"x"}));
+  EXPECT_FALSE(primary_.AwaitDigests(2));
+
+  p4::v1::DigestListAck ack;
+  ack.set_digest_id(2);
+  ack.set_list_id(1);
+  EXPECT_OK(digest_manager_.HandleAck(ack));
+  digest_manager_.AddDigests(2, Data({"x"}));
+  ASSERT_TRUE(primary_.AwaitDigests(2));
+  EXPECT_EQ(primary_.digests()[1].list_id(), 2);
+}
+
+TEST_F(DigestManagerTest, RejectsAcksOfUnknownLists) {
+  digest_manager_.ApplyUpdate(
+      DigestEntry(2, 10, absl::Milliseconds(50), absl::Seconds(10)),
+      absl::nullopt);
+  p4::v1::DigestListAck ack;
+  ack.set_digest_id(2);
+  ack.set_list_id(9);
+  EXPECT_FALSE(digest_manager_.HandleAck(ack).ok());
+  ack.set_digest_id(7);
+  EXPECT_FALSE(digest_manager_.HandleAck(ack).ok());
+}
+
+TEST_F(DigestManagerTest, ClearDropsEveryEntry) {
+  digest_manager_.ApplyUpdate(
+      DigestEntry(3, 2, absl::Seconds(10), absl::ZeroDuration()),
+      absl::nullopt);
+  digest_manager_.Clear();
+  EXPECT_EQ(digest_manager_.AddDigests(3, Data({"p"})), 0);
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "entity_store.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/types/optional.h"
+
+namespace p4rt_server{
+namespace {
+
+   // Entries copied out of the store at a time by Read.
+   constexpr size_t kReadBatchSize = 256;
+
+}  // namespace
+
+bool EntityStore::CanServe(const p4::v1::Entity& entity) {
+  if (!entity.has_table_entry()) return false;
+  const p4::v1::TableEntry& filter = entity.table_entry();
+  return !filter.is_default_action() && !filter.has_counter_data() &&
+         !filter.has_meter_config();
+}
+
+uint32_t EntityStore::StoredTableId(const p4::v1::Update& update) {
+  if (!update.entity().has_table_entry()) return 0;
+  const p4::v1::TableEntry& entry = update.entity().table_entry();
+  if (entry.is_default_action()) return 0;
+  return entry.table_id();
+}
+
+std::string EntityStore::MatchKey(const p4::v1::TableEntry& entry) {
+  std::vector<const p4::v1::FieldMatch*> fields;
+  fields.reserve(entry.match_size());
+  for (const auto& field : entry.match()) fields.push_back(&field);
+  std::sort(fields.begin(), fields.end(),
+            [](const p4::v1::FieldMatch* a, const p4::v1::FieldMatch* b) {
+              return a->field_id() < b->field_id();
+            });
+
+  // The priority is part of the key of ternary, range and optional matches.
+  int32_t priority = entry.priority();
+  std::string key(reinterpret_cast<const char*>(&priority), sizeof(priority));
+  for (const p4::v1::FieldMatch* field : fields) {
+    std::string serialized = field->SerializeAsString();
+    uint32_t size = serialized.size();
+    key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    key.append(serialized);
+  }
+  return key;
+}
+
+void EntityStore::StoreEntry(const p4::v1::TableEntry& entry) {
+  p4::v1::TableEntry& stored = tables_[entry.table_id()][MatchKey(entry)];
+  stored = entry;
+  // Counter and meter state lives on the switch, and is never served from
+  // here.
+  stored.clear_counter_data();
+  stored.clear_meter_config();
+  stored.clear_time_since_last_hit();
+}
+
+void EntityStore::Apply(const p4::v1::Update& update) {
+  if (StoredTableId(update) == 0) return;
+  const p4::v1::TableEntry& entry = update.entity().table_entry();
+
+  absl::MutexLock l(&lock_);
+  switch (update.type()) {
+    case p4::v1::Update::INSERT:
+    case p4::v1::Update::MODIFY:
+      StoreEntry(entry);
+      break;
+    case p4::v1::Update::DELETE: {
+      auto table = tables_.find(entry.table_id());
+      if (table == tables_.end()) break;
+      table->second.erase(MatchKey(entry));
+      if (table->second.empty()) tables_.erase(table);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void EntityStore::ReplaceTables(const absl::flat_hash_set<uint32_t>& table_ids,
+                                const p4::v1::ReadResponse& response) {
+  absl::MutexLock l(&lock_);
+  for (uint32_t table_id : table_ids) tables_.erase(table_id);
+  for (const auto& entity : response.entities()) {
+    if (!entity.has_table_entry()) continue;
+    const p4::v1::TableEntry& entry = entity.table_entry();
+    if (entry.is_default_action() || !table_ids.contains(entry.table_id())) {
+      continue;
+    }
+    StoreEntry(entry);
+  }
+}
+
+void EntityStore::EraseTables(const absl::flat_hash_set<uint32_t>& table_ids) {
+  absl::MutexLock l(&lock_);
+  for (uint32_t table_id : table_ids) tables_.erase(table_id);
+}
+
+void EntityStore::Clear() {
+  absl::MutexLock l(&lock_);
+  tables_.clear();
+}
+
+void EntityStore::Read(
+    const p4::v1::TableEntry& filter,
+    const std::function<bool(uint32_t)>& table_visible,
+    const std::function<bool(p4::v1::TableEntry)>& visit) const {
+  if (filter.table_id() != 0 && table_visible &&
+      !table_visible(filter.table_id())) {
+    return;
+  }
+
+  if (filter.table_id() != 0 &&
+      (filter.match_size() > 0 || filter.priority() != 0)) {
+    p4::v1::TableEntry found;
+    {
+      absl::ReaderMutexLock l(&lock_);
+      auto table = tables_.find(filter.table_id());
+      if (table == tables_.end()) return;
+      auto entry = table->second.find(MatchKey(filter));
+      if (entry == table->second.end()) return;
+      found = entry->second;
+    }
+    visit(std::move(found));
+    return;
+  }
+
+  std::vector<uint32_t> table_ids;
+  if (filter.table_id() != 0) {
+    table_ids.push_back(filter.table_id());
+  } else {
+    absl::ReaderMutexLock l(&lock_);
+    for (const auto& table : tables_) table_ids.push_back(table.first);
+  }
+
+  std::vector<p4::v1::TableEntry> batch;
+  for (uint32_t table_id : table_ids) {
+    if (filter.table_id() == 0 && table_visible && !table_visible(table_id)) {
+      continue;
+    }
+    // Match key of the last entry copied, to resume the table after it.
+    absl::optional<std::string> last_key;
+    bool more = true;
+    while (more) {
+      batch.clear();
+      {
+        absl::ReaderMutexLock l(&lock_);
+        auto table = tables_.find(table_id);
+        if (table == tables_.end()) break;
+        auto entry = last_key.has_value()
+                         ? table->second.upper_bound(*last_key)
+                         : table->second.begin();
+        for (; entry != table->second.end() && batch.size() < kReadBatchSize;
+             ++entry) {
+          batch.push_back(entry->second);
+          last_key = entry->first;
+        }
+        more = entry != table->second.end();
+      }
+      for (auto& entry : batch) {
+        if (!visit(std::move(entry))) return;
+      }
+    }
+  }
+}
+
+}//namespace p4rt_server
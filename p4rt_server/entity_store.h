@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _ENTITY_STORE_H_
+#define _ENTITY_STORE_H_
+
+#include <functional>
+#include <string>
+
+#include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// In memory copy of the table entries installed on the switch, indexed by
+// table ID and match key.
+//
+// The P4RtServer records every update it successfully wrote, so table entry
+// reads (including wildcard reads of a table or of every table) can be served
+// without asking the switch provider. Default entries and direct counter and
+// meter data are never stored; they are always read from the switch.
+class EntityStore {
+ public:
+  EntityStore() = default;
+
+  EntityStore(const EntityStore&) = delete;
+  EntityStore& operator=(const EntityStore&) = delete;
+
+  // Returns true if a read of the entity can be answered by the store.
+  static bool CanServe(const p4::v1::Entity& entity);
+
+  // Returns the ID of the table an update writes to, or 0 if the update does
+  // not write a table entry the store keeps.
+  static uint32_t StoredTableId(const p4::v1::Update& update);
+
+  // Builds a key that identifies the entry within its table, independent of
+  // the order of its match fields.
+  static std::string MatchKey(const p4::v1::TableEntry& entry);
+
+  // Records an update that was applied to the switch.
+  void Apply(const p4::v1::Update& update) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Replaces the stored entries of the tables with the table entries in the
+  // response. Used to resynchronize tables after a failed write.
+  void ReplaceTables(const absl::flat_hash_set<uint32_t>& table_ids,
+                     const p4::v1::ReadResponse& response)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Drops the stored entries of the tables, e.g. of tables a reconciled
+  // pipeline removed or changed.
+  void EraseTables(const absl::flat_hash_set<uint32_t>& table_ids)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Drops every stored entry.
+  void Clear() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Passes the stored table entries matching the read filter to visit, until
+  // visit returns false. A table_id of 0 reads every table, and a filter
+  // without match fields or priority reads every entry of the table. Only
+  // tables that table_visible, if set, returns true for are read.
+  //
+  // Entries are copied out in bounded batches and visit is called without
+  // the lock held, so a slow reader never holds up writes. Entries written
+  // while the read is in progress may or may not be visited.
+  void Read(const p4::v1::TableEntry& filter,
+            const std::function<bool(uint32_t)>& table_visible,
+            const std::function<bool(p4::v1::TableEntry)>& visit) const
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  // Entries of a table by match key, ordered so a read can resume after the
+  // last entry it copied.
+  using Table = absl::btree_map<std::string, p4::v1::TableEntry>;
+
+  void StoreEntry(const p4::v1::TableEntry& entry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  mutable absl::Mutex lock_;
+  absl::flat_hash_map<uint32_t, Table> tables_ ABSL_GUARDED_BY(lock_);
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _ENTITY_STORE_H_
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "entity_store.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+p4::v1::Update TableUpdate(p4::v1::Update::Type type, uint32_t table_id,
+                           const std::string& key, uint32_t action_id) {
+  p4::v1::Update update;
+  update.set_type(type);
+  p4::v1::TableEntry* entry = update.mutable_entity()->mutable_table_entry();
+  entry->set_table_id(table_id);
+  p4::v1::FieldMatch* first = entry->add_match();
+  first->set_field_id(1);
+  first->mutable_exact()->set_value(key);
+  p4::v1::FieldMatch* second = entry->add_match();
+  second->set_field_id(2);
+  second->mutable_exact()->set_value("x");
+  entry->mutable_action()->mutable_action()->set_action_id(action_id);
+  return update;
+}
+
+std::vector<p4::v1::TableEntry> ReadAll(
+    const EntityStore& store, const p4::v1::TableEntry& filter,
+    const std::function<bool(uint32_t)>& table_visible = nullptr) {
+  std::vector<p4::v1::TableEntry> entries;
+  store.Read(filter, table_visible, [&entries](p4::v1::TableEntry entry) {
+    entries.push_back(std::move(entry));
+    return true;
+  });
+  return entries;
+}
+
+p4::v1::TableEntry TableFilter(uint32_t table_id) {
+  p4::v1::TableEntry filter;
+  filter.set_table_id(table_id);
+  return filter;
+}
+
+class EntityStoreTest : public testing::Test {
+ protected:
+  // 50 entries in table 1 and 49 in table 2.
+  void SetUp() override {
+    for (int i = 0; i < 100; ++i) {
+      store_.Apply(TableUpdate(p4::v1::Update::INSERT, 1 + i % 2,
+                               std::to_string(i), 1));
+    }
+    store_.Apply(TableUpdate(p4::v1::Update::MODIFY, 1, "0", 9));
+    store_.Apply(TableUpdate(p4::v1::Update::DELETE, 2, "1", 0));
+  }
+
+  EntityStore store_;
+};
+
+TEST_F(EntityStoreTest, ReadsEveryTableOrOneTable) {
+  EXPECT_EQ(ReadAll(store_, TableFilter(0)).size(), 99);
+  EXPECT_EQ(ReadAll(store_, TableFilter(1)).size(), 50);
+  EXPECT_EQ(ReadAll(store_, TableFilter(2)).size(), 49);
+}
+
+TEST_F(EntityStoreTest, LooksUpEntriesIndependentOfMatchFieldOrder) {
+  p4::v1::TableEntry filter =
+      TableUpdate(p4::v1::Update::INSERT, 1, "0", 0).entity().table_entry();
+  std::swap(*filter.mutable_match(0), *filter.mutable_match(1));
+  std::vector<p4::v1::TableEntry> entries = ReadAll(store_, filter);
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0].action().action().action_id(), 9);
+}
+
+TEST_F(EntityStoreTest, StopsWhenTheVisitorReturnsFalse) {
+  int visited = 0;
+  store_.Read(TableFilter(0), nullptr, [&visited](p4::v1::TableEntry) {
+    return ++visited < 10;
+  });
+  EXPECT_EQ(visited, 10);
+}
+
+TEST_F(EntityStoreTest, ReadsOnlyTheTablesOfTheRole) {
+  auto only_table_2 = [](uint32_t table_id) { return table_id == 2; };
+  EXPECT_EQ(ReadAll(store_, TableFilter(0), only_table_2).size(), 49);
+  EXPECT_EQ(ReadAll(store_, TableFilter(2), only_table_2).size(), 49);
+  EXPECT_TRUE(ReadAll(store_, TableFilter(1), only_table_2).empty());
+}
+
+TEST_F(EntityStoreTest, ReplaceTablesDropsTheOldEntries) {
+  p4::v1::ReadResponse response;
+  *response.add_entities() =
+      TableUpdate(p4::v1::Update::INSERT, 1, "z", 3).entity();
+  store_.ReplaceTables({1}, response);
+  EXPECT_EQ(ReadAll(store_, TableFilter(1)).size(), 1);
+  EXPECT_EQ(ReadAll(store_, TableFilter(0)).size(), 50);
+}
+
+TEST(EntityStoreCanServeTest, DirectCountersAreReadFromTheSwitch) {
+  p4::v1::Entity entity;
+  entity.mutable_table_entry()->mutable_counter_data();
+  EXPECT_FALSE(EntityStore::CanServe(entity));
+  entity.mutable_table_entry()->clear_counter_data();
+  EXPECT_TRUE(EntityStore::CanServe(entity));
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "metrics.h"
+
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "glog/logging.h"
+
+namespace p4rt_server{
+namespace{
+   // Threads are assigned shards round robin the first time they record.
+   int ThisThreadShard() {
+     static std::atomic<int> next_shard{0};
+     thread_local int shard =
+         next_shard.fetch_add(1, std::memory_order_relaxed);
+     return shard;
+   }
+
+   std::string EscapeLabelValue(absl::string_view value) {
+     return absl::StrReplaceAll(value,
+                                {{"\\", "\\\\"}, {"\"", "\\\""}, {"\n", "\\n"}});
+   }
+
+   // Renders {name="value",...}, with an optional extra label appended.
+   // Empty if there are no labels.
+   std::string FormatLabels(const MetricLabels& labels,
+                            absl::string_view extra_name = "",
+                            absl::string_view extra_value = "") {
+     if (labels.empty() && extra_name.empty()) return "";
+     std::string formatted = "{";
+     for (const auto& label : labels) {
+       if (formatted.size() > 1) formatted += ",";
+       absl::StrAppend(&formatted, label.first, "=\"",
+                       EscapeLabelValue(label.second), "\"");
+     }
+     if (!extra_name.empty()) {
+       if (formatted.size() > 1) formatted += ",";
+       absl::StrAppend(&formatted, extra_name, "=\"", extra_value, "\"");
+     }
+     formatted += "}";
+     return formatted;
+   }
+
+   const char* TypeName(MetricsRegistry::Type type) {
+     switch (type) {
+       case MetricsRegistry::Type::kCounter:
+         return "counter";
+       case MetricsRegistry::Type::kGauge:
+         return "gauge";
+       case MetricsRegistry::Type::kHistogram:
+         return "histogram";
+     }
+     return "untyped";
+   }
+}
+
+void Counter::Increment(int64_t n) {
+  shards_[ThisThreadShard() % kNumShards].value.fetch_add(
+      n, std::memory_order_relaxed);
+}
+
+int64_t Counter::Value() const {
+  int64_t value = 0;
+  for (const auto& shard : shards_) {
+    value += shard.value.load(std::memory_order_relaxed);
+  }
+  return value;
+}
+
+void Histogram::Record(absl::Duration latency) {
+  int64_t micros = absl::ToInt64Microseconds(latency);
+  // Smallest bucket i with micros <= 2^i.
+  int bucket = micros <= 1 ? 0
+                           : absl::bit_width(static_cast<uint64_t>(micros - 1));
+  if (bucket >= kNumBuckets) bucket = kNumBuckets - 1;
+
+  Shard& shard = shards_[ThisThreadShard() % kNumShards];
+  shard.bucket_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  shard.sum_ns.fetch_add(absl::ToInt64Nanoseconds(latency),
+                         std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::GetSnapshot() const {
+  Snapshot snapshot;
+  snapshot.bucket_counts.resize(kNumBuckets);
+  int64_t sum_ns = 0;
+  for (const auto& shard : shards_) {
+    for (int i = 0; i < kNumBuckets; ++i) {
+      int64_t count = shard.bucket_counts[i].load(std::memory_order_relaxed);
+      snapshot.bucket_counts[i] += count;
+      snapshot.count += count;
+    }
+    sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+  }
+  snapshot.sum = absl::Nanoseconds(sum_ns);
+  return snapshot;
+}
+
+absl::Duration Histogram::BucketUpperBound(int bucket) {
+  if (bucket >= kNumBuckets - 1) return absl::InfiniteDuration();
+  return absl::Microseconds(int64_t{1} << bucket);
+}
+
+Counter* MetricsRegistry::GetCounter(absl::string_view name,
+                                     const MetricLabels& labels) {
+  absl::MutexLock l(&lock_);
+  return FindOrCreate(name, labels, Type::kCounter)->counter.get();
+}
+
+Gauge* MetricsRegistry::GetGauge(absl::string_view name,
+                                 const MetricLabels& labels) {
+  absl::MutexLock l(&lock_);
+  return FindOrCreate(name, labels, Type::kGauge)->gauge.get();
+}
+
+Histogram* MetricsRegistry::GetHistogram(absl::string_view name,
+                                         const MetricLabels& labels) {
+  absl::MutexLock l(&lock_);
+  return FindOrCreate(name, labels, Type::kHistogram)->histogram.get();
+}
+
+MetricsRegistry::Metric* MetricsRegistry::FindOrCreate(
+    absl::string_view name, const MetricLabels& labels, Type type) {
+  // The space sorts before any character of a metric name.
+  std::string key = absl::StrCat(name, " ", FormatLabels(labels));
+  auto it = metrics_.find(key);
+  if (it != metrics_.end()) {
+    CHECK(it->second.type == type)
+        << "Metric " << key << " is already registered as a "
+        << TypeName(it->second.type) << ".";
+    return &it->second;
+  }
+  Metric& metric = metrics_[key];
+  metric.name = std::string(name);
+  metric.labels = labels;
+  metric.type = type;
+  switch (type) {
+    case Type::kCounter:
+      metric.counter = absl::make_unique<Counter>();
+      break;
+    case Type::kGauge:
+      metric.gauge = absl::make_unique<Gauge>();
+      break;
+    case Type::kHistogram:
+      metric.histogram = absl::make_unique<Histogram>();
+      break;
+  }
+  return &metric;
+}
+
+std::vector<MetricsRegistry::Sample> MetricsRegistry::Collect() const {
+  absl::MutexLock l(&lock_);
+  std::vector<Sample> samples;
+  samples.reserve(metrics_.size());
+  for (const auto& entry : metrics_) {
+    const Metric& metric = entry.second;
+    Sample sample;
+    sample.name = metric.name;
+    sample.labels = metric.labels;
+    sample.type = metric.type;
+    switch (metric.type) {
+      case Type::kCounter:
+        sample.value = metric.counter->Value();
+        break;
+      case Type::kGauge:
+        sample.value = metric.gauge->Value();
+        break;
+      case Type::kHistogram:
+        sample.histogram = metric.histogram->GetSnapshot();
+        break;
+    }
+    samples.push_back(std::move(sample));
+  }
+  return samples;
+}
+
+std::string MetricsRegistry::ExportText() const {
+  std::string text;
+  const std::string* last_name = nullptr;
+  std::vector<Sample> samples = Collect();
+  for (const auto& sample : samples) {
+    if (last_name == nullptr || *last_name != sample.name) {
+      absl::StrAppend(&text, "# TYPE ", sample.name, " ",
+                      TypeName(sample.type), "\n");
+      last_name = &sample.name;
+    }
+    if (sample.type != Type::kHistogram) {
+      absl::StrAppend(&text, sample.name, FormatLabels(sample.labels), " ",
+                      sample.value, "\n");
+      continue;
+    }
+    int64_t cumulative = 0;
+    for (int i = 0; i < Histogram::kNumBuckets; ++i) {
+      cumulative += sample.histogram.bucket_counts[i];
+      absl::Duration bound = Histogram::BucketUpperBound(i);
+      std::string le = bound == absl::InfiniteDuration()
+                           ? "+Inf"
+                           : absl::StrCat(absl::ToDoubleSeconds(bound));
+      absl::StrAppend(&text, sample.name, "_bucket",
+                      FormatLabels(sample.labels, "le", le), " ", cumulative,
+                      "\n");
+    }
+    absl::StrAppend(&text, sample.name, "_sum", FormatLabels(sample.labels),
+                    " ", absl::ToDoubleSeconds(sample.histogram.sum), "\n");
+    absl::StrAppend(&text, sample.name, "_count",
+                    FormatLabels(sample.labels), " ", sample.histogram.count,
+                    "\n");
+  }
+  return text;
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace p4rt_server{
+
+// Label name/value pairs of a metric, e.g. {{"rpc", "Write"}}.
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// Monotonic counter. Increments go to one of several cache line sized shards
+// picked by the calling thread, so threads counting the same event do not
+// contend. Reading the value sums the shards.
+class Counter {
+ public:
+  Counter() = default;
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+  void Increment(int64_t n = 1);
+  int64_t Value() const;
+
+ private:
+  static constexpr int kNumShards = 16;
+  struct alignas(64) Shard {
+    std::atomic<int64_t> value{0};
+  };
+  Shard shards_[kNumShards];
+};
+
+// Value that goes up and down, e.g. a queue depth.
+class Gauge {
+ public:
+  Gauge() = default;
+  Gauge(const Gauge&) = delete;
+  Gauge& operator=(const Gauge&) = delete;
+
+  void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  void Add(int64_t delta) {
+    value_.fetch_add(delta, std::memory_order_relaxed);
+  }
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_{0};
+};
+
+// Latency histogram with exponential buckets. Bucket i counts the samples of
+// at most 2^i microseconds, the last bucket everything above. Sharded the same
+// way as Counter.
+class Histogram {
+ public:
+  static constexpr int kNumBuckets = 27;
+
+  struct Snapshot {
+    // Samples per bucket, not cumulative.
+    std::vector<int64_t> bucket_counts;
+    int64_t count = 0;
+    absl::Duration sum;
+  };
+
+  Histogram() = default;
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void Record(absl::Duration latency);
+  Snapshot GetSnapshot() const;
+
+  // Upper bound of a bucket; absl::InfiniteDuration for the last one.
+  static absl::Duration BucketUpperBound(int bucket);
+
+ private:
+  static constexpr int kNumShards = 8;
+  struct alignas(64) Shard {
+    std::atomic<int64_t> bucket_counts[kNumBuckets] = {};
+    std::atomic<int64_t> sum_ns{0};
+  };
+  Shard shards_[kNumShards];
+};
+
+// Owns every metric of a server and exports them on request.
+//
+// Looking a metric up takes a lock, so callers look their metrics up once and
+// keep the pointer, which stays valid for the lifetime of the registry.
+// Recording into a metric never takes a lock.
+class MetricsRegistry {
+ public:
+  enum class Type { kCounter, kGauge, kHistogram };
+
+  struct Sample {
+    std::string name;
+    MetricLabels labels;
+    Type type;
+    // Counters and gauges.
+    int64_t value = 0;
+    // Histograms.
+    Histogram::Snapshot histogram;
+  };
+
+  MetricsRegistry() = default;
+  MetricsRegistry(const MetricsRegistry&) = delete;
+  MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+  // Return the metric with the name and labels, created on first use. A name
+  // must always be used with the same metric type.
+  Counter* GetCounter(absl::string_view name, const MetricLabels& labels = {})
+      ABSL_LOCKS_EXCLUDED(lock_);
+  Gauge* GetGauge(absl::string_view name, const MetricLabels& labels = {})
+      ABSL_LOCKS_EXCLUDED(lock_);
+  Histogram* GetHistogram(absl::string_view name,
+                          const MetricLabels& labels = {})
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Current value of every metric, ordered by name and labels.
+  std::vector<Sample> Collect() const ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Every metric in the Prometheus text exposition format, ready to be served
+  // to a scraper. Histograms are exported in seconds.
+  std::string ExportText() const ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  struct Metric {
+    std::string name;
+    MetricLabels labels;
+    Type type;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  Metric* FindOrCreate(absl::string_view name, const MetricLabels& labels,
+                       Type type) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  mutable absl::Mutex lock_;
+  // Keyed by name and labels, e.g. 'p4rt_rpcs {rpc="Write"}', so the series
+  // of a metric are next to each other.
+  std::map<std::string, Metric> metrics_ ABSL_GUARDED_BY(lock_);
+};
+
+// Records the time from construction to destruction into a histogram.
+class LatencyTimer {
+ public:
+  explicit LatencyTimer(Histogram* histogram)
+      : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+  ~LatencyTimer() {
+    histogram_->Record(
+        absl::FromChrono(std::chrono::steady_clock::now() - start_));
+  }
+
+  LatencyTimer(const LatencyTimer&) = delete;
+  LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+ private:
+  Histogram* histogram_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+// absl::MutexLock that records how long the mutex was held.
+class ABSL_SCOPED_LOCKABLE TimedMutexLock {
+ public:
+  TimedMutexLock(absl::Mutex* mu, Histogram* hold_time)
+      ABSL_EXCLUSIVE_LOCK_FUNCTION(mu)
+      : mu_(mu), hold_time_(hold_time) {
+    mu_->Lock();
+    acquired_ = std::chrono::steady_clock::now();
+  }
+  ~TimedMutexLock() ABSL_UNLOCK_FUNCTION() {
+    auto held = std::chrono::steady_clock::now() - acquired_;
+    mu_->Unlock();
+    hold_time_->Record(absl::FromChrono(held));
+  }
+
+  TimedMutexLock(const TimedMutexLock&) = delete;
+  TimedMutexLock& operator=(const TimedMutexLock&) = delete;
+
+ private:
+  absl::Mutex* const mu_;
+  Histogram* const hold_time_;
+  std::chrono::steady_clock::time_point acquired_;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _METRICS_H_
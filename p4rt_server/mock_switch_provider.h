@@ -0,0 +1,122 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _MOCK_SWITCH_PROVIDER_H_
+#define _MOCK_SWITCH_PROVIDER_H_
+
+#include "switch_provider_base.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// SwitchProviderBase for benchmarks and tests. Accepts every request after a
+// configurable delay that stands in for the time a real switch takes, and
+// counts the calls it received.
+class MockSwitchProvider : public switch_provider::SwitchProviderBase {
+ public:
+  struct Options {
+    absl::Duration write_delay = absl::ZeroDuration();
+    absl::Duration read_delay = absl::ZeroDuration();
+    absl::Duration packet_out_delay = absl::ZeroDuration();
+    // Returned by every DoRead.
+    p4::v1::ReadResponse read_response;
+    // Sends every PacketOut back to the primary of the default role as a
+    // PacketIn with the same payload.
+    bool echo_packet_outs = false;
+    // See SwitchProviderBase::WriteUpdateParallelism.
+    int write_update_parallelism = 0;
+  };
+
+  MockSwitchProvider() : MockSwitchProvider(Options()) {}
+  explicit MockSwitchProvider(Options options) : options_(std::move(options)) {}
+
+  absl::Status DoWrite(const p4::v1::WriteRequest* request) override {
+    Delay(options_.write_delay);
+    updates_.fetch_add(request->updates_size(), std::memory_order_relaxed);
+    return absl::OkStatus();
+  }
+
+  int WriteUpdateParallelism() const override {
+    return options_.write_update_parallelism;
+  }
+
+  absl::Status DoWriteUpdate(const p4::v1::Update& update) override {
+    Delay(options_.write_delay);
+    updates_.fetch_add(1, std::memory_order_relaxed);
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<p4::v1::ReadResponse> DoRead(
+      const p4::v1::ReadRequest* request) override {
+    Delay(options_.read_delay);
+    reads_.fetch_add(1, std::memory_order_relaxed);
+    return options_.read_response;
+  }
+
+  absl::Status SendPacketOut(const p4::v1::PacketOut& packet) override {
+    return SendPacketOuts(absl::MakeConstSpan(&packet, 1)).front();
+  }
+
+  std::vector<absl::Status> SendPacketOuts(
+      absl::Span<const p4::v1::PacketOut> packets) override {
+    Delay(options_.packet_out_delay);
+    packet_outs_.fetch_add(packets.size(), std::memory_order_relaxed);
+    if (options_.echo_packet_outs) {
+      std::vector<p4::v1::PacketIn> packet_ins(packets.size());
+      for (size_t i = 0; i < packets.size(); ++i) {
+        packet_ins[i].set_payload(packets[i].payload());
+      }
+      SendPacketIns(absl::nullopt, std::move(packet_ins));
+    }
+    return std::vector<absl::Status>(packets.size());
+  }
+
+  absl::Status SetForwardingPipelineConfig(
+      const p4::v1::ForwardingPipelineConfig config) override {
+    absl::MutexLock l(&lock_);
+    config_ = config;
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<p4::v1::ForwardingPipelineConfig>
+  GetForwardingPipelineConfig() override {
+    absl::MutexLock l(&lock_);
+    return config_;
+  }
+
+  int64_t updates() const { return updates_.load(); }
+  int64_t reads() const { return reads_.load(); }
+  int64_t packet_outs() const { return packet_outs_.load(); }
+
+ private:
+  static void Delay(absl::Duration delay) {
+    if (delay > absl::ZeroDuration()) absl::SleepFor(delay);
+  }
+
+  const Options options_;
+  std::atomic<int64_t> updates_{0};
+  std::atomic<int64_t> reads_{0};
+  std::atomic<int64_t> packet_outs_{0};
+
+  absl::Mutex lock_;
+  p4::v1::ForwardingPipelineConfig config_ ABSL_GUARDED_BY(lock_);
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _MOCK_SWITCH_PROVIDER_H_
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "multi_device_p4rt_server.h"
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+namespace {
+
+   grpc::Status UnknownDevice(uint64_t device_id) {
+     return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                         absl::StrCat("Unknown device ID ", device_id, "."));
+   }
+
+}  // namespace
+
+absl::Status MultiDeviceP4RtServer::AddDevice(
+    uint64_t device_id,
+    std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider) {
+  if (devices_.contains(device_id)) {
+    return gutil::AlreadyExistsErrorBuilder()
+           << "Device ID " << device_id << " was already added.";
+  }
+  devices_[device_id] =
+      absl::make_unique<P4RtServer>(std::move(switch_provider), device_id);
+  return absl::OkStatus();
+}
+
+P4RtServer* MultiDeviceP4RtServer::GetDevice(uint64_t device_id) const {
+  auto device = devices_.find(device_id);
+  return device == devices_.end() ? nullptr : device->second.get();
+}
+
+/*
+ * MultiDeviceP4RtServer::Write
+ * Routes write requests to the server of their device
+ */
+grpc::Status MultiDeviceP4RtServer::Write(grpc::ServerContext* context,
+                                          const p4::v1::WriteRequest* request,
+                                          p4::v1::WriteResponse* response) {
+  P4RtServer* device = GetDevice(request->device_id());
+  if (device == nullptr) return UnknownDevice(request->device_id());
+  return device->Write(context, request, response);
+}
+
+/*
+ * MultiDeviceP4RtServer::Read
+ * Routes read requests to the server of their device
+ */
+grpc::Status MultiDeviceP4RtServer::Read(
+    grpc::ServerContext* context, const p4::v1::ReadRequest* request,
+    grpc::ServerWriter<p4::v1::ReadResponse>* response_writer) {
+  P4RtServer* device = GetDevice(request->device_id());
+  if (device == nullptr) return UnknownDevice(request->device_id());
+  return device->Read(context, request, response_writer);
+}
+
+/*
+ * MultiDeviceP4RtServer::StreamChannel
+ * Reads the first message of the stream, which must be a
+ * MasterArbitrationUpdate, and hands the stream to the server of its device
+ */
+grpc::Status MultiDeviceP4RtServer::StreamChannel(
+    grpc::ServerContext* context,
+    grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
+                             p4::v1::StreamMessageRequest>* stream) {
+  p4::v1::StreamMessageRequest request;
+  if (!stream->Read(&request)) return grpc::Status::OK;
+  if (!request.has_arbitration()) {
+    LOG(WARNING) << "StreamChannel did not start with an arbitration update.";
+    return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                        "The first message of a StreamChannel must be a "
+                        "MasterArbitrationUpdate.");
+  }
+  P4RtServer* device = GetDevice(request.arbitration().device_id());
+  if (device == nullptr) return UnknownDevice(request.arbitration().device_id());
+  return device->ServeStreamChannel(context, stream, &request);
+}
+
+/*
+ * MultiDeviceP4RtServer::SetForwardingPipelineConfig
+ * Routes pipeline pushes to the server of their device
+ */
+grpc::Status MultiDeviceP4RtServer::SetForwardingPipelineConfig(
+    grpc::ServerContext* context,
+    const p4::v1::SetForwardingPipelineConfigRequest* request,
+    p4::v1::SetForwardingPipelineConfigResponse* response) {
+  P4RtServer* device = GetDevice(request->device_id());
+  if (device == nullptr) return UnknownDevice(request->device_id());
+  return device->SetForwardingPipelineConfig(context, request, response);
+}
+
+/*
+ * MultiDeviceP4RtServer::GetForwardingPipelineConfig
+ * Routes pipeline config reads to the server of their device
+ */
+grpc::Status MultiDeviceP4RtServer::GetForwardingPipelineConfig(
+    grpc::ServerContext* context,
+    const p4::v1::GetForwardingPipelineConfigRequest* request,
+    p4::v1::GetForwardingPipelineConfigResponse* response) {
+  P4RtServer* device = GetDevice(request->device_id());
+  if (device == nullptr) return UnknownDevice(request->device_id());
+  return device->GetForwardingPipelineConfig(context, request, response);
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef MULTI_DEVICE_P4RT_SERVER_H_
+#define MULTI_DEVICE_P4RT_SERVER_H_
+
+#include "p4rt_server.h"
+#include "switch_provider_base.h"
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "grpcpp/grpcpp.h"
+#include "p4/v1/p4runtime.grpc.pb.h"
+
+namespace p4rt_server{
+
+/*
+ * MultiDeviceP4RtServer serves several devices, e.g. the ASICs of a chassis,
+ * from one P4Runtime service and port. Every device has its own switch
+ * provider and its own P4RtServer, with separate arbitration state, locks,
+ * pipeline config and stores, so devices are programmed independently and in
+ * parallel. Requests are routed by their device_id; a StreamChannel by the
+ * device_id of its first MasterArbitrationUpdate.
+ *
+ * Usage:
+ *   MultiDeviceP4RtServer p4runtime_server;
+ *   p4runtime_server.AddDevice(1, std::move(asic0_provider));
+ *   p4runtime_server.AddDevice(2, std::move(asic1_provider));
+ *   ServerBuilder builder;
+ *   builder.RegisterService(&p4runtime_server);
+ */
+class MultiDeviceP4RtServer final : public p4::v1::P4Runtime::Service {
+  public:
+    MultiDeviceP4RtServer() = default;
+
+    MultiDeviceP4RtServer(const MultiDeviceP4RtServer&) = delete;
+    MultiDeviceP4RtServer& operator=(const MultiDeviceP4RtServer&) = delete;
+
+    // Adds a device. Every device must be added before the service is
+    // registered with gRPC.
+    absl::Status AddDevice(
+        uint64_t device_id,
+        std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider);
+
+    // Returns the server of the device, or nullptr for unknown devices. Use
+    // it to send PacketIns or read the metrics of a device.
+    P4RtServer* GetDevice(uint64_t device_id) const;
+
+    grpc::Status Write(grpc::ServerContext* context,
+                       const p4::v1::WriteRequest* request,
+                       p4::v1::WriteResponse* response) override;
+
+    grpc::Status Read(grpc::ServerContext* context,
+                      const p4::v1::ReadRequest* request,
+                      grpc::ServerWriter<p4::v1::ReadResponse>* response_writer)
+        override;
+
+    grpc::Status StreamChannel(
+        grpc::ServerContext* context,
+        grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
+                                 p4::v1::StreamMessageRequest>* stream) override;
+
+    grpc::Status SetForwardingPipelineConfig(
+        grpc::ServerContext* context,
+        const p4::v1::SetForwardingPipelineConfigRequest* request,
+        p4::v1::SetForwardingPipelineConfigResponse* response) override;
+
+    grpc::Status GetForwardingPipelineConfig(
+        grpc::ServerContext* context,
+        const p4::v1::GetForwardingPipelineConfigRequest* request,
+        p4::v1::GetForwardingPipelineConfigResponse* response) override;
+
+  private:
+    // Fixed once serving starts, so lookups take no lock.
+    absl::flat_hash_map<uint64_t, std::unique_ptr<P4RtServer>> devices_;
+};
+
+}
+
+#endif //ifndef MULTI_DEVICE_P4RT_SERVER_H_
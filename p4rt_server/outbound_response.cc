@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "outbound_response.h"
+
+#include <utility>
+
+#include "grpcpp/impl/codegen/proto_utils.h"
+
+namespace p4rt_server{
+namespace {
+
+   // Enough for the response, the PacketIn and a few metadata of a typical
+   // packet, so a batch mostly fits the first block of its arena.
+   constexpr size_t kArenaBytesPerPacketIn = 256;
+
+   grpc::Status SerializeResponse(const p4::v1::StreamMessageResponse& response,
+                                  grpc::ByteBuffer* buffer) {
+     bool own_buffer;
+     return grpc::SerializationTraits<p4::v1::StreamMessageResponse>::Serialize(
+         response, buffer, &own_buffer);
+   }
+
+}  // namespace
+
+grpc::Status SharedStreamResponse::Serialize(grpc::ByteBuffer* buffer) const {
+  absl::call_once(serialize_once_, [this]() {
+    serialize_status_ = SerializeResponse(*response_, &serialized_);
+  });
+  if (!serialize_status_.ok()) return serialize_status_;
+  // Copying a ByteBuffer takes a reference to its slices, the bytes are not
+  // copied.
+  *buffer = serialized_;
+  return grpc::Status::OK;
+}
+
+grpc::Status OutboundResponse::Serialize(grpc::ByteBuffer* buffer) const {
+  if (shared_ != nullptr) return shared_->Serialize(buffer);
+  return SerializeResponse(response(), buffer);
+}
+
+std::shared_ptr<const SharedStreamResponse> OutboundResponse::Share() && {
+  if (shared_ != nullptr) return std::move(shared_);
+  if (arena_response_ != nullptr) {
+    return std::make_shared<const SharedStreamResponse>(std::move(arena_),
+                                                        arena_response_);
+  }
+  return std::make_shared<const SharedStreamResponse>(std::move(owned_));
+}
+
+std::vector<OutboundResponse> PacketInResponses(
+    std::vector<p4::v1::PacketIn> packets) {
+  std::vector<OutboundResponse> responses;
+  responses.reserve(packets.size());
+  // A single packet is not worth an arena.
+  if (packets.size() < 2) {
+    for (auto& packet : packets) {
+      p4::v1::StreamMessageResponse response;
+      response.mutable_packet()->Swap(&packet);
+      responses.emplace_back(std::move(response));
+    }
+    return responses;
+  }
+  google::protobuf::ArenaOptions options;
+  options.start_block_size = packets.size() * kArenaBytesPerPacketIn;
+  auto arena = std::make_shared<google::protobuf::Arena>(options);
+  for (auto& packet : packets) {
+    auto* response = google::protobuf::Arena::CreateMessage<
+        p4::v1::StreamMessageResponse>(arena.get());
+    p4::v1::PacketIn* packet_in = response->mutable_packet();
+    // Swapping the messages would copy them between the heap and the arena.
+    packet_in->mutable_payload()->swap(*packet.mutable_payload());
+    *packet_in->mutable_metadata() = packet.metadata();
+    responses.emplace_back(arena, response);
+  }
+  return responses;
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _OUTBOUND_RESPONSE_H_
+#define _OUTBOUND_RESPONSE_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/base/call_once.h"
+#include "google/protobuf/arena.h"
+#include "grpcpp/support/byte_buffer.h"
+#include "grpcpp/support/status.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// A StreamMessageResponse sent to several connections, e.g. an arbitration
+// update for every backup or a PacketIn mirrored to monitoring sessions.
+// Connections share one immutable copy of the message, and connections that
+// write serialized bytes (the AsyncP4RtServer streams) share one
+// serialization: every stream writes the same reference counted slices.
+class SharedStreamResponse {
+ public:
+  explicit SharedStreamResponse(p4::v1::StreamMessageResponse response)
+      : owned_(std::move(response)), response_(&owned_) {}
+  // A response on an arena, which is kept alive with it.
+  SharedStreamResponse(std::shared_ptr<google::protobuf::Arena> arena,
+                       const p4::v1::StreamMessageResponse* response)
+      : arena_(std::move(arena)), response_(response) {}
+
+  SharedStreamResponse(const SharedStreamResponse&) = delete;
+  SharedStreamResponse& operator=(const SharedStreamResponse&) = delete;
+
+  const p4::v1::StreamMessageResponse& response() const { return *response_; }
+
+  // Serializes the response the first time it is called, and returns a
+  // reference to the same bytes on every call. Thread-safe.
+  grpc::Status Serialize(grpc::ByteBuffer* buffer) const;
+
+ private:
+  const p4::v1::StreamMessageResponse owned_;
+  const std::shared_ptr<google::protobuf::Arena> arena_;
+  const p4::v1::StreamMessageResponse* const response_;
+  mutable absl::once_flag serialize_once_;
+  mutable grpc::Status serialize_status_;
+  mutable grpc::ByteBuffer serialized_;
+};
+
+// A response queued on one connection. Either owned by the connection, on an
+// arena shared with the other responses of its batch, or shared with other
+// connections.
+class OutboundResponse {
+ public:
+  OutboundResponse(p4::v1::StreamMessageResponse response)
+      : owned_(std::move(response)) {}
+  // The arena is freed with the last response of the batch, on whichever
+  // thread writes or drops it.
+  OutboundResponse(std::shared_ptr<google::protobuf::Arena> arena,
+                   const p4::v1::StreamMessageResponse* response)
+      : arena_(std::move(arena)), arena_response_(response) {}
+  OutboundResponse(std::shared_ptr<const SharedStreamResponse> shared)
+      : shared_(std::move(shared)) {}
+
+  const p4::v1::StreamMessageResponse& response() const {
+    if (shared_ != nullptr) return shared_->response();
+    return arena_response_ != nullptr ? *arena_response_ : owned_;
+  }
+
+  // Owned and arena responses are serialized on every call, shared responses
+  // only once for all connections.
+  grpc::Status Serialize(grpc::ByteBuffer* buffer) const;
+
+  // Turns the response into one that can be queued on several connections,
+  // without copying it.
+  std::shared_ptr<const SharedStreamResponse> Share() &&;
+
+ private:
+  p4::v1::StreamMessageResponse owned_;
+  std::shared_ptr<google::protobuf::Arena> arena_;
+  const p4::v1::StreamMessageResponse* arena_response_ = nullptr;
+  std::shared_ptr<const SharedStreamResponse> shared_;
+};
+
+// Wraps a batch of PacketIns into StreamMessageResponses. The responses of a
+// batch are built on one arena, freed at once after the last of them is
+// written or dropped, instead of allocating and freeing the nested messages
+// of every packet one by one. Payloads are moved, not copied.
+std::vector<OutboundResponse> PacketInResponses(
+    std::vector<p4::v1::PacketIn> packets);
+
+}//namespace p4rt_server
+
+#endif //ifndef _OUTBOUND_RESPONSE_H_
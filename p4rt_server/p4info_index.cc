@@ -0,0 +1,433 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "p4info_index.h"
+
+#include <algorithm>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+namespace{
+  constexpr absl::string_view kRoleAnnotation = "@p4runtime_role(";
+
+  // Returns the role of a @p4runtime_role("<role>") annotation, if any.
+  absl::optional<std::string> ParseRoleAnnotation(
+      const google::protobuf::RepeatedPtrField<std::string>& annotations) {
+    for (absl::string_view annotation : annotations) {
+      if (!absl::StartsWith(annotation, kRoleAnnotation) ||
+          !absl::EndsWith(annotation, ")")) {
+        continue;
+      }
+      annotation.remove_prefix(kRoleAnnotation.size());
+      annotation.remove_suffix(1);
+      if (annotation.size() >= 2 && annotation.front() == '"' &&
+          annotation.back() == '"') {
+        annotation.remove_prefix(1);
+        annotation.remove_suffix(1);
+      }
+      return std::string(annotation);
+    }
+    return absl::nullopt;
+  }
+
+  // Values are sent in the canonical (shortest) byte string representation,
+  // which never needs more bytes than the bitwidth.
+  absl::Status ValidateBytes(const std::string& value, int32_t bitwidth,
+                             absl::string_view what) {
+    if (bitwidth <= 0) return absl::OkStatus();
+    if (value.empty()) {
+      return gutil::InvalidArgumentErrorBuilder() << what << " is empty.";
+    }
+    if (value.size() > static_cast<size_t>((bitwidth + 7) / 8)) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << what << " has " << value.size() << " bytes, more than its "
+             << bitwidth << " bits.";
+    }
+    return absl::OkStatus();
+  }
+
+  // Returns true if the FieldMatch kind is allowed for the match type.
+  bool MatchKindAgrees(const p4::v1::FieldMatch& match,
+                       p4::config::v1::MatchField::MatchType match_type) {
+    switch (match_type) {
+      case p4::config::v1::MatchField::EXACT:
+        return match.has_exact();
+      case p4::config::v1::MatchField::LPM:
+        return match.has_lpm();
+      case p4::config::v1::MatchField::TERNARY:
+        return match.has_ternary();
+      case p4::config::v1::MatchField::RANGE:
+        return match.has_range();
+      case p4::config::v1::MatchField::OPTIONAL:
+        return match.has_optional();
+      default:
+        // Architecture specific match types are left to the provider.
+        return true;
+    }
+  }
+
+  absl::Status ValidateFieldMatch(
+      const p4::v1::FieldMatch& match,
+      const P4InfoIndex::MatchFieldInfo& field) {
+    if (!MatchKindAgrees(match, field.match_type)) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Match field '" << field.name
+             << "' does not have the match type of the P4Info.";
+    }
+    switch (match.field_match_type_case()) {
+      case p4::v1::FieldMatch::kExact:
+        return ValidateBytes(match.exact().value(), field.bitwidth,
+                             absl::StrCat("Match field '", field.name, "'"));
+      case p4::v1::FieldMatch::kLpm:
+        if (match.lpm().prefix_len() <= 0 ||
+            (field.bitwidth > 0 && match.lpm().prefix_len() > field.bitwidth)) {
+          return gutil::InvalidArgumentErrorBuilder()
+                 << "Match field '" << field.name << "' has prefix length "
+                 << match.lpm().prefix_len() << ".";
+        }
+        return ValidateBytes(match.lpm().value(), field.bitwidth,
+                             absl::StrCat("Match field '", field.name, "'"));
+      case p4::v1::FieldMatch::kTernary:
+        RETURN_IF_ERROR(
+            ValidateBytes(match.ternary().value(), field.bitwidth,
+                          absl::StrCat("Match field '", field.name, "'")));
+        return ValidateBytes(
+            match.ternary().mask(), field.bitwidth,
+            absl::StrCat("Mask of match field '", field.name, "'"));
+      case p4::v1::FieldMatch::kRange:
+        RETURN_IF_ERROR(ValidateBytes(
+            match.range().low(), field.bitwidth,
+            absl::StrCat("Low of match field '", field.name, "'")));
+        return ValidateBytes(
+            match.range().high(), field.bitwidth,
+            absl::StrCat("High of match field '", field.name, "'"));
+      case p4::v1::FieldMatch::kOptional:
+        return ValidateBytes(match.optional().value(), field.bitwidth,
+                             absl::StrCat("Match field '", field.name, "'"));
+      default:
+        return absl::OkStatus();
+    }
+  }
+}
+
+absl::StatusOr<std::shared_ptr<const P4InfoIndex>> P4InfoIndex::Create(
+    const p4::config::v1::P4Info& p4info) {
+  // The constructor is private, so make_shared cannot be used.
+  std::shared_ptr<P4InfoIndex> index(new P4InfoIndex());
+
+  for (const auto& action : p4info.actions()) {
+    ActionInfo info{action.preamble().id(), action.preamble().name(), {}};
+    for (const auto& param : action.params()) {
+      if (!info.param_bitwidths.emplace(param.id(), param.bitwidth()).second) {
+        return gutil::InvalidArgumentErrorBuilder()
+               << "Action '" << info.name << "' has duplicate param ID "
+               << param.id() << ".";
+      }
+    }
+    if (!index->actions_.emplace(info.id, std::move(info)).second) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Duplicate action ID " << action.preamble().id() << ".";
+    }
+  }
+
+  for (const auto& profile : p4info.action_profiles()) {
+    ActionProfileInfo info{profile.preamble().id(), profile.preamble().name(),
+                           {}};
+    info.table_ids.insert(profile.table_ids().begin(),
+                          profile.table_ids().end());
+    if (!index->action_profiles_.emplace(info.id, std::move(info)).second) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Duplicate action profile ID " << profile.preamble().id()
+             << ".";
+    }
+  }
+
+  for (const auto& table : p4info.tables()) {
+    TableInfo info;
+    info.id = table.preamble().id();
+    info.name = table.preamble().name();
+    info.implementation_id = table.implementation_id();
+    info.requires_priority = false;
+    info.is_const_table = table.is_const_table();
+    info.role = ParseRoleAnnotation(table.preamble().annotations());
+    if (info.role.has_value()) index->has_roles_ = true;
+
+    for (const auto& field : table.match_fields()) {
+      MatchFieldInfo field_info{field.id(), field.name(), field.bitwidth(),
+                                field.match_type()};
+      switch (field.match_type()) {
+        case p4::config::v1::MatchField::EXACT:
+          info.exact_match_field_ids.push_back(field.id());
+          break;
+        case p4::config::v1::MatchField::TERNARY:
+        case p4::config::v1::MatchField::RANGE:
+        case p4::config::v1::MatchField::OPTIONAL:
+          info.requires_priority = true;
+          break;
+        default:
+          break;
+      }
+      if (!info.match_fields.emplace(field.id(), std::move(field_info))
+               .second) {
+        return gutil::InvalidArgumentErrorBuilder()
+               << "Table '" << info.name << "' has duplicate match field ID "
+               << field.id() << ".";
+      }
+    }
+
+    for (const auto& action_ref : table.action_refs()) {
+      if (index->FindAction(action_ref.id()) == nullptr) {
+        return gutil::InvalidArgumentErrorBuilder()
+               << "Table '" << info.name << "' refers to unknown action ID "
+               << action_ref.id() << ".";
+      }
+      info.action_ids.insert(action_ref.id());
+    }
+    if (info.implementation_id != 0 &&
+        index->FindActionProfile(info.implementation_id) == nullptr) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Table '" << info.name
+             << "' refers to unknown action profile ID "
+             << info.implementation_id << ".";
+    }
+
+    uint32_t id = info.id;
+    if (!index->tables_.emplace(id, std::move(info)).second) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Duplicate table ID " << id << ".";
+    }
+  }
+  return std::shared_ptr<const P4InfoIndex>(std::move(index));
+}
+
+const P4InfoIndex::TableInfo* P4InfoIndex::FindTable(uint32_t id) const {
+  auto table = tables_.find(id);
+  return table == tables_.end() ? nullptr : &table->second;
+}
+
+const P4InfoIndex::ActionInfo* P4InfoIndex::FindAction(uint32_t id) const {
+  auto action = actions_.find(id);
+  return action == actions_.end() ? nullptr : &action->second;
+}
+
+const P4InfoIndex::ActionProfileInfo* P4InfoIndex::FindActionProfile(
+    uint32_t id) const {
+  auto profile = action_profiles_.find(id);
+  return profile == action_profiles_.end() ? nullptr : &profile->second;
+}
+
+bool P4InfoIndex::RoleCanAccessTable(const absl::optional<std::string>& role,
+                                     const TableInfo& table) const {
+  if (!has_roles_ || !role.has_value()) return true;
+  return table.role == role;
+}
+
+std::vector<uint32_t> P4InfoIndex::TableIds(
+    const absl::optional<std::string>& role) const {
+  std::vector<uint32_t> ids;
+  ids.reserve(tables_.size());
+  for (const auto& table : tables_) {
+    if (RoleCanAccessTable(role, table.second)) ids.push_back(table.first);
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+absl::Status P4InfoIndex::ValidateUpdate(
+    const p4::v1::Update& update,
+    const absl::optional<std::string>& role) const {
+  const p4::v1::Entity& entity = update.entity();
+  switch (entity.entity_case()) {
+    case p4::v1::Entity::kTableEntry:
+      return ValidateTableEntry(entity.table_entry(), update.type(), role);
+    case p4::v1::Entity::kActionProfileMember: {
+      const auto& member = entity.action_profile_member();
+      return ValidateActionProfileEntity(
+          member.action_profile_id(),
+          update.type() == p4::v1::Update::DELETE ? nullptr : &member.action(),
+          role);
+    }
+    case p4::v1::Entity::kActionProfileGroup:
+      return ValidateActionProfileEntity(
+          entity.action_profile_group().action_profile_id(), nullptr, role);
+    default:
+      return absl::OkStatus();
+  }
+}
+
+absl::Status P4InfoIndex::ValidateReadEntity(
+    const p4::v1::Entity& entity,
+    const absl::optional<std::string>& role) const {
+  if (!entity.has_table_entry()) return absl::OkStatus();
+  uint32_t table_id = entity.table_entry().table_id();
+  // Wildcard reads of every table.
+  if (table_id == 0) return absl::OkStatus();
+
+  const TableInfo* table = FindTable(table_id);
+  if (table == nullptr) {
+    return gutil::NotFoundErrorBuilder()
+           << "Table ID " << table_id << " is not in the P4Info.";
+  }
+  if (!RoleCanAccessTable(role, *table)) {
+    return gutil::PermissionDeniedErrorBuilder()
+           << "Table '" << table->name << "' is not in the scope of the role.";
+  }
+  return absl::OkStatus();
+}
+
+absl::Status P4InfoIndex::ValidateTableEntry(
+    const p4::v1::TableEntry& entry, p4::v1::Update::Type type,
+    const absl::optional<std::string>& role) const {
+  const TableInfo* table = FindTable(entry.table_id());
+  if (table == nullptr) {
+    return gutil::NotFoundErrorBuilder()
+           << "Table ID " << entry.table_id() << " is not in the P4Info.";
+  }
+  if (!RoleCanAccessTable(role, *table)) {
+    return gutil::PermissionDeniedErrorBuilder()
+           << "Table '" << table->name << "' is not in the scope of the role.";
+  }
+  if (table->is_const_table) {
+    return gutil::PermissionDeniedErrorBuilder()
+           << "Table '" << table->name << "' is const.";
+  }
+
+  if (entry.is_default_action()) {
+    if (entry.match_size() > 0 || entry.priority() != 0) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "The default entry of table '" << table->name
+             << "' cannot have a match or priority.";
+    }
+  } else {
+    absl::flat_hash_set<uint32_t> seen_fields;
+    for (const auto& match : entry.match()) {
+      auto field = table->match_fields.find(match.field_id());
+      if (field == table->match_fields.end()) {
+        return gutil::InvalidArgumentErrorBuilder()
+               << "Table '" << table->name << "' has no match field ID "
+               << match.field_id() << ".";
+      }
+      if (!seen_fields.insert(match.field_id()).second) {
+        return gutil::InvalidArgumentErrorBuilder()
+               << "Match field '" << field->second.name << "' is repeated.";
+      }
+      RETURN_IF_ERROR(ValidateFieldMatch(match, field->second));
+    }
+    for (uint32_t field_id : table->exact_match_field_ids) {
+      if (!seen_fields.contains(field_id)) {
+        return gutil::InvalidArgumentErrorBuilder()
+               << "Exact match field '"
+               << table->match_fields.at(field_id).name
+               << "' of table '" << table->name << "' is missing.";
+      }
+    }
+    if (table->requires_priority != (entry.priority() > 0)) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Table '" << table->name
+             << (table->requires_priority ? "' requires a priority."
+                                          : "' does not use priorities.");
+    }
+  }
+
+  // Deletes are matched on the key only.
+  if (type == p4::v1::Update::DELETE || !entry.has_action()) {
+    return absl::OkStatus();
+  }
+  switch (entry.action().type_case()) {
+    case p4::v1::TableAction::kAction:
+      return ValidateAction(entry.action().action(), table);
+    case p4::v1::TableAction::kActionProfileMemberId:
+    case p4::v1::TableAction::kActionProfileGroupId:
+    case p4::v1::TableAction::kActionProfileActionSet:
+      if (table->implementation_id == 0) {
+        return gutil::InvalidArgumentErrorBuilder()
+               << "Table '" << table->name
+               << "' has no action profile for indirect actions.";
+      }
+      if (entry.action().has_action_profile_action_set()) {
+        for (const auto& profile_action :
+             entry.action().action_profile_action_set()
+                 .action_profile_actions()) {
+          RETURN_IF_ERROR(ValidateAction(profile_action.action(), table));
+        }
+      }
+      return absl::OkStatus();
+    default:
+      return absl::OkStatus();
+  }
+}
+
+absl::Status P4InfoIndex::ValidateAction(const p4::v1::Action& action,
+                                         const TableInfo* table) const {
+  const ActionInfo* info = FindAction(action.action_id());
+  if (info == nullptr) {
+    return gutil::NotFoundErrorBuilder()
+           << "Action ID " << action.action_id() << " is not in the P4Info.";
+  }
+  if (table != nullptr && !table->action_ids.contains(info->id)) {
+    return gutil::InvalidArgumentErrorBuilder()
+           << "Action '" << info->name << "' is not an action of table '"
+           << table->name << "'.";
+  }
+
+  absl::flat_hash_set<uint32_t> seen_params;
+  for (const auto& param : action.params()) {
+    auto bitwidth = info->param_bitwidths.find(param.param_id());
+    if (bitwidth == info->param_bitwidths.end()) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Action '" << info->name << "' has no param ID "
+             << param.param_id() << ".";
+    }
+    if (!seen_params.insert(param.param_id()).second) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Param ID " << param.param_id() << " of action '"
+             << info->name << "' is repeated.";
+    }
+    RETURN_IF_ERROR(ValidateBytes(
+        param.value(), bitwidth->second,
+        absl::StrCat("Param ID ", param.param_id(), " of action '",
+                     info->name, "'")));
+  }
+  if (seen_params.size() != info->param_bitwidths.size()) {
+    return gutil::InvalidArgumentErrorBuilder()
+           << "Action '" << info->name << "' expects "
+           << info->param_bitwidths.size() << " params, got "
+           << seen_params.size() << ".";
+  }
+  return absl::OkStatus();
+}
+
+absl::Status P4InfoIndex::ValidateActionProfileEntity(
+    uint32_t action_profile_id, const p4::v1::Action* action,
+    const absl::optional<std::string>& role) const {
+  const ActionProfileInfo* profile = FindActionProfile(action_profile_id);
+  if (profile == nullptr) {
+    return gutil::NotFoundErrorBuilder()
+           << "Action profile ID " << action_profile_id
+           << " is not in the P4Info.";
+  }
+
+  // A profile is in scope if one of its tables is.
+  bool in_scope = !has_roles_ || !role.has_value();
+  for (uint32_t table_id : profile->table_ids) {
+    const TableInfo* table = FindTable(table_id);
+    if (table != nullptr && RoleCanAccessTable(role, *table)) in_scope = true;
+  }
+  if (!in_scope) {
+    return gutil::PermissionDeniedErrorBuilder()
+           << "Action profile '" << profile->name
+           << "' is not in the scope of the role.";
+  }
+
+  if (action == nullptr) return absl::OkStatus();
+  return ValidateAction(*action, /*table=*/nullptr);
+}
+
+}//namespace p4rt_server
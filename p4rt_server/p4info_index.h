@@ -0,0 +1,123 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _P4INFO_INDEX_H_
+#define _P4INFO_INDEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/optional.h"
+#include "p4/config/v1/p4info.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// Immutable lookup tables built from a P4Info.
+//
+// The index is built once per SetForwardingPipelineConfig, and lets the
+// server validate every update of a WriteRequest (IDs, match fields, action
+// parameters and the role of the sender) with hash lookups before the request
+// reaches the switch provider. Providers get the same index through
+// SwitchProviderBase::GetP4InfoIndex.
+//
+// Tables are scoped to a role with a @p4runtime_role("<role name>")
+// annotation. A controller with a named role may only access tables
+// annotated with that role; the default role may access every table. If no
+// table carries the annotation, roles are not checked.
+class P4InfoIndex {
+ public:
+  struct ActionInfo {
+    uint32_t id;
+    std::string name;
+    // Bitwidth by param ID. A bitwidth of 0 means the width is not known.
+    absl::flat_hash_map<uint32_t, int32_t> param_bitwidths;
+  };
+
+  struct MatchFieldInfo {
+    uint32_t id;
+    std::string name;
+    int32_t bitwidth;
+    p4::config::v1::MatchField::MatchType match_type;
+  };
+
+  struct TableInfo {
+    uint32_t id;
+    std::string name;
+    absl::flat_hash_map<uint32_t, MatchFieldInfo> match_fields;
+    // IDs of the exact match fields, which every entry must set.
+    std::vector<uint32_t> exact_match_field_ids;
+    absl::flat_hash_set<uint32_t> action_ids;
+    // Action profile of indirect tables, 0 for direct tables.
+    uint32_t implementation_id;
+    // Tables with ternary, range or optional matches need a priority.
+    bool requires_priority;
+    bool is_const_table;
+    // Role from the @p4runtime_role annotation.
+    absl::optional<std::string> role;
+  };
+
+  struct ActionProfileInfo {
+    uint32_t id;
+    std::string name;
+    absl::flat_hash_set<uint32_t> table_ids;
+  };
+
+  // Builds the index. Fails if the P4Info has duplicate IDs or references
+  // unknown actions or action profiles.
+  static absl::StatusOr<std::shared_ptr<const P4InfoIndex>> Create(
+      const p4::config::v1::P4Info& p4info);
+
+  P4InfoIndex(const P4InfoIndex&) = delete;
+  P4InfoIndex& operator=(const P4InfoIndex&) = delete;
+
+  // Return nullptr if the ID is not in the P4Info.
+  const TableInfo* FindTable(uint32_t id) const;
+  const ActionInfo* FindAction(uint32_t id) const;
+  const ActionProfileInfo* FindActionProfile(uint32_t id) const;
+
+  // Returns true if a controller with the role may access the table.
+  bool RoleCanAccessTable(const absl::optional<std::string>& role,
+                          const TableInfo& table) const;
+
+  // Sorted IDs of the tables a controller with the role may access.
+  std::vector<uint32_t> TableIds(const absl::optional<std::string>& role) const;
+
+  // Checks that an update is well formed for the P4Info and that the role
+  // may write it. Entity types without an index are not checked.
+  absl::Status ValidateUpdate(const p4::v1::Update& update,
+                              const absl::optional<std::string>& role) const;
+
+  // Checks the IDs and role scope of an entity in a ReadRequest.
+  absl::Status ValidateReadEntity(const p4::v1::Entity& entity,
+                                  const absl::optional<std::string>& role) const;
+
+ private:
+  P4InfoIndex() = default;
+
+  absl::Status ValidateTableEntry(const p4::v1::TableEntry& entry,
+                                  p4::v1::Update::Type type,
+                                  const absl::optional<std::string>& role) const;
+  absl::Status ValidateAction(const p4::v1::Action& action,
+                              const TableInfo* table) const;
+  absl::Status ValidateActionProfileEntity(
+      uint32_t action_profile_id, const p4::v1::Action* action,
+      const absl::optional<std::string>& role) const;
+
+  absl::flat_hash_map<uint32_t, TableInfo> tables_;
+  absl::flat_hash_map<uint32_t, ActionInfo> actions_;
+  absl::flat_hash_map<uint32_t, ActionProfileInfo> action_profiles_;
+  bool has_roles_ = false;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _P4INFO_INDEX_H_
@@ -6,11 +6,22 @@
  */
 
 #include "p4rt_server.h"
+#include "pipeline_diff.h"
+#include "read_query.h"
+#include "read_response_chunker.h"
 #include "sdn_controller_manager.h"
+#include "tracing.h"
+#include "write_batch_checker.h"
 
 #include <memory>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
 #include "glog/logging.h"
 #include "grpcpp/grpcpp.h"
 #include "grpcpp/server_context.h"
@@ -31,6 +42,106 @@ namespace{
      return response;
    }
 
+   // Converts a DoRead failure into the status returned to the controller.
+   grpc::Status ReadFailure(const absl::Status& status) {
+     LOG(WARNING) << "Read failure: " << status;
+     return grpc::Status(grpc::StatusCode::UNKNOWN,
+                         absl::StrCat("Read failure: ", status.ToString()));
+   }
+
+   // False if the client asked to read counters and meters from the switch
+   // rather than from the counter cache.
+   bool AllowsCachedCounters(const grpc::ServerContext* context) {
+     if (context == nullptr) return true;
+     auto metadata = context->client_metadata().find("p4rt-counter-cache");
+     return metadata == context->client_metadata().end() ||
+            metadata->second != "bypass";
+   }
+
+   // Writes the last chunk of a Read.
+   grpc::Status FinishRead(ReadResponseChunker* chunker) {
+     if (!chunker->Finish()) {
+       return grpc::Status(grpc::StatusCode::UNKNOWN,
+                           "Failed to write ReadResponse.");
+     }
+     return grpc::Status::OK;
+   }
+
+   // Names the root span of a StreamChannel message.
+   const char* StreamMessageSpanName(
+       const p4::v1::StreamMessageRequest& request) {
+     switch (request.update_case()) {
+       case p4::v1::StreamMessageRequest::kArbitration:
+         return "StreamChannel.arbitration";
+       case p4::v1::StreamMessageRequest::kPacket:
+         return "StreamChannel.packet";
+       case p4::v1::StreamMessageRequest::kDigestAck:
+         return "StreamChannel.digest_ack";
+       default:
+         return "StreamChannel.other";
+     }
+   }
+
+   // Returns the role of a Write or Read request, absl::nullopt for the
+   // default role.
+   template <typename Request>
+   absl::optional<std::string> RoleOf(const Request& request) {
+     if (request.role().empty()) return absl::nullopt;
+     return request.role();
+   }
+
+   // Validates every update of a WriteRequest against the index, if any,
+   // and with a WriteBatchChecker if pre_validate is set. Returns nothing if
+   // they are all valid, otherwise one status per update: the error of every
+   // invalid update, and OK for the valid ones.
+   std::vector<absl::Status> ValidateWriteRequest(
+       const P4InfoIndex* index, bool pre_validate,
+       const p4::v1::WriteRequest& request,
+       const absl::optional<std::string>& role) {
+     std::vector<absl::Status> statuses;
+     statuses.reserve(request.updates_size());
+     absl::optional<WriteBatchChecker> checker;
+     if (pre_validate) checker.emplace(request.updates_size());
+     bool failed = false;
+     for (const auto& update : request.updates()) {
+       absl::Status status;
+       if (checker.has_value()) status = checker->Check(update);
+       if (status.ok() && index != nullptr) {
+         status = index->ValidateUpdate(update, role);
+       }
+       failed |= !status.ok();
+       statuses.push_back(std::move(status));
+     }
+     if (!failed) return {};
+     return statuses;
+   }
+
+   // Marks the valid updates of a batch that is not executed as ABORTED.
+   void AbortValidUpdates(std::vector<absl::Status>* statuses) {
+     for (auto& status : *statuses) {
+       if (status.ok()) {
+         status = gutil::AbortedErrorBuilder()
+                  << "Not executed, since the batch has invalid updates.";
+       }
+     }
+   }
+
+   // Returns a copy of the request with only the updates whose status is OK.
+   p4::v1::WriteRequest ValidUpdates(
+       const p4::v1::WriteRequest& request,
+       const std::vector<absl::Status>& statuses) {
+     p4::v1::WriteRequest valid;
+     valid.set_device_id(request.device_id());
+     valid.set_role_id(request.role_id());
+     valid.set_role(request.role());
+     *valid.mutable_election_id() = request.election_id();
+     valid.set_atomicity(request.atomicity());
+     for (int i = 0; i < request.updates_size(); ++i) {
+       if (statuses[i].ok()) *valid.add_updates() = request.updates(i);
+     }
+     return valid;
+   }
+
    // Generates StreamMessageResponse with errors for PacketIO
    p4::v1::StreamMessageResponse GenerateErrorResponse(
        absl::Status status, const p4::v1::PacketOut& packet) {
@@ -39,14 +150,113 @@ namespace{
          packet;
      return response;
    }
+
+   Histogram* RpcLatency(MetricsRegistry* metrics, absl::string_view rpc) {
+     return metrics->GetHistogram("p4rt_rpc_latency_seconds",
+                                  {{"rpc", std::string(rpc)}});
+   }
+
+   Histogram* ProviderLatency(MetricsRegistry* metrics,
+                              absl::string_view call) {
+     return metrics->GetHistogram("p4rt_provider_call_latency_seconds",
+                                  {{"call", std::string(call)}});
+   }
+
+   // Generates StreamMessageResponse with errors for digest acks
+   p4::v1::StreamMessageResponse GenerateErrorResponse(
+       absl::Status status, const p4::v1::DigestListAck& ack) {
+     p4::v1::StreamMessageResponse response = GenerateErrorResponse(status);
+     *response.mutable_error()->mutable_digest_list_ack()
+          ->mutable_digest_list_ack() = ack;
+     return response;
+   }
 }
 
 P4RtServer::P4RtServer(
-    std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider):
-  switch_provider_(std::move(switch_provider)){
+    std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider,
+    absl::optional<uint64_t> device_id):
+  switch_provider_(std::move(switch_provider)),
+  device_id_(device_id),
+  metrics_(std::make_shared<MetricsRegistry>()){
   LOG(ERROR) << "P4RtServer::P4RtServer calling init";
-  controller_manager_ = std::make_shared<SdnControllerManager>(); 
+  TracingOptions tracing_options = switch_provider_->TracingOptions();
+  if (tracing_options.sample_one_in > 0 && tracing_options.sink != nullptr) {
+    tracer_ = absl::make_unique<Tracer>(tracing_options);
+  }
+  request_metrics_ = {
+      RpcLatency(metrics_.get(), "Write"),
+      RpcLatency(metrics_.get(), "Read"),
+      RpcLatency(metrics_.get(), "SetForwardingPipelineConfig"),
+      RpcLatency(metrics_.get(), "GetForwardingPipelineConfig"),
+      ProviderLatency(metrics_.get(), "DoWrite"),
+      ProviderLatency(metrics_.get(), "DoWriteUpdate"),
+      ProviderLatency(metrics_.get(), "DoRead"),
+      ProviderLatency(metrics_.get(), "DoQueryRead"),
+      ProviderLatency(metrics_.get(), "SendPacketOuts"),
+      ProviderLatency(metrics_.get(), "SetForwardingPipelineConfig"),
+      ProviderLatency(metrics_.get(), "GetForwardingPipelineConfig"),
+      metrics_->GetGauge("p4rt_packet_out_queue_depth")};
+  controller_manager_ = std::make_shared<SdnControllerManager>(
+      metrics_, [provider = switch_provider_.get()](
+                    const absl::optional<std::string>& role_name) {
+        return provider->RateLimitsForRole(role_name);
+      },
+      switch_provider_->MirrorPacketInsToBackups(), device_id_);
   switch_provider_->AddSdnController(controller_manager_);
+  digest_manager_ = std::make_shared<DigestManager>(controller_manager_);
+  switch_provider_->AddDigestManager(digest_manager_);
+  packet_in_options_ = switch_provider_->PacketInQueueOptions();
+  packet_out_options_ = switch_provider_->PacketOutDispatcherOptions();
+  packet_out_options_.queue_depth = request_metrics_.packet_out_queue_depth;
+  pre_validate_writes_ = switch_provider_->PreValidateWrites();
+  use_packet_out_buffers_ = switch_provider_->UsePacketOutBuffers();
+  int write_parallelism = switch_provider_->WriteUpdateParallelism();
+  if (write_parallelism > 0) {
+    write_executor_ = absl::make_unique<WriteExecutor>(write_parallelism);
+  }
+  if (switch_provider_->UseEntityStore()) {
+    entity_store_ = absl::make_unique<EntityStore>();
+  }
+  CounterCacheOptions counter_cache_options =
+      switch_provider_->CounterCacheOptions();
+  if (counter_cache_options.poll_interval > absl::ZeroDuration()) {
+    counter_cache_ = absl::make_unique<CounterCache>(
+        counter_cache_options,
+        [this](const p4::v1::ReadRequest& request,
+               const std::function<bool(p4::v1::Entity)>& write_entity) {
+          auto index = p4info_index_.Load();
+          return ReadFromSwitch(request, index.get(), absl::nullopt,
+                                write_entity);
+        });
+  }
+  AdmissionControlOptions admission_options =
+      switch_provider_->AdmissionControlOptions();
+  if (admission_options.max_concurrent_requests > 0) {
+    admission_controller_ = absl::make_unique<AdmissionController>(
+        admission_options,
+        [provider = switch_provider_.get()](
+            RequestType type, const absl::optional<std::string>& role) {
+          return provider->AdmissionLimitsFor(type, role);
+        },
+        metrics_.get());
+  }
+  WriteGroupCommitter::Options group_commit_options =
+      switch_provider_->WriteGroupCommitOptions();
+  if (group_commit_options.window > absl::ZeroDuration()) {
+    group_committer_ = absl::make_unique<WriteGroupCommitter>(
+        group_commit_options,
+        [this](absl::Span<const p4::v1::WriteRequest* const> requests) {
+          return CommitWrites(requests);
+        });
+  }
+  WarmRestartOptions warm_restart_options =
+      switch_provider_->WarmRestartOptions();
+  if (!warm_restart_options.snapshot_path.empty()) {
+    RestoreSnapshot(warm_restart_options.snapshot_path);
+    snapshot_writer_ = absl::make_unique<SnapshotWriter>(
+        warm_restart_options, [this]() { return TakeSnapshot(); });
+  }
+  if (pipeline_config_.Load() == nullptr) LoadPipelineConfig();
 }
 
 /*
@@ -56,23 +266,88 @@ P4RtServer::P4RtServer(
 grpc::Status P4RtServer::Write(grpc::ServerContext* context,
                                     const p4::v1::WriteRequest* request,
                                     p4::v1::WriteResponse* response) {
+  LatencyTimer timer(request_metrics_.write);
+  ScopedSpan span(tracer_.get(), "Write");
   #ifdef __EXCEPTIONS
     try {
   #endif
 
+      auto device_status = CheckDeviceId(request->device_id());
+      if (!device_status.ok()) return device_status;
       // verify the request comes from the primary connection.
-      auto connection_status = controller_manager_->AllowRequest(*request);
+      grpc::Status connection_status;
+      {
+        ScopedSpan allow_span("AllowRequest");
+        connection_status = controller_manager_->AllowRequest(*request);
+      }
       if (!connection_status.ok()) {
         return connection_status;
       }
-      auto result = switch_provider_->DoWrite(request);
-      return gutil::AbslStatusToGrpcStatus(result);
+      auto index = p4info_index_.Load();
+      absl::optional<std::string> role = RoleOf(*request);
+      absl::optional<AdmissionController::Ticket> ticket;
+      auto admission_status =
+          Admit(RequestType::kWrite, role, context, &ticket);
+      if (!admission_status.ok()) return admission_status;
+
+      // Other atomicity modes need the provider to see the whole batch.
+      if (write_executor_ != nullptr &&
+          request->atomicity() == p4::v1::WriteRequest::CONTINUE_ON_ERROR) {
+        std::vector<absl::Status> statuses;
+        auto execute = [this, request, &index, &role, &statuses]() {
+          statuses = ExecuteUpdates(*request, index.get(), role);
+        };
+        // Keeps its place in the commit order of grouped writes.
+        if (group_committer_ != nullptr) {
+          ScopedSpan commit_span("GroupCommit");
+          group_committer_->CommitAlone(execute);
+        } else {
+          execute();
+        }
+        return WriteStatusesToGrpcStatus(statuses);
+      }
+      // Malformed updates never reach the provider.
+      std::vector<absl::Status> statuses;
+      p4::v1::WriteRequest valid_updates;
+      const p4::v1::WriteRequest* commit_request = request;
+      if (index != nullptr || pre_validate_writes_) {
+        statuses = ValidateWriteRequest(index.get(), pre_validate_writes_,
+                                        *request, role);
+        if (!statuses.empty()) {
+          if (request->atomicity() != p4::v1::WriteRequest::CONTINUE_ON_ERROR) {
+            AbortValidUpdates(&statuses);
+            return WriteStatusesToGrpcStatus(statuses);
+          }
+          // The valid updates of a CONTINUE_ON_ERROR batch are still
+          // executed, as one request.
+          valid_updates = ValidUpdates(*request, statuses);
+          if (valid_updates.updates().empty()) {
+            return WriteStatusesToGrpcStatus(statuses);
+          }
+          commit_request = &valid_updates;
+        }
+        span.AddEvent("validated");
+      }
+      absl::Status result;
+      if (group_committer_ != nullptr) {
+        ScopedSpan commit_span("GroupCommit");
+        result = group_committer_->Commit(*commit_request);
+      } else {
+        result = CommitWrites({commit_request})[0];
+      }
+      if (statuses.empty()) return gutil::AbslStatusToGrpcStatus(result);
+      // The provider reports one status for all the valid updates.
+      for (auto& status : statuses) {
+        if (status.ok()) status = result;
+      }
+      return WriteStatusesToGrpcStatus(statuses);
   #ifdef __EXCEPTIONS
     } catch (const std::exception& e) {
       LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
     } catch (...) {
       LOG(FATAL) << "Unknown exception caught in " << __func__;
     }
+    return grpc::Status(grpc::StatusCode::INTERNAL, "Unhandled exception.");
   #endif
 }
 
@@ -83,6 +358,27 @@ grpc::Status P4RtServer::Write(grpc::ServerContext* context,
 grpc::Status P4RtServer::Read(
     grpc::ServerContext* context, const p4::v1::ReadRequest* request,
     grpc::ServerWriter<p4::v1::ReadResponse>* response_writer) {
+  if (response_writer == nullptr) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "ReadResponse writer cannot be a nullptr.");
+  }
+  return HandleRead(context, request, [response_writer](
+                                 const p4::v1::ReadResponse& response) {
+    bool written = response_writer->Write(response);
+    ScopedSpan::AddCurrentEvent("response_written");
+    return written;
+  });
+}
+
+/*
+ * P4RtServer::HandleRead
+ * Reads the requested entities from the switch provider
+ */
+grpc::Status P4RtServer::HandleRead(
+    const grpc::ServerContext* context, const p4::v1::ReadRequest* request,
+    const std::function<bool(const p4::v1::ReadResponse&)>& write_response) {
+  LatencyTimer timer(request_metrics_.read);
+  ScopedSpan span(tracer_.get(), "Read");
 #ifdef __EXCEPTIONS
   try {
 #endif
@@ -90,31 +386,415 @@ grpc::Status P4RtServer::Read(
       return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
                           "ReadRequest cannot be a nullptr.");
     }   
-    if (response_writer == nullptr) {
-      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                          "ReadResponse writer cannot be a nullptr.");
-    }   
+    auto device_status = CheckDeviceId(request->device_id());
+    if (!device_status.ok()) return device_status;
 
-    auto response_status = switch_provider_->DoRead(request);
-    if (!response_status.ok()) {
-      LOG(WARNING) << "Read failure: " << response_status.status();
-      return grpc::Status(
-          grpc::StatusCode::UNKNOWN,
-          absl::StrCat("Read failure: ", response_status.status().ToString()));
-    }   
+    auto index = p4info_index_.Load();
+    absl::optional<std::string> role = RoleOf(*request);
+    if (index != nullptr) {
+      for (const auto& entity : request->entities()) {
+        auto status = index->ValidateReadEntity(entity, role);
+        if (!status.ok()) return gutil::AbslStatusToGrpcStatus(status);
+      }
+    }
 
-    response_writer->Write(response_status.value());
-    return grpc::Status::OK;
+    absl::optional<AdmissionController::Ticket> ticket;
+    auto admission_status = Admit(RequestType::kRead, role, context, &ticket);
+    if (!admission_status.ok()) return admission_status;
+
+    // Entities are written to the controller in bounded chunks as soon as
+    // they are read, instead of building one ReadResponse for the whole read.
+    ReadResponseChunker chunker(write_response);
+    auto write_entity = [&chunker](p4::v1::Entity entity) {
+      return chunker.Add(std::move(entity));
+    };
+
+    bool use_counter_cache =
+        counter_cache_ != nullptr && AllowsCachedCounters(context);
+    if (entity_store_ == nullptr && !use_counter_cache) {
+      auto status = ReadFromSwitch(*request, index.get(), role, write_entity);
+      if (!status.ok()) return ReadFailure(status);
+      return FinishRead(&chunker);
+    }
+
+    // Serve what we can from memory and only read the rest from the switch.
+    p4::v1::ReadRequest switch_request;
+    switch_request.set_device_id(request->device_id());
+    switch_request.set_role(request->role());
+    // Tables outside the scope of a role are not served from the entity
+    // store or the counter cache.
+    std::function<bool(uint32_t)> table_visible;
+    if (index != nullptr && role.has_value()) {
+      table_visible = [&index, &role](uint32_t table_id) {
+        const P4InfoIndex::TableInfo* table = index->FindTable(table_id);
+        return table != nullptr && index->RoleCanAccessTable(role, *table);
+      };
+    }
+    for (const auto& entity : request->entities()) {
+      if (entity_store_ != nullptr &&
+          switch_provider_->ReadFromEntityStore(entity)) {
+        // Stored entries go straight into the chunker.
+        bool written = true;
+        entity_store_->Read(entity.table_entry(), table_visible,
+                            [&](p4::v1::TableEntry entry) {
+                              p4::v1::Entity stored_entity;
+                              *stored_entity.mutable_table_entry() =
+                                  std::move(entry);
+                              written = write_entity(std::move(stored_entity));
+                              return written;
+                            });
+        if (!written) return FinishRead(&chunker);
+        continue;
+      }
+      p4::v1::ReadResponse stored;
+      if (!use_counter_cache || !CounterCache::CanServe(entity) ||
+          !counter_cache_->Read(entity, table_visible, &stored)) {
+        *switch_request.add_entities() = entity;
+        continue;
+      }
+      for (auto& stored_entity : *stored.mutable_entities()) {
+        if (!write_entity(std::move(stored_entity))) {
+          return FinishRead(&chunker);
+        }
+      }
+    }
+    if (switch_request.entities_size() > 0) {
+      auto status =
+          ReadFromSwitch(switch_request, index.get(), role, write_entity);
+      if (!status.ok()) return ReadFailure(status);
+    }
+    return FinishRead(&chunker);
 #ifdef __EXCEPTIONS
   } catch (const std::exception& e) {
     LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
   } catch (...) {
     LOG(FATAL) << "Unknown exception caught in " << __func__;
   }
+  return grpc::Status(grpc::StatusCode::INTERNAL, "Unhandled exception.");
 #endif
   
 }
 
+/*
+ * P4RtServer::ReadFromSwitch
+ * Parses the entities of a ReadRequest against the P4Info and reads them
+ * with the switch provider's DoQueryRead
+ */
+absl::Status P4RtServer::ReadFromSwitch(
+    const p4::v1::ReadRequest& request, const P4InfoIndex* index,
+    const absl::optional<std::string>& role,
+    const std::function<bool(p4::v1::Entity)>& write_entity) {
+  std::vector<ReadQuery> queries = ParseReadQueries(request, index, role);
+  LatencyTimer timer(request_metrics_.do_query_read);
+  ScopedSpan provider_span("DoQueryRead");
+  return switch_provider_->DoQueryRead(&request, queries, write_entity);
+}
+
+/*
+ * P4RtServer::RecordUpdate
+ * Records an update the switch provider applied in the entity store and the
+ * digest manager
+ */
+void P4RtServer::RecordUpdate(const p4::v1::Update& update,
+                              const absl::optional<std::string>& role) {
+  if (entity_store_ != nullptr) entity_store_->Apply(update);
+  digest_manager_->ApplyUpdate(update, role);
+}
+
+/*
+ * P4RtServer::CheckDeviceId
+ * Rejects requests for a device other than the one the server was created
+ * for
+ */
+grpc::Status P4RtServer::CheckDeviceId(uint64_t device_id) const {
+  if (!device_id_.has_value() || device_id == *device_id_) {
+    return grpc::Status::OK;
+  }
+  return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                      absl::StrCat("Unknown device ID ", device_id,
+                                   ", this is device ", *device_id_, "."));
+}
+
+/*
+ * P4RtServer::Admit
+ * Waits for a slot of the admission controller, at most until the deadline
+ * of the RPC
+ */
+grpc::Status P4RtServer::Admit(
+    RequestType type, const absl::optional<std::string>& role,
+    const grpc::ServerContext* context,
+    absl::optional<AdmissionController::Ticket>* ticket) {
+  if (admission_controller_ == nullptr) return grpc::Status::OK;
+  ScopedSpan span("Admit");
+  absl::Time deadline = absl::InfiniteFuture();
+  if (context != nullptr) deadline = absl::FromChrono(context->deadline());
+  auto admitted = admission_controller_->Admit(type, role, deadline);
+  if (!admitted.ok()) {
+    return gutil::AbslStatusToGrpcStatus(admitted.status());
+  }
+  ticket->emplace(std::move(admitted).value());
+  return grpc::Status::OK;
+}
+
+/*
+ * P4RtServer::CommitWrites
+ * Applies WriteRequests through the switch provider, one group at a time,
+ * and records the updates of the requests that succeeded in commit order
+ */
+std::vector<absl::Status> P4RtServer::CommitWrites(
+    absl::Span<const p4::v1::WriteRequest* const> requests) {
+  std::vector<absl::Status> statuses;
+  {
+    absl::ReaderMutexLock commit_lock(&commit_lock_);
+    {
+      LatencyTimer timer(request_metrics_.do_write);
+      ScopedSpan provider_span("DoWrites");
+      statuses = switch_provider_->DoWrites(requests);
+    }
+    if (statuses.size() != requests.size()) {
+      statuses.assign(requests.size(),
+                      gutil::InternalErrorBuilder()
+                          << "Switch provider returned " << statuses.size()
+                          << " statuses for " << requests.size()
+                          << " write requests.");
+    }
+    for (size_t i = 0; i < requests.size(); ++i) {
+      if (!statuses[i].ok()) continue;
+      absl::optional<std::string> role = RoleOf(*requests[i]);
+      for (const auto& update : requests[i]->updates()) {
+        RecordUpdate(update, role);
+      }
+    }
+  }
+  if (entity_store_ != nullptr) {
+    for (size_t i = 0; i < requests.size(); ++i) {
+      if (!statuses[i].ok()) ResyncEntityStore(*requests[i]);
+    }
+  }
+  return statuses;
+}
+
+/*
+ * P4RtServer::ExecuteUpdates
+ * Applies the updates of a CONTINUE_ON_ERROR WriteRequest one at a time
+ * through the write executor. Updates the batch checker or the P4Info reject
+ * fail on their own, and the others are still executed
+ */
+std::vector<absl::Status> P4RtServer::ExecuteUpdates(
+    const p4::v1::WriteRequest& request, const P4InfoIndex* index,
+    const absl::optional<std::string>& role) {
+  absl::flat_hash_map<const p4::v1::Update*, absl::Status> rejected;
+  if (pre_validate_writes_) {
+    WriteBatchChecker checker(request.updates_size());
+    for (const auto& update : request.updates()) {
+      absl::Status status = checker.Check(update);
+      if (!status.ok()) rejected.emplace(&update, std::move(status));
+    }
+  }
+
+  absl::ReaderMutexLock commit_lock(&commit_lock_);
+  ScopedSpan execute_span("WriteExecutor");
+  auto statuses = write_executor_->Execute(
+      request, [this, index, &role, &rejected](const p4::v1::Update& update) {
+        auto rejection = rejected.find(&update);
+        if (rejection != rejected.end()) return rejection->second;
+        if (index != nullptr) {
+          auto status = index->ValidateUpdate(update, role);
+          if (!status.ok()) return status;
+        }
+        LatencyTimer timer(request_metrics_.do_write_update);
+        return switch_provider_->DoWriteUpdate(update);
+      });
+  for (int i = 0; i < request.updates_size(); ++i) {
+    if (statuses[i].ok()) RecordUpdate(request.updates(i), role);
+  }
+  return statuses;
+}
+
+/*
+ * P4RtServer::ResyncEntityStore
+ * Reloads the tables written by a failed WriteRequest from the switch, since
+ * we cannot tell which of its updates were applied. No other write is applied
+ * between the read and the replace
+ */
+void P4RtServer::ResyncEntityStore(const p4::v1::WriteRequest& request) {
+  absl::flat_hash_set<uint32_t> table_ids;
+  p4::v1::ReadRequest read_request;
+  read_request.set_device_id(request.device_id());
+  for (const auto& update : request.updates()) {
+    uint32_t table_id = EntityStore::StoredTableId(update);
+    if (table_id == 0 || !table_ids.insert(table_id).second) continue;
+    read_request.add_entities()->mutable_table_entry()->set_table_id(table_id);
+  }
+  if (table_ids.empty()) return;
+
+  absl::MutexLock commit_lock(&commit_lock_);
+  p4::v1::ReadResponse response;
+  auto index = p4info_index_.Load();
+  absl::Status status = ReadFromSwitch(
+      read_request, index.get(), absl::nullopt,
+      [&response](p4::v1::Entity entity) {
+        *response.add_entities() = std::move(entity);
+        return true;
+      });
+  if (!status.ok()) {
+    // Keep what we have rather than serving reads with the tables missing.
+    LOG(ERROR) << "Could not resync entity store after failed write: "
+               << status;
+    return;
+  }
+  entity_store_->ReplaceTables(table_ids, response);
+}
+
+/*
+ * P4RtServer::SaveSnapshot
+ * Writes the warm restart snapshot on demand
+ */
+absl::Status P4RtServer::SaveSnapshot() {
+  if (snapshot_writer_ == nullptr) {
+    return gutil::FailedPreconditionErrorBuilder()
+           << "Warm restart is not enabled by the switch provider.";
+  }
+  return snapshot_writer_->Write();
+}
+
+/*
+ * P4RtServer::TakeSnapshot
+ * Collects the committed pipeline config, the entity store and the election
+ * IDs of every role for a warm restart snapshot
+ */
+ServerSnapshot P4RtServer::TakeSnapshot() {
+  ServerSnapshot snapshot;
+  {
+    // Keeps the entries consistent with the config they were written for,
+    // and with the writes the switch applied.
+    absl::MutexLock l(&pipeline_config_lock_);
+    absl::MutexLock commit_lock(&commit_lock_);
+    auto config = pipeline_config_.Load();
+    if (config != nullptr) snapshot.pipeline_config = *config;
+    if (entity_store_ != nullptr) {
+      // Bounded chunks keep every message far below the protobuf limits.
+      constexpr int kEntitiesPerChunk = 4096;
+      int stored = 0;
+      entity_store_->Read(p4::v1::TableEntry(), nullptr,
+                          [&snapshot, &stored](p4::v1::TableEntry entry) {
+                            if (stored++ % kEntitiesPerChunk == 0) {
+                              snapshot.table_entries.emplace_back();
+                            }
+                            *snapshot.table_entries.back()
+                                 .add_entities()
+                                 ->mutable_table_entry() = std::move(entry);
+                            return true;
+                          });
+    }
+  }
+  snapshot.election_ids = controller_manager_->ElectionIds();
+  return snapshot;
+}
+
+/*
+ * P4RtServer::RestoreSnapshot
+ * Reloads the warm restart snapshot written before the last shutdown. The
+ * switch still runs its pipeline, so the provider only restores its own
+ * state and nothing is reprogrammed
+ */
+void P4RtServer::RestoreSnapshot(const std::string& snapshot_path) {
+  auto snapshot = ReadServerSnapshot(snapshot_path);
+  if (!snapshot.ok()) {
+    if (!absl::IsNotFound(snapshot.status())) {
+      LOG(WARNING) << "Ignoring warm restart snapshot " << snapshot_path
+                   << ": " << snapshot.status();
+    }
+    return;
+  }
+  if (snapshot->pipeline_config.has_value()) {
+    const p4::v1::ForwardingPipelineConfig& config = *snapshot->pipeline_config;
+    std::shared_ptr<const P4InfoIndex> index;
+    if (config.has_p4info()) {
+      auto index_status = P4InfoIndex::Create(config.p4info());
+      if (!index_status.ok()) {
+        LOG(WARNING) << "Ignoring warm restart snapshot " << snapshot_path
+                     << " with an invalid P4Info: " << index_status.status();
+        return;
+      }
+      index = std::move(index_status).value();
+    }
+    switch_provider_->SetP4InfoIndex(index);
+    absl::Status status =
+        switch_provider_->RestoreForwardingPipelineConfig(config);
+    if (!status.ok()) {
+      switch_provider_->SetP4InfoIndex(nullptr);
+      LOG(WARNING) << "Ignoring warm restart snapshot " << snapshot_path
+                   << " the switch provider cannot restore: " << status;
+      return;
+    }
+    pipeline_config_.Store(
+        std::make_shared<p4::v1::ForwardingPipelineConfig>(config));
+    p4info_index_.Store(index);
+    // Entries are only valid for the pipeline they were written to.
+    if (entity_store_ != nullptr) {
+      p4::v1::Update update;
+      update.set_type(p4::v1::Update::INSERT);
+      for (auto& chunk : snapshot->table_entries) {
+        for (auto& entity : *chunk.mutable_entities()) {
+          *update.mutable_entity() = std::move(entity);
+          entity_store_->Apply(update);
+        }
+      }
+    }
+  }
+  controller_manager_->RestoreElectionIds(snapshot->election_ids);
+  LOG(INFO) << "Warm restart from snapshot " << snapshot_path << ".";
+}
+
+/*
+ * P4RtServer::LoadPipelineConfig
+ * Caches the pipeline the switch already runs and indexes its P4Info, so
+ * writes are validated before a controller sets a pipeline
+ */
+void P4RtServer::LoadPipelineConfig() {
+  auto config = GetPipelineConfig();
+  if (!config.ok()) {
+    LOG(INFO) << "No pipeline config from the switch provider yet: "
+              << config.status();
+    return;
+  }
+  if (!(*config)->has_p4info()) return;
+  auto index_status = P4InfoIndex::Create((*config)->p4info());
+  if (!index_status.ok()) {
+    LOG(WARNING) << "Cannot index the P4Info of the switch provider: "
+                 << index_status.status();
+    return;
+  }
+  p4info_index_.Store(index_status.value());
+  switch_provider_->SetP4InfoIndex(std::move(index_status).value());
+}
+
+/*
+ * P4RtServer::GetPipelineConfig
+ * Returns the last committed pipeline config. Until one is committed through
+ * this server it is read from the switch provider once and cached
+ */
+absl::StatusOr<std::shared_ptr<const p4::v1::ForwardingPipelineConfig>>
+P4RtServer::GetPipelineConfig() {
+  auto config = pipeline_config_.Load();
+  if (config != nullptr) return config;
+
+  absl::MutexLock l(&pipeline_config_lock_);
+  config = pipeline_config_.Load();
+  if (config != nullptr) return config;
+  absl::StatusOr<p4::v1::ForwardingPipelineConfig> config_status;
+  {
+    LatencyTimer timer(request_metrics_.provider_get_pipeline_config);
+    config_status = switch_provider_->GetForwardingPipelineConfig();
+  }
+  if (!config_status.ok()) return config_status.status();
+  config = std::make_shared<p4::v1::ForwardingPipelineConfig>(
+      std::move(config_status).value());
+  pipeline_config_.Store(config);
+  return config;
+}
+
 /*
  * P4RtServer::StreamChannel
  * Sets up grpc stream channel for bi-directional communication
@@ -124,68 +804,53 @@ grpc::Status P4RtServer::StreamChannel(
     grpc::ServerContext* context,
     grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
                              p4::v1::StreamMessageRequest>* stream) {
+  return ServeStreamChannel(context, stream, nullptr);
+}
+
+/*
+ * P4RtServer::ServeStreamChannel
+ * Serves a StreamChannel, starting with a request that was already read from
+ * the stream, if any
+ */
+grpc::Status P4RtServer::ServeStreamChannel(
+    grpc::ServerContext* context,
+    grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
+                             p4::v1::StreamMessageRequest>* stream,
+    p4::v1::StreamMessageRequest* first_request) {
 #ifdef __EXCEPTIONS
   try {
 #endif
     // We create a unique SDN connection object for every active connection.
-    auto sdn_connection = absl::make_unique<SdnConnection>(context, stream);
+    // Destroying it flushes its outbound queue, which happens before this
+    // method returns and the stream is closed.
+    auto sdn_connection = absl::make_unique<SdnConnection>(
+        context, stream, SdnConnection::kDefaultMaxOutboundQueueSize,
+        stream_metrics(), packet_in_options());
+    // PacketOuts are handed to the switch provider from a separate thread, so
+    // the stream keeps reading while the provider sends them.
+    auto packet_out_dispatcher =
+        CreatePacketOutDispatcher(sdn_connection.get());
+
+    if (first_request != nullptr) {
+      auto status = HandleStreamMessage(
+          sdn_connection.get(), packet_out_dispatcher.get(), first_request);
+      if (!status.ok()) {
+        Disconnect(sdn_connection.get(), packet_out_dispatcher.get());
+        return status;
+      }
+    }
 
     // While the connection is active we can receive and send requests.
     p4::v1::StreamMessageRequest request;
     while (stream->Read(&request)) {
-
-      switch (request.update_case()) {
-        case p4::v1::StreamMessageRequest::kArbitration: {
-          LOG(INFO) << "Received arbitration request: "
-                    << request.ShortDebugString();
-
-          auto status = controller_manager_->HandleArbitrationUpdate(
-              request.arbitration(), sdn_connection.get());
-          if (!status.ok()) {
-            LOG(WARNING) << "Failed arbitration request: "
-                         << status.error_message();
-            controller_manager_->Disconnect(sdn_connection.get());
-            return status;
-          }
-          break;
-        }
-        case p4::v1::StreamMessageRequest::kPacket: {
-          // Returns with an error if the write request was not received from a
-          // primary connection
-          bool is_primary = controller_manager_
-                                ->AllowRequest(sdn_connection->GetRoleName(),
-                                               sdn_connection->GetElectionId())
-                                .ok();
-          if (!is_primary) {
-            sdn_connection->SendStreamMessageResponse(GenerateErrorResponse(
-                gutil::PermissionDeniedErrorBuilder()
-                    << "Cannot process request. Only the primary connection "
-                       "can send PacketOuts.",
-                request.packet()));
-          } else {
-              auto status = switch_provider_->SendPacketOut(request.packet());
-              if (!status.ok()) {
-                // Get the primary streamchannel and write into the stream.
-                controller_manager_->SendStreamMessageToPrimary(
-                    sdn_connection->GetRoleName(),
-                    GenerateErrorResponse(gutil::StatusBuilder(status)
-                                              << "Failed to send packet out.",
-                                          request.packet()));
-              }
-            }
-            break;
-        }
-        case p4::v1::StreamMessageRequest::kDigestAck:
-        case p4::v1::StreamMessageRequest::kOther:
-        default:
-          sdn_connection->SendStreamMessageResponse(
-                GenerateErrorResponse(gutil::UnimplementedErrorBuilder()
-                                      << "Stream update type is not supported."));
-          LOG(ERROR) << "Received unhandled stream channel message: "
-                       << request.DebugString();
+      auto status = HandleStreamMessage(sdn_connection.get(),
+                                        packet_out_dispatcher.get(), &request);
+      if (!status.ok()) {
+        Disconnect(sdn_connection.get(), packet_out_dispatcher.get());
+        return status;
       }
     }//while
-    controller_manager_->Disconnect(sdn_connection.get());
+    Disconnect(sdn_connection.get(), packet_out_dispatcher.get());
     return grpc::Status::OK;
 #ifdef __EXCEPTIONS
   } catch (const std::exception& e) {
@@ -193,10 +858,189 @@ grpc::Status P4RtServer::StreamChannel(
   } catch (...) {
     LOG(FATAL) << "Unknown exception caught in " << __func__;
   }
+  return grpc::Status(grpc::StatusCode::INTERNAL, "Unhandled exception.");
 #endif
  
 }
 
+/*
+ * P4RtServer::HandleStreamMessage
+ * Processes a single StreamMessageRequest received from a controller
+ */
+grpc::Status P4RtServer::HandleStreamMessage(
+    SdnConnection* sdn_connection,
+    PacketOutDispatcher* packet_out_dispatcher,
+    p4::v1::StreamMessageRequest* request) {
+  ScopedSpan span(tracer_.get(), StreamMessageSpanName(*request));
+  switch (request->update_case()) {
+    case p4::v1::StreamMessageRequest::kArbitration: {
+      LOG(INFO) << "Received arbitration request: "
+                << request->ShortDebugString();
+
+      // PacketOuts received before the arbitration update are sent, and their
+      // errors reported, under the role they were received with.
+      packet_out_dispatcher->Flush();
+      grpc::Status status;
+      {
+        ScopedSpan arbitration_span("HandleArbitrationUpdate");
+        status = controller_manager_->HandleArbitrationUpdate(
+            request->arbitration(), sdn_connection);
+      }
+      if (!status.ok()) {
+        LOG(WARNING) << "Failed arbitration request: "
+                     << status.error_message();
+        return status;
+      }
+      break;
+    }
+    case p4::v1::StreamMessageRequest::kPacket: {
+      // Returns with an error if the write request was not received from a
+      // primary connection
+      bool is_primary;
+      {
+        ScopedSpan allow_span("AllowRequest");
+        is_primary = controller_manager_->AllowRequest(*sdn_connection).ok();
+      }
+      if (!is_primary) {
+        sdn_connection->SendStreamMessageResponse(GenerateErrorResponse(
+            gutil::PermissionDeniedErrorBuilder()
+                << "Cannot process request. Only the primary connection "
+                   "can send PacketOuts.",
+            request->packet()));
+        break;
+      }
+      switch (controller_manager_->AdmitPacketOut(*sdn_connection)) {
+        case StreamRateLimiter::PacketOutAdmission::kAdmitted:
+          packet_out_dispatcher->Enqueue(std::move(*request->mutable_packet()));
+          span.AddEvent("enqueued");
+          break;
+        case StreamRateLimiter::PacketOutAdmission::kRejected:
+          sdn_connection->SendStreamMessageResponse(GenerateErrorResponse(
+              gutil::ResourceExhaustedErrorBuilder()
+                  << "PacketOut rate limit exceeded.",
+              request->packet()));
+          break;
+        case StreamRateLimiter::PacketOutAdmission::kDropped:
+          break;
+      }
+      break;
+    }
+    case p4::v1::StreamMessageRequest::kDigestAck: {
+      absl::Status status;
+      if (controller_manager_->AllowRequest(*sdn_connection).ok()) {
+        status = digest_manager_->HandleAck(request->digest_ack());
+      } else {
+        status = gutil::PermissionDeniedErrorBuilder()
+                 << "Cannot process request. Only the primary connection "
+                    "can acknowledge digests.";
+      }
+      if (!status.ok()) {
+        sdn_connection->SendStreamMessageResponse(
+            GenerateErrorResponse(status, request->digest_ack()));
+      }
+      break;
+    }
+    case p4::v1::StreamMessageRequest::kOther:
+    default:
+      sdn_connection->SendStreamMessageResponse(
+            GenerateErrorResponse(gutil::UnimplementedErrorBuilder()
+                                  << "Stream update type is not supported."));
+      LOG(ERROR) << "Received unhandled stream channel message: "
+                   << request->DebugString();
+  }
+  return grpc::Status::OK;
+}
+
+/*
+ * P4RtServer::CreatePacketOutDispatcher
+ * Creates the PacketOut pipeline for a new StreamChannel
+ */
+std::unique_ptr<PacketOutDispatcher> P4RtServer::CreatePacketOutDispatcher(
+    SdnConnection* sdn_connection, WorkerPool* workers) {
+  auto dispatch = [this,
+                   sdn_connection](std::vector<p4::v1::PacketOut> packets) {
+    DispatchPacketOuts(sdn_connection, std::move(packets));
+  };
+  if (workers != nullptr) {
+    return absl::make_unique<PacketOutDispatcher>(std::move(dispatch),
+                                                  packet_out_options_, workers);
+  }
+  return absl::make_unique<PacketOutDispatcher>(std::move(dispatch),
+                                                packet_out_options_);
+}
+
+/*
+ * P4RtServer::DispatchPacketOuts
+ * Sends a batch of PacketOuts and reports failures per packet
+ */
+void P4RtServer::DispatchPacketOuts(SdnConnection* sdn_connection,
+                                    std::vector<p4::v1::PacketOut> packets) {
+  // A batch holding a traced PacketOut continues the trace of the message
+  // that carried it, the others are sampled on their own.
+  absl::optional<ScopedSpan> span;
+  if (ScopedSpan::CurrentContext().empty()) {
+    span.emplace(tracer_.get(), "DispatchPacketOuts");
+  } else {
+    span.emplace("DispatchPacketOuts");
+  }
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    std::vector<absl::Status> statuses;
+    std::vector<PacketOutBuffer> buffers;
+    absl::optional<AdmissionController::Ticket> ticket;
+    grpc::Status admission_status =
+        Admit(RequestType::kPacketOut, sdn_connection->GetRoleName(),
+              /*context=*/nullptr, &ticket);
+    if (!admission_status.ok()) {
+      statuses.assign(packets.size(),
+                      gutil::GrpcStatusToAbslStatus(admission_status));
+    } else if (use_packet_out_buffers_) {
+      buffers.reserve(packets.size());
+      for (auto& packet : packets) {
+        buffers.push_back(PacketOutBuffer::FromPacketOut(std::move(packet)));
+      }
+      // The copies share the payloads, and are kept for the error reports.
+      std::vector<PacketOutBuffer> sent = buffers;
+      LatencyTimer timer(request_metrics_.send_packet_outs);
+      ScopedSpan provider_span("SendPacketOutBuffers");
+      statuses = switch_provider_->SendPacketOutBuffers(std::move(sent));
+    } else {
+      LatencyTimer timer(request_metrics_.send_packet_outs);
+      ScopedSpan provider_span("SendPacketOuts");
+      statuses = switch_provider_->SendPacketOuts(packets);
+    }
+    if (statuses.size() != packets.size()) {
+      LOG(ERROR) << "SendPacketOuts returned " << statuses.size()
+                 << " statuses for " << packets.size() << " packets.";
+      statuses.resize(packets.size(),
+                      gutil::InternalErrorBuilder()
+                          << "No status returned for packet.");
+    }
+
+    std::vector<p4::v1::StreamMessageResponse> errors;
+    for (size_t i = 0; i < packets.size(); ++i) {
+      if (statuses[i].ok()) continue;
+      errors.push_back(GenerateErrorResponse(
+          gutil::StatusBuilder(statuses[i]) << "Failed to send packet out.",
+          buffers.empty() ? packets[i] : buffers[i].ToPacketOut()));
+    }
+    controller_manager_->RecordPacketOuts(*sdn_connection, packets.size(),
+                                          errors.size());
+    if (!errors.empty()) {
+      // Get the primary streamchannel and write into the stream.
+      controller_manager_->SendStreamMessagesToPrimary(
+          sdn_connection->GetRoleName(), std::move(errors));
+    }
+#ifdef __EXCEPTIONS
+  } catch (const std::exception& e) {
+    LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
+  } catch (...) {
+    LOG(FATAL) << "Unknown exception caught in " << __func__;
+  }
+#endif
+}
+
 /*
  * P4RtServer::SetForwardingPipelineConfig
  * Handles P4info.txt pushes from P4Runtime controller application
@@ -205,16 +1049,28 @@ grpc::Status P4RtServer::SetForwardingPipelineConfig(
     grpc::ServerContext* context,
     const p4::v1::SetForwardingPipelineConfigRequest* request,
     p4::v1::SetForwardingPipelineConfigResponse* response) {
+  LatencyTimer timer(request_metrics_.set_pipeline_config);
+  ScopedSpan span(tracer_.get(), "SetForwardingPipelineConfig");
 #ifdef __EXCEPTIONS
   try {
 #endif
     LOG(INFO)
         << "Received SetForwardingPipelineConfig request from election id: "
         << request->election_id().ShortDebugString();
-    auto connection_status = controller_manager_->AllowRequest(*request);
+    auto device_status = CheckDeviceId(request->device_id());
+    if (!device_status.ok()) return device_status;
+    grpc::Status connection_status;
+    {
+      ScopedSpan allow_span("AllowRequest");
+      connection_status = controller_manager_->AllowRequest(*request);
+    }
     if (!connection_status.ok()) {
       return connection_status;
     }
+    absl::optional<AdmissionController::Ticket> ticket;
+    auto admission_status = Admit(RequestType::kSetPipelineConfig,
+                                  RoleOf(*request), context, &ticket);
+    if (!admission_status.ok()) return admission_status;
 
     if (request->action() !=
             p4::v1::SetForwardingPipelineConfigRequest::RECONCILE_AND_COMMIT &&
@@ -226,7 +1082,90 @@ grpc::Status P4RtServer::SetForwardingPipelineConfig(
              "supported for "
           << "SetForwardingPipelineConfig.");
     }
-    auto status = switch_provider_->SetForwardingPipelineConfig(request->config());
+    std::shared_ptr<const P4InfoIndex> index;
+    if (request->config().has_p4info()) {
+      auto index_status = P4InfoIndex::Create(request->config().p4info());
+      if (!index_status.ok()) {
+        return gutil::AbslStatusToGrpcStatus(
+            gutil::StatusBuilder(index_status.status()) << "Invalid P4Info.");
+      }
+      index = std::move(index_status).value();
+    }
+
+    // Serialized, so the cached config is always the one the switch has.
+    absl::MutexLock l(&pipeline_config_lock_);
+    // No write is applied or recorded while the pipeline is replaced and the
+    // entity store is reset for it.
+    absl::MutexLock commit_lock(&commit_lock_);
+    span.AddEvent("locked");
+    // A reconcile against a known P4Info only reprograms what changed.
+    absl::optional<PipelineDiff> diff;
+    auto committed = pipeline_config_.Load();
+    if (request->action() ==
+            p4::v1::SetForwardingPipelineConfigRequest::RECONCILE_AND_COMMIT &&
+        committed != nullptr && committed->has_p4info() &&
+        request->config().has_p4info()) {
+      diff = PipelineDiff::Compute(*committed, request->config());
+      LOG(INFO) << "Reconciling pipeline: tables added "
+                << diff->tables.added.size() << ", removed "
+                << diff->tables.removed.size() << ", modified "
+                << diff->tables.modified.size() << ", unchanged "
+                << diff->tables.unchanged.size()
+                << (diff->device_config_changed ? ", device config changed"
+                                                : "");
+    }
+    // The provider already sees the new index while it applies the config.
+    auto previous_index = switch_provider_->GetP4InfoIndex();
+    switch_provider_->SetP4InfoIndex(index);
+    absl::Status status;
+    if (diff.has_value() && diff->empty()) {
+      // Same program, e.g. a controller reconnecting: nothing to reprogram.
+      status = absl::OkStatus();
+    } else {
+      LatencyTimer timer(request_metrics_.provider_set_pipeline_config);
+      ScopedSpan provider_span(diff.has_value()
+                                   ? "ReconcileForwardingPipelineConfig"
+                                   : "SetForwardingPipelineConfig");
+      status = diff.has_value()
+                   ? switch_provider_->ReconcileForwardingPipelineConfig(
+                         request->config(), *diff)
+                   : switch_provider_->SetForwardingPipelineConfig(
+                         request->config());
+    }
+    if (status.ok()) {
+      pipeline_config_.Store(
+          std::make_shared<p4::v1::ForwardingPipelineConfig>(
+              request->config()));
+      p4info_index_.Store(index);
+    } else {
+      switch_provider_->SetP4InfoIndex(std::move(previous_index));
+    }
+    // Counters and meters read from the old pipeline are not served for the
+    // new one.
+    if (status.ok() && counter_cache_ != nullptr &&
+        !(diff.has_value() && diff->empty())) {
+      counter_cache_->Clear();
+    }
+    // VERIFY_AND_COMMIT starts the new pipeline without any forwarding state.
+    if (status.ok() &&
+        request->action() ==
+            p4::v1::SetForwardingPipelineConfigRequest::VERIFY_AND_COMMIT) {
+      if (entity_store_ != nullptr) entity_store_->Clear();
+      digest_manager_->Clear();
+    }
+    // A reconcile keeps the entries of unchanged tables and the
+    // configuration of unchanged digests.
+    if (status.ok() && diff.has_value()) {
+      if (entity_store_ != nullptr) {
+        absl::flat_hash_set<uint32_t> table_ids(diff->tables.removed.begin(),
+                                                diff->tables.removed.end());
+        table_ids.insert(diff->tables.modified.begin(),
+                         diff->tables.modified.end());
+        entity_store_->EraseTables(table_ids);
+      }
+      digest_manager_->Erase(diff->digests.removed);
+      digest_manager_->Erase(diff->digests.modified);
+    }
     return gutil::AbslStatusToGrpcStatus(status);
 
 #ifdef __EXCEPTIONS
@@ -235,6 +1174,7 @@ grpc::Status P4RtServer::SetForwardingPipelineConfig(
   } catch (...) {
     LOG(FATAL) << "Unknown exception caught in " << __func__;
   }
+  return grpc::Status(grpc::StatusCode::INTERNAL, "Unhandled exception.");
 #endif
   
 }
@@ -247,21 +1187,39 @@ grpc::Status P4RtServer::GetForwardingPipelineConfig(
     grpc::ServerContext* context,
     const p4::v1::GetForwardingPipelineConfigRequest* request,
     p4::v1::GetForwardingPipelineConfigResponse* response) {
+  LatencyTimer timer(request_metrics_.get_pipeline_config);
+  ScopedSpan span(tracer_.get(), "GetForwardingPipelineConfig");
 #ifdef __EXCEPTIONS
   try {
 #endif
-    auto response_status = switch_provider_->GetForwardingPipelineConfig();
-    if(response_status.ok()) {
-      auto p4info = response_status.value();
-      switch (request->response_type())
-      {
-      case p4::v1::GetForwardingPipelineConfigRequest::COOKIE_ONLY:
-        *response->mutable_config()->mutable_cookie() = p4info.cookie();
-        break;
-      default:
-        *response->mutable_config() = p4info  ;
-        break;
-      }
+    auto device_status = CheckDeviceId(request->device_id());
+    if (!device_status.ok()) return device_status;
+    absl::optional<AdmissionController::Ticket> ticket;
+    auto admission_status = Admit(RequestType::kGetPipelineConfig,
+                                  absl::nullopt, context, &ticket);
+    if (!admission_status.ok()) return admission_status;
+    auto config_status = GetPipelineConfig();
+    if (!config_status.ok()) {
+      return gutil::AbslStatusToGrpcStatus(config_status.status());
+    }
+    const p4::v1::ForwardingPipelineConfig& config = **config_status;
+    auto* response_config = response->mutable_config();
+    switch (request->response_type())
+    {
+    case p4::v1::GetForwardingPipelineConfigRequest::COOKIE_ONLY:
+      *response_config->mutable_cookie() = config.cookie();
+      break;
+    case p4::v1::GetForwardingPipelineConfigRequest::P4INFO_AND_COOKIE:
+      *response_config->mutable_p4info() = config.p4info();
+      *response_config->mutable_cookie() = config.cookie();
+      break;
+    case p4::v1::GetForwardingPipelineConfigRequest::DEVICE_CONFIG_AND_COOKIE:
+      response_config->set_p4_device_config(config.p4_device_config());
+      *response_config->mutable_cookie() = config.cookie();
+      break;
+    default:
+      *response_config = config;
+      break;
     }
     return grpc::Status(grpc::StatusCode::OK, "");
 #ifdef __EXCEPTIONS
@@ -270,6 +1228,7 @@ grpc::Status P4RtServer::GetForwardingPipelineConfig(
   } catch (...) {
     LOG(FATAL) << "Unknown exception caught in " << __func__;
   }
+  return grpc::Status(grpc::StatusCode::INTERNAL, "Unhandled exception.");
 #endif
 }
 
@@ -9,11 +9,28 @@
 #define P4RT_SERVER_H_
 
 #include "switch_provider_base.h"
+#include "admission_controller.h"
+#include "counter_cache.h"
+#include "digest_manager.h"
+#include "entity_store.h"
+#include "metrics.h"
+#include "p4info_index.h"
 #include "sdn_controller_manager.h"
+#include "packet_out_dispatcher.h"
+#include "rcu_ptr.h"
+#include "server_snapshot.h"
+#include "tracing.h"
+#include "write_executor.h"
+#include "write_group_committer.h"
 
+#include <functional>
 #include <memory>
 #include <thread>
+#include <vector>
 
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
 #include "grpcpp/grpcpp.h"
 #include "grpcpp/server_context.h"
 #include "p4/v1/p4runtime.grpc.pb.h"
@@ -22,11 +39,79 @@ namespace p4rt_server{
   class P4RtServer final : public p4::v1::P4Runtime::Service{
     private:
       std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider_;
+      // Only requests for this device are served, if set.
+      const absl::optional<uint64_t> device_id_;
+      std::shared_ptr<MetricsRegistry> metrics_;
+      // Only set if the switch provider wants requests traced.
+      std::unique_ptr<Tracer> tracer_;
       std::shared_ptr<SdnControllerManager> controller_manager_;
-      
+      // Only set if the switch provider handles writes one update at a time.
+      std::unique_ptr<WriteExecutor> write_executor_;
+      // Only set if the switch provider wants reads served from memory.
+      std::unique_ptr<EntityStore> entity_store_;
+      // Only set if the switch provider wants counters and meters polled in
+      // the background. Declared after switch_provider_, so the poller stops
+      // before the provider is destroyed.
+      std::unique_ptr<CounterCache> counter_cache_;
+      // Batches the digests reported by the switch provider.
+      std::shared_ptr<DigestManager> digest_manager_;
+      // PacketIn queue of every SdnConnection, from the switch provider.
+      PacketInQueue::Options packet_in_options_;
+      PacketOutDispatcher::Options packet_out_options_;
+      // Check batches with a WriteBatchChecker before DoWrite.
+      bool pre_validate_writes_ = false;
+      // Hand PacketOuts to the switch provider with SendPacketOutBuffers.
+      bool use_packet_out_buffers_ = false;
+      // Only set if the switch provider wants concurrent writes committed
+      // in groups.
+      std::unique_ptr<WriteGroupCommitter> group_committer_;
+      // Only set if the switch provider bounds the requests that run at once.
+      std::unique_ptr<AdmissionController> admission_controller_;
+
+      // The last committed pipeline config, shared with every
+      // GetForwardingPipelineConfig instead of copied from the provider.
+      // Writers hold pipeline_config_lock_; readers never wait for them.
+      absl::Mutex pipeline_config_lock_;
+      RcuPtr<p4::v1::ForwardingPipelineConfig> pipeline_config_;
+      // Index of the committed P4Info, used to validate requests before they
+      // reach the switch provider. nullptr while no P4Info is known. Accessed
+      // the same way as pipeline_config_.
+      RcuPtr<P4InfoIndex> p4info_index_;
+      // Held shared while writes are applied through the switch provider and
+      // recorded, and exclusively by TakeSnapshot, so a snapshot never misses
+      // a write the switch applied but the entity store did not record yet,
+      // and by SetForwardingPipelineConfig, so no write lands in the entity
+      // store between the new pipeline and the reset of the store. Taken
+      // after pipeline_config_lock_.
+      absl::Mutex commit_lock_;
+
+      // Latency of every RPC, and of the switch provider calls made for it.
+      struct RequestMetrics {
+        Histogram* write;
+        Histogram* read;
+        Histogram* set_pipeline_config;
+        Histogram* get_pipeline_config;
+        Histogram* do_write;
+        Histogram* do_write_update;
+        Histogram* do_read;
+        Histogram* do_query_read;
+        Histogram* send_packet_outs;
+        Histogram* provider_set_pipeline_config;
+        Histogram* provider_get_pipeline_config;
+        // PacketOuts queued on all StreamChannels.
+        Gauge* packet_out_queue_depth;
+      };
+      RequestMetrics request_metrics_;
+
+      // Only set if the switch provider wants warm restarts. Declared last,
+      // so the final snapshot is written while the state is still there.
+      std::unique_ptr<SnapshotWriter> snapshot_writer_;
 
     public:
-      P4RtServer(std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider);
+      // With a device_id, requests and arbitration updates for any other
+      // device are rejected. Otherwise every device ID is accepted.
+      P4RtServer(std::unique_ptr<switch_provider::SwitchProviderBase> switch_provider,
+                 absl::optional<uint64_t> device_id = absl::nullopt);
       ~P4RtServer() = default;
       
       grpc::Status Write(grpc::ServerContext* context,
@@ -41,6 +126,13 @@ namespace p4rt_server{
             grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
             p4::v1::StreamMessageRequest>* stream); 
 
+      // StreamChannel for a stream whose first request was already read,
+      // e.g. by a MultiDeviceP4RtServer to find the device.
+      grpc::Status ServeStreamChannel(grpc::ServerContext* context,
+            grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
+            p4::v1::StreamMessageRequest>* stream,
+            p4::v1::StreamMessageRequest* first_request);
+
       grpc::Status SetForwardingPipelineConfig(grpc::ServerContext* context,
             const p4::v1::SetForwardingPipelineConfigRequest* request,
             p4::v1::SetForwardingPipelineConfigResponse* response);
@@ -50,8 +142,125 @@ namespace p4rt_server{
           p4::v1::GetForwardingPipelineConfigResponse* response);
       bool SendPacketIn(const absl::optional<std::string>& role_name,
                         const p4::v1::StreamMessageResponse& response){
+        if (response.has_packet()) {
+          std::vector<OutboundResponse> packets;
+          packets.emplace_back(response);
+          return controller_manager_->SendPacketInsToPrimary(
+              role_name, std::move(packets), {}).queued == 1;
+        }
         return controller_manager_->SendStreamMessageToPrimary(role_name, response);
       }
+
+      // Every metric of the server: RPC and provider call latencies, per role
+      // stream and arbitration counters, and queue depths. Scrape it with
+      // MetricsRegistry::ExportText.
+      std::shared_ptr<MetricsRegistry> metrics() const { return metrics_; }
+
+      // Writes the warm restart snapshot now, e.g. before a planned restart.
+      absl::Status SaveSnapshot();
+
+      // Metrics to hand to every SdnConnection of the server.
+      const StreamMetrics& stream_metrics() const {
+        return controller_manager_->stream_metrics();
+      }
+
+      // PacketIn queue options to hand to every SdnConnection of the server.
+      const PacketInQueue::Options& packet_in_options() const {
+        return packet_in_options_;
+      }
+
+      /*
+       * Transport independent request handling. The synchronous RPCs above
+       * are thin wrappers around these, and the AsyncP4RtServer drives them
+       * from its completion queue threads.
+       */
+
+      // Serves a ReadRequest. Every ReadResponse is handed to write_response,
+      // which returns false if the response could not be sent. Clients that
+      // send the "p4rt-counter-cache: bypass" metadata read counters and
+      // meters from the switch instead of the counter cache.
+      grpc::Status HandleRead(const grpc::ServerContext* context,
+          const p4::v1::ReadRequest* request,
+          const std::function<bool(const p4::v1::ReadResponse&)>&
+              write_response);
+
+      // Creates the dispatcher that hands the PacketOuts received on a
+      // StreamChannel to the switch provider, on the workers if set and on a
+      // thread of its own otherwise. Must be destroyed before the connection.
+      std::unique_ptr<PacketOutDispatcher> CreatePacketOutDispatcher(
+          SdnConnection* sdn_connection, WorkerPool* workers = nullptr);
+
+      // Handles one message received on a StreamChannel. PacketOuts are moved
+      // out of the request and queued on the stream's dispatcher. A non-OK
+      // status means the stream must be closed with that status.
+      grpc::Status HandleStreamMessage(SdnConnection* sdn_connection,
+          PacketOutDispatcher* packet_out_dispatcher,
+          p4::v1::StreamMessageRequest* request);
+
+      // Must be called once a StreamChannel is closed. PacketOuts still queued
+      // on the dispatcher are sent first.
+      void Disconnect(SdnConnection* sdn_connection,
+                      PacketOutDispatcher* packet_out_dispatcher){
+        packet_out_dispatcher->Flush();
+        controller_manager_->Disconnect(sdn_connection);
+      }
+
+    private:
+      // Caches the pipeline config of the switch provider and indexes its
+      // P4Info. Called once, when no snapshot restored a pipeline.
+      void LoadPipelineConfig() ABSL_LOCKS_EXCLUDED(pipeline_config_lock_);
+
+      // Returns the cached pipeline config, reading it from the switch
+      // provider if nothing was committed yet.
+      absl::StatusOr<std::shared_ptr<const p4::v1::ForwardingPipelineConfig>>
+      GetPipelineConfig() ABSL_LOCKS_EXCLUDED(pipeline_config_lock_);
+
+      // Reads entities from the switch provider rather than from memory.
+      // index is the P4Info the request was validated with, if any.
+      absl::Status ReadFromSwitch(const p4::v1::ReadRequest& request,
+          const P4InfoIndex* index,
+          const absl::optional<std::string>& role,
+          const std::function<bool(p4::v1::Entity)>& write_entity);
+
+      // Records an update the switch provider applied.
+      void RecordUpdate(const p4::v1::Update& update,
+                        const absl::optional<std::string>& role);
+
+      grpc::Status CheckDeviceId(uint64_t device_id) const;
+
+      // Waits until the admission controller, if any, lets the request run.
+      // The ticket holds its slot.
+      grpc::Status Admit(RequestType type,
+                         const absl::optional<std::string>& role,
+                         const grpc::ServerContext* context,
+                         absl::optional<AdmissionController::Ticket>* ticket);
+
+      // Applies a group of WriteRequests through the switch provider and
+      // records the updates of those that succeeded, in order.
+      std::vector<absl::Status> CommitWrites(
+          absl::Span<const p4::v1::WriteRequest* const> requests);
+
+      // Executes a CONTINUE_ON_ERROR request update by update. Returns one
+      // status per update.
+      std::vector<absl::Status> ExecuteUpdates(
+          const p4::v1::WriteRequest& request, const P4InfoIndex* index,
+          const absl::optional<std::string>& role);
+
+      // The state persisted for warm restarts.
+      ServerSnapshot TakeSnapshot();
+
+      // Reloads the state of a warm restart snapshot, if there is one.
+      void RestoreSnapshot(const std::string& snapshot_path);
+
+      // Reloads the tables written by a failed request into the entity store,
+      // holding commit_lock_ exclusively.
+      void ResyncEntityStore(const p4::v1::WriteRequest& request)
+          ABSL_LOCKS_EXCLUDED(commit_lock_);
+
+      // Sends a batch of PacketOuts through the switch provider and reports
+      // every failed packet to the primary connection of the sender's role.
+      void DispatchPacketOuts(SdnConnection* sdn_connection,
+                              std::vector<p4::v1::PacketOut> packets);
     };
 
 }
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "packet_in_queue.h"
+
+#include <iterator>
+
+namespace p4rt_server{
+
+PacketInResult PacketInQueue::Push(
+    std::vector<OutboundResponse> responses,
+    absl::Span<const int> priorities) {
+  PacketInResult result;
+  for (size_t i = 0; i < responses.size(); ++i) {
+    int priority = priorities.empty() ? 0 : priorities[i];
+    if (size_ >= options_.capacity) {
+      if (by_priority_.empty()) {
+        // A capacity of 0 buffers nothing.
+        ++result.overflow;
+        continue;
+      }
+      auto lowest = std::prev(by_priority_.end());
+      bool keep_buffered =
+          lowest->first > priority ||
+          (lowest->first == priority &&
+           options_.overflow_policy == OverflowPolicy::kDropNewest);
+      if (keep_buffered) {
+        ++result.overflow;
+        continue;
+      }
+      if (options_.overflow_policy == OverflowPolicy::kDropOldest) {
+        lowest->second.pop_front();
+      } else {
+        lowest->second.pop_back();
+      }
+      if (lowest->second.empty()) by_priority_.erase(lowest);
+      --size_;
+      ++result.evicted;
+    }
+    by_priority_[priority].push_back(std::move(responses[i]));
+    ++size_;
+    ++result.queued;
+  }
+  return result;
+}
+
+int PacketInQueue::Pop(int max_count, std::deque<OutboundResponse>* out) {
+  int popped = 0;
+  while (popped < max_count && !by_priority_.empty()) {
+    auto highest = by_priority_.begin();
+    while (popped < max_count && !highest->second.empty()) {
+      out->push_back(std::move(highest->second.front()));
+      highest->second.pop_front();
+      ++popped;
+    }
+    if (highest->second.empty()) by_priority_.erase(highest);
+  }
+  size_ -= popped;
+  return popped;
+}
+
+int PacketInQueue::Clear() {
+  int dropped = size_;
+  by_priority_.clear();
+  size_ = 0;
+  return dropped;
+}
+
+}//namespace p4rt_server
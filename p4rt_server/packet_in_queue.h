@@ -0,0 +1,93 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _PACKET_IN_QUEUE_H_
+#define _PACKET_IN_QUEUE_H_
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "outbound_response.h"
+
+#include "absl/types/span.h"
+
+namespace p4rt_server{
+
+// Outcome of handing a batch of PacketIns to p4rt_server. Sending never blocks
+// on the controller; packets that cannot be buffered are dropped right away.
+struct PacketInResult {
+  // Accepted into the PacketIn buffer of the primary connection.
+  int queued = 0;
+  // Dropped because the role has no primary connection.
+  int no_primary = 0;
+  // Dropped because they exceeded the PacketIn rate limits of the role.
+  int rate_limited = 0;
+  // Dropped because the buffer was full of packets the overflow policy keeps.
+  int overflow = 0;
+  // Packets buffered earlier that were dropped to make room for these.
+  int evicted = 0;
+};
+
+// Bounded buffer for the PacketIns waiting to be written to one controller.
+//
+// Every packet has a priority (see SwitchProviderBase::PacketInPriority).
+// Packets are written highest priority first, and in order within a
+// priority. Once the buffer is full a new packet may only displace a packet of
+// the lowest buffered priority:
+//  * A lower priority packet is always displaced, so e.g. an ARP flood cannot
+//    hold back LACP or BGP packets.
+//  * Between packets of the same priority the overflow policy decides: with
+//    kDropNewest the new packet is dropped, with kDropOldest the oldest
+//    buffered packet of that priority is.
+//  * A packet with a priority below everything buffered is dropped.
+// With the default priority of 0 for every packet this is a plain bounded
+// FIFO with the chosen overflow policy.
+//
+// Not thread-safe; connections guard it with their outbound lock.
+class PacketInQueue {
+ public:
+  enum class OverflowPolicy { kDropNewest, kDropOldest };
+
+  struct Options {
+    // Maximum number of buffered PacketIns per connection.
+    int capacity = 1024;
+    OverflowPolicy overflow_policy = OverflowPolicy::kDropNewest;
+  };
+
+  explicit PacketInQueue(const Options& options) : options_(options) {}
+
+  PacketInQueue(const PacketInQueue&) = delete;
+  PacketInQueue& operator=(const PacketInQueue&) = delete;
+
+  // Buffers the responses, which carry PacketIns. priorities[i] is the
+  // priority of responses[i]; an empty span means priority 0 for all.
+  // no_primary and rate_limited are never set in the result.
+  PacketInResult Push(std::vector<OutboundResponse> responses,
+                      absl::Span<const int> priorities);
+
+  // Moves up to max_count packets, highest priority first, to the back of
+  // out. Returns how many were moved.
+  int Pop(int max_count, std::deque<OutboundResponse>* out);
+
+  // Drops every buffered packet. Returns how many were dropped.
+  int Clear();
+
+  bool empty() const { return size_ == 0; }
+  int size() const { return size_; }
+
+ private:
+  const Options options_;
+  // Buffered packets by priority, highest priority first. Only priorities
+  // with buffered packets are present.
+  std::map<int, std::deque<OutboundResponse>, std::greater<int>> by_priority_;
+  int size_ = 0;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _PACKET_IN_QUEUE_H_
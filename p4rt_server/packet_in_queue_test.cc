@@ -0,0 +1,123 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "packet_in_queue.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+// Responses carrying one PacketIn per payload.
+std::vector<OutboundResponse> PacketIns(
+    const std::vector<std::string>& payloads) {
+  std::vector<OutboundResponse> responses;
+  for (const std::string& payload : payloads) {
+    p4::v1::StreamMessageResponse response;
+    response.mutable_packet()->set_payload(payload);
+    responses.emplace_back(std::move(response));
+  }
+  return responses;
+}
+
+// Pops every queued packet and returns their payloads, in order.
+std::string PopAll(PacketInQueue* queue) {
+  std::deque<OutboundResponse> popped;
+  queue->Pop(100, &popped);
+  std::string payloads;
+  for (const OutboundResponse& response : popped) {
+    payloads += response.response().packet().payload();
+  }
+  return payloads;
+}
+
+TEST(PacketInQueueTest, DropNewestKeepsTheOldestPackets) {
+  PacketInQueue queue({3, PacketInQueue::OverflowPolicy::kDropNewest});
+  PacketInResult result = queue.Push(PacketIns({"a", "b", "c", "d"}), {});
+  EXPECT_EQ(result.queued, 3);
+  EXPECT_EQ(result.overflow, 1);
+  EXPECT_EQ(result.evicted, 0);
+  EXPECT_EQ(PopAll(&queue), "abc");
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(PacketInQueueTest, DropOldestEvictsTheOldestPackets) {
+  PacketInQueue queue({3, PacketInQueue::OverflowPolicy::kDropOldest});
+  PacketInResult result =
+      queue.Push(PacketIns({"a", "b", "c", "d", "e"}), {});
+  EXPECT_EQ(result.queued, 5);
+  EXPECT_EQ(result.evicted, 2);
+  EXPECT_EQ(PopAll(&queue), "cde");
+}
+
+TEST(PacketInQueueTest, HigherPriorityPacketsEvictLowerPriorityOnes) {
+  PacketInQueue queue({3, PacketInQueue::OverflowPolicy::kDropNewest});
+  std::vector<int> priorities = {0, 0, 0, 5, 5, -1};
+  PacketInResult result =
+      queue.Push(PacketIns({"a", "b", "c", "X", "Y", "z"}), priorities);
+  EXPECT_EQ(result.queued, 5);
+  EXPECT_EQ(result.evicted, 2);
+  EXPECT_EQ(result.overflow, 1);
+  // Higher priorities are popped first, in arrival order within a priority.
+  EXPECT_EQ(PopAll(&queue), "XYa");
+}
+
+TEST(PacketInQueueTest, DropOldestEvictsTheLowestPriorityFirst) {
+  PacketInQueue queue({2, PacketInQueue::OverflowPolicy::kDropOldest});
+  queue.Push(PacketIns({"a", "b", "c"}), {1, 0, 1});
+  EXPECT_EQ(queue.size(), 2);
+  EXPECT_EQ(PopAll(&queue), "ac");
+}
+
+TEST(PacketInQueueTest, ZeroCapacityDropsEveryPacket) {
+  PacketInQueue queue({0, PacketInQueue::OverflowPolicy::kDropOldest});
+  PacketInResult result = queue.Push(PacketIns({"a"}), {});
+  EXPECT_EQ(result.overflow, 1);
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(PacketInQueueTest, ClearReturnsTheDroppedCount) {
+  PacketInQueue queue({10, PacketInQueue::OverflowPolicy::kDropOldest});
+  queue.Push(PacketIns({"a", "b"}), {});
+  EXPECT_EQ(queue.Clear(), 2);
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(PacketInQueueTest, ArenaResponsesOutliveTheRestOfTheirBatch) {
+  std::vector<p4::v1::PacketIn> packets(3);
+  for (size_t i = 0; i < packets.size(); ++i) {
+    packets[i].set_payload(std::string(100, 'a' + i));
+    packets[i].add_metadata()->set_metadata_id(1);
+  }
+  PacketInQueue queue({2, PacketInQueue::OverflowPolicy::kDropOldest});
+  queue.Push(PacketInResponses(std::move(packets)), {});
+  // The evicted packet and the popped one release their share of the arena.
+  std::deque<OutboundResponse> popped;
+  queue.Pop(1, &popped);
+  popped.clear();
+  EXPECT_EQ(PopAll(&queue), std::string(100, 'c'));
+}
+
+TEST(PacketInQueueTest, SharedArenaResponsesKeepTheirContent) {
+  std::vector<p4::v1::PacketIn> packets(2);
+  packets[0].set_payload("a");
+  packets[1].set_payload("b");
+  std::vector<OutboundResponse> responses =
+      PacketInResponses(std::move(packets));
+  std::shared_ptr<const SharedStreamResponse> shared =
+      std::move(responses[1]).Share();
+  responses.clear();
+  EXPECT_EQ(shared->response().packet().payload(), "b");
+}
+
+}  // namespace
+}  // namespace p4rt_server
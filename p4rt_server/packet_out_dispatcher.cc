@@ -0,0 +1,178 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "packet_out_dispatcher.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace p4rt_server{
+
+PacketOutBuffer PacketOutBuffer::FromPacketOut(p4::v1::PacketOut packet) {
+  PacketOutBuffer buffer;
+  buffer.payload = absl::Cord(std::move(*packet.mutable_payload()));
+  buffer.metadata.Swap(packet.mutable_metadata());
+  return buffer;
+}
+
+p4::v1::PacketOut PacketOutBuffer::ToPacketOut() const {
+  p4::v1::PacketOut packet;
+  packet.set_payload(std::string(payload));
+  *packet.mutable_metadata() = metadata;
+  return packet;
+}
+
+PacketOutDispatcher::PacketOutDispatcher(DispatchCallback dispatch,
+                                         const Options& options)
+    : dispatch_(std::move(dispatch)), options_(options), workers_(nullptr) {
+  dispatcher_ = std::thread([this]() { DispatchPackets(); });
+}
+
+PacketOutDispatcher::PacketOutDispatcher(DispatchCallback dispatch,
+                                         const Options& options,
+                                         WorkerPool* workers)
+    : dispatch_(std::move(dispatch)), options_(options), workers_(workers) {}
+
+PacketOutDispatcher::~PacketOutDispatcher() {
+  {
+    absl::MutexLock l(&lock_);
+    closed_ = true;
+    // Whatever is queued is already scheduled on a worker.
+    auto drained = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return !draining_;
+    };
+    lock_.Await(absl::Condition(&drained));
+  }
+  if (dispatcher_.joinable()) dispatcher_.join();
+}
+
+void PacketOutDispatcher::Enqueue(p4::v1::PacketOut packet) {
+  auto has_room = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return static_cast<int>(pending_.size()) < options_.max_pending_packets;
+  };
+  SpanContext span_context = ScopedSpan::CurrentContext();
+  absl::MutexLock l(&lock_);
+  lock_.Await(absl::Condition(&has_room));
+  pending_.push_back({std::move(packet), std::move(span_context)});
+  if (options_.queue_depth != nullptr) options_.queue_depth->Add(1);
+  ScheduleDrain();
+}
+
+void PacketOutDispatcher::Flush() {
+  auto is_idle = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return pending_.empty() && !dispatching_;
+  };
+  absl::MutexLock l(&lock_);
+  ++flush_waiters_;
+  lock_.Await(absl::Condition(&is_idle));
+  --flush_waiters_;
+}
+
+bool PacketOutDispatcher::NotifyWhenRoom(std::function<void()> done) {
+  absl::MutexLock l(&lock_);
+  if (static_cast<int>(pending_.size()) < options_.max_pending_packets) {
+    return true;
+  }
+  room_callbacks_.push_back(std::move(done));
+  return false;
+}
+
+bool PacketOutDispatcher::NotifyWhenFlushed(std::function<void()> done) {
+  absl::MutexLock l(&lock_);
+  if (pending_.empty() && !dispatching_) return true;
+  flush_callbacks_.push_back(std::move(done));
+  return false;
+}
+
+void PacketOutDispatcher::ScheduleDrain() {
+  if (workers_ == nullptr || draining_) return;
+  draining_ = true;
+  workers_->Schedule([this]() { DrainPackets(); });
+}
+
+void PacketOutDispatcher::DispatchPackets() {
+  auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return closed_ || !pending_.empty() || !flush_callbacks_.empty();
+  };
+  while (true) {
+    {
+      absl::MutexLock l(&lock_);
+      lock_.Await(absl::Condition(&has_work));
+      // On close we still dispatch whatever was queued before returning.
+      if (closed_ && pending_.empty() && flush_callbacks_.empty()) return;
+    }
+    DispatchBatch();
+  }
+}
+
+void PacketOutDispatcher::DrainPackets() {
+  while (true) {
+    if (DispatchBatch()) continue;
+    // A flush callback may have let the reader queue more packets.
+    absl::MutexLock l(&lock_);
+    if (pending_.empty() && flush_callbacks_.empty()) {
+      draining_ = false;
+      return;
+    }
+  }
+}
+
+bool PacketOutDispatcher::DispatchBatch() {
+  auto has_full_batch = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return closed_ || flush_waiters_ > 0 || !flush_callbacks_.empty() ||
+           static_cast<int>(pending_.size()) >= options_.max_batch_size;
+  };
+
+  std::vector<p4::v1::PacketOut> batch;
+  SpanContext span_context;
+  std::vector<std::function<void()>> callbacks;
+  {
+    absl::MutexLock l(&lock_);
+    if (pending_.empty()) {
+      callbacks.swap(flush_callbacks_);
+    } else {
+      if (options_.max_batch_delay > absl::ZeroDuration()) {
+        lock_.AwaitWithTimeout(absl::Condition(&has_full_batch),
+                               options_.max_batch_delay);
+      }
+
+      int batch_size = std::min<int>(pending_.size(), options_.max_batch_size);
+      batch.reserve(batch_size);
+      for (int i = 0; i < batch_size; ++i) {
+        PendingPacket& pending = pending_.front();
+        batch.push_back(std::move(pending.packet));
+        if (span_context.empty()) {
+          span_context = std::move(pending.span_context);
+        }
+        pending_.pop_front();
+      }
+      if (options_.queue_depth != nullptr) {
+        options_.queue_depth->Add(-batch_size);
+      }
+      if (static_cast<int>(pending_.size()) < options_.max_pending_packets) {
+        callbacks.swap(room_callbacks_);
+      }
+      dispatching_ = true;
+    }
+  }
+  // Resumed readers queue the next packets while this batch is dispatched.
+  for (auto& callback : callbacks) callback();
+  if (batch.empty()) return false;
+
+  // The lock is not held while dispatching, so the stream reader can keep
+  // queueing packets while the provider works on this batch.
+  {
+    ScopedSpanContext scoped_context(std::move(span_context));
+    dispatch_(std::move(batch));
+  }
+
+  absl::MutexLock l(&lock_);
+  dispatching_ = false;
+  return true;
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _PACKET_OUT_DISPATCHER_H_
+#define _PACKET_OUT_DISPATCHER_H_
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "tracing.h"
+#include "worker_pool.h"
+
+#include "absl/strings/cord.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// A PacketOut handed to the switch provider by ownership. The payload is a
+// reference counted buffer moved out of the StreamChannel message: the
+// provider may keep copies of the Cord past SendPacketOutBuffers, e.g. on its
+// TX ring, and the memory is released once the last copy is dropped.
+struct PacketOutBuffer {
+  // Takes the payload and metadata of the packet without copying them.
+  static PacketOutBuffer FromPacketOut(p4::v1::PacketOut packet);
+  // Copies the packet back, e.g. to report an error for it.
+  p4::v1::PacketOut ToPacketOut() const;
+
+  // A single chunk unless the payload is tiny; absl::Cord::TryFlat returns
+  // it without a copy.
+  absl::Cord payload;
+  google::protobuf::RepeatedPtrField<p4::v1::PacketMetadata> metadata;
+};
+
+// Decouples reading PacketOuts from a StreamChannel from handing them to the
+// switch provider.
+//
+// The stream reader queues PacketOuts and goes back to reading. The queued
+// packets are taken in batches of up to max_batch_size, waiting at most
+// max_batch_delay for a batch to fill, and every batch is passed to the
+// dispatch callback, either on a thread of the dispatcher's own or on a shared
+// WorkerPool. Packets are dispatched in the order they were queued, and the
+// callback runs in the span context of the first traced packet of the batch.
+class PacketOutDispatcher {
+ public:
+  struct Options {
+    // Largest batch handed to the dispatch callback.
+    int max_batch_size = 64;
+    // How long a partial batch waits for more packets before it is
+    // dispatched. Zero dispatches whatever is queued right away.
+    absl::Duration max_batch_delay = absl::Microseconds(100);
+    // Once this many packets are queued, Enqueue blocks until the dispatcher
+    // catches up, and NotifyWhenRoom tells readers that must not block to
+    // stop reading. This pushes back on the controller through gRPC flow
+    // control instead of buffering without bound.
+    int max_pending_packets = 1024;
+    // If set, tracks the number of queued packets. May be shared by several
+    // dispatchers.
+    Gauge* queue_depth = nullptr;
+  };
+
+  using DispatchCallback =
+      std::function<void(std::vector<p4::v1::PacketOut> packets)>;
+
+  // Dispatches on a thread of its own.
+  PacketOutDispatcher(DispatchCallback dispatch, const Options& options);
+  explicit PacketOutDispatcher(DispatchCallback dispatch)
+      : PacketOutDispatcher(std::move(dispatch), Options()) {}
+  // Dispatches on the workers, which must outlive the dispatcher.
+  PacketOutDispatcher(DispatchCallback dispatch, const Options& options,
+                      WorkerPool* workers);
+
+  // Dispatches any queued packets and stops dispatching.
+  ~PacketOutDispatcher();
+
+  PacketOutDispatcher(const PacketOutDispatcher&) = delete;
+  PacketOutDispatcher& operator=(const PacketOutDispatcher&) = delete;
+
+  // Queues a packet for dispatch, with the current span context of the
+  // caller. Blocks while the queue is full.
+  void Enqueue(p4::v1::PacketOut packet) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Blocks until every queued packet has been dispatched. Used as a barrier
+  // before the connection's arbitration state changes, so queued packets are
+  // handled under the state they were received with.
+  void Flush() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Non-blocking counterparts of Enqueue and Flush, for readers that must not
+  // wait, e.g. on a completion queue thread. Return true if the queue has
+  // room, or every queued packet was dispatched, right away. Otherwise return
+  // false and call done on the dispatching thread once it does; the reader
+  // queues no more packets until then.
+  bool NotifyWhenRoom(std::function<void()> done) ABSL_LOCKS_EXCLUDED(lock_);
+  bool NotifyWhenFlushed(std::function<void()> done)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  // Dispatches batches until closed, on the dispatcher's own thread.
+  void DispatchPackets() ABSL_LOCKS_EXCLUDED(lock_);
+  // Dispatches batches until the queue is empty, on a worker.
+  void DrainPackets() ABSL_LOCKS_EXCLUDED(lock_);
+  // Dispatches the next batch. Returns false, once the flush callbacks ran,
+  // if nothing is queued.
+  bool DispatchBatch() ABSL_LOCKS_EXCLUDED(lock_);
+  // Makes sure a worker drains the queue.
+  void ScheduleDrain() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  struct PendingPacket {
+    p4::v1::PacketOut packet;
+    // Where the packet was received, if that was traced.
+    SpanContext span_context;
+  };
+
+  const DispatchCallback dispatch_;
+  const Options options_;
+  WorkerPool* const workers_;
+
+  absl::Mutex lock_;
+  std::deque<PendingPacket> pending_ ABSL_GUARDED_BY(lock_);
+  // True while a batch is handed to the dispatch callback.
+  bool dispatching_ ABSL_GUARDED_BY(lock_) = false;
+  // Number of Flush calls waiting. Partial batches are not held back while a
+  // flush is pending.
+  int flush_waiters_ ABSL_GUARDED_BY(lock_) = 0;
+  std::vector<std::function<void()>> room_callbacks_ ABSL_GUARDED_BY(lock_);
+  std::vector<std::function<void()>> flush_callbacks_ ABSL_GUARDED_BY(lock_);
+  // True while DrainPackets is scheduled or running on a worker.
+  bool draining_ ABSL_GUARDED_BY(lock_) = false;
+  bool closed_ ABSL_GUARDED_BY(lock_) = false;
+
+  // Only without workers.
+  std::thread dispatcher_;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _PACKET_OUT_DISPATCHER_H_
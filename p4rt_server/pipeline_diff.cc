@@ -0,0 +1,138 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "pipeline_diff.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "google/protobuf/repeated_field.h"
+#include "google/protobuf/util/message_differencer.h"
+
+namespace p4rt_server{
+namespace {
+
+   using ::google::protobuf::RepeatedPtrField;
+   using ::google::protobuf::util::MessageDifferencer;
+
+   template <typename T>
+   PipelineDiff::EntityDiff DiffEntities(const RepeatedPtrField<T>& committed,
+                                         const RepeatedPtrField<T>& pushed) {
+     absl::flat_hash_map<uint32_t, const T*> committed_by_id;
+     committed_by_id.reserve(committed.size());
+     for (const T& entity : committed) {
+       committed_by_id[entity.preamble().id()] = &entity;
+     }
+     PipelineDiff::EntityDiff diff;
+     absl::flat_hash_set<uint32_t> pushed_ids;
+     pushed_ids.reserve(pushed.size());
+     for (const T& entity : pushed) {
+       uint32_t id = entity.preamble().id();
+       pushed_ids.insert(id);
+       auto it = committed_by_id.find(id);
+       if (it == committed_by_id.end()) {
+         diff.added.push_back(id);
+       } else if (MessageDifferencer::Equals(*it->second, entity)) {
+         diff.unchanged.push_back(id);
+       } else {
+         diff.modified.push_back(id);
+       }
+     }
+     for (const T& entity : committed) {
+       if (!pushed_ids.contains(entity.preamble().id())) {
+         diff.removed.push_back(entity.preamble().id());
+       }
+     }
+     return diff;
+   }
+
+   // Moves the unchanged tables that depend on a changed action, action
+   // profile or direct resource to the modified tables.
+   void AddDependentTables(const p4::config::v1::P4Info& pushed,
+                           PipelineDiff* diff) {
+     auto unchanged_ids = [](const PipelineDiff::EntityDiff& entity_diff) {
+       return absl::flat_hash_set<uint32_t>(entity_diff.unchanged.begin(),
+                                            entity_diff.unchanged.end());
+     };
+     absl::flat_hash_set<uint32_t> actions = unchanged_ids(diff->actions);
+     absl::flat_hash_set<uint32_t> action_profiles =
+         unchanged_ids(diff->action_profiles);
+     absl::flat_hash_set<uint32_t> direct_resources =
+         unchanged_ids(diff->direct_counters);
+     direct_resources.insert(diff->direct_meters.unchanged.begin(),
+                             diff->direct_meters.unchanged.end());
+     absl::flat_hash_set<uint32_t> tables = unchanged_ids(diff->tables);
+
+     std::vector<uint32_t> unchanged;
+     for (const auto& table : pushed.tables()) {
+       if (!tables.contains(table.preamble().id())) continue;
+       bool depends_on_change =
+           table.implementation_id() != 0 &&
+           !action_profiles.contains(table.implementation_id());
+       for (const auto& action_ref : table.action_refs()) {
+         if (!actions.contains(action_ref.id())) depends_on_change = true;
+       }
+       for (uint32_t resource_id : table.direct_resource_ids()) {
+         if (!direct_resources.contains(resource_id)) depends_on_change = true;
+       }
+       if (depends_on_change) {
+         diff->tables.modified.push_back(table.preamble().id());
+       } else {
+         unchanged.push_back(table.preamble().id());
+       }
+     }
+     diff->tables.unchanged = std::move(unchanged);
+   }
+
+}  // namespace
+
+PipelineDiff PipelineDiff::Compute(
+    const p4::v1::ForwardingPipelineConfig& committed,
+    const p4::v1::ForwardingPipelineConfig& pushed) {
+  const p4::config::v1::P4Info& before = committed.p4info();
+  const p4::config::v1::P4Info& after = pushed.p4info();
+  PipelineDiff diff;
+  diff.cookie_changed = committed.cookie().cookie() != pushed.cookie().cookie();
+  diff.device_config_changed =
+      committed.p4_device_config() != pushed.p4_device_config();
+  diff.pkg_info_changed =
+      !MessageDifferencer::Equals(before.pkg_info(), after.pkg_info());
+  diff.type_info_changed =
+      !MessageDifferencer::Equals(before.type_info(), after.type_info());
+  diff.tables = DiffEntities(before.tables(), after.tables());
+  diff.actions = DiffEntities(before.actions(), after.actions());
+  diff.action_profiles =
+      DiffEntities(before.action_profiles(), after.action_profiles());
+  diff.counters = DiffEntities(before.counters(), after.counters());
+  diff.direct_counters =
+      DiffEntities(before.direct_counters(), after.direct_counters());
+  diff.meters = DiffEntities(before.meters(), after.meters());
+  diff.direct_meters =
+      DiffEntities(before.direct_meters(), after.direct_meters());
+  diff.controller_packet_metadata = DiffEntities(
+      before.controller_packet_metadata(), after.controller_packet_metadata());
+  diff.value_sets = DiffEntities(before.value_sets(), after.value_sets());
+  diff.registers = DiffEntities(before.registers(), after.registers());
+  diff.digests = DiffEntities(before.digests(), after.digests());
+  diff.externs_changed = before.externs_size() != after.externs_size();
+  for (int i = 0; !diff.externs_changed && i < after.externs_size(); ++i) {
+    diff.externs_changed =
+        !MessageDifferencer::Equals(before.externs(i), after.externs(i));
+  }
+  AddDependentTables(after, &diff);
+  return diff;
+}
+
+bool PipelineDiff::empty() const {
+  return !device_config_changed && !pkg_info_changed && !type_info_changed &&
+         !externs_changed && !tables.changed() &&
+         !actions.changed() && !action_profiles.changed() &&
+         !counters.changed() && !direct_counters.changed() &&
+         !meters.changed() && !direct_meters.changed() &&
+         !controller_packet_metadata.changed() && !value_sets.changed() &&
+         !registers.changed() && !digests.changed();
+}
+
+}//namespace p4rt_server
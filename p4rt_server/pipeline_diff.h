@@ -0,0 +1,72 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _PIPELINE_DIFF_H_
+#define _PIPELINE_DIFF_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "p4/config/v1/p4info.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// Difference between the committed forwarding pipeline config and the one a
+// RECONCILE_AND_COMMIT pushes, passed to
+// SwitchProviderBase::ReconcileForwardingPipelineConfig.
+//
+// P4 entities are matched by ID. An entity whose P4Info definition differs is
+// modified. A table is also modified if one of its actions, its action profile
+// or one of its direct counters or meters is modified or removed, since its
+// entries may no longer be valid then. The entries of unchanged tables are
+// expected to survive the reconcile.
+struct PipelineDiff {
+  struct EntityDiff {
+    std::vector<uint32_t> added;
+    std::vector<uint32_t> removed;
+    std::vector<uint32_t> modified;
+    std::vector<uint32_t> unchanged;
+
+    bool changed() const {
+      return !added.empty() || !removed.empty() || !modified.empty();
+    }
+  };
+
+  // Diffs the P4Info and the device config of two configs.
+  static PipelineDiff Compute(
+      const p4::v1::ForwardingPipelineConfig& committed,
+      const p4::v1::ForwardingPipelineConfig& pushed);
+
+  // True if the switch does not need to be touched: at most the cookie
+  // changed.
+  bool empty() const;
+
+  bool cookie_changed = false;
+  bool device_config_changed = false;
+  // The P4Info pkg_info and type_info, compared as a whole. Providers may
+  // depend on the architecture or the P4 types, so either change is one the
+  // switch is told about.
+  bool pkg_info_changed = false;
+  bool type_info_changed = false;
+  EntityDiff tables;
+  EntityDiff actions;
+  EntityDiff action_profiles;
+  EntityDiff counters;
+  EntityDiff direct_counters;
+  EntityDiff meters;
+  EntityDiff direct_meters;
+  EntityDiff controller_packet_metadata;
+  EntityDiff value_sets;
+  EntityDiff registers;
+  EntityDiff digests;
+  // Externs are compared as a whole.
+  bool externs_changed = false;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _PIPELINE_DIFF_H_
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "pipeline_diff.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+// Tables 1 to 3, each with an action of ID 100 + table ID, and digest 7.
+p4::v1::ForwardingPipelineConfig Pipeline() {
+  p4::v1::ForwardingPipelineConfig config;
+  p4::config::v1::P4Info* p4info = config.mutable_p4info();
+  for (uint32_t id = 1; id <= 3; ++id) {
+    p4::config::v1::Table* table = p4info->add_tables();
+    table->mutable_preamble()->set_id(id);
+    table->add_action_refs()->set_id(100 + id);
+    p4info->add_actions()->mutable_preamble()->set_id(100 + id);
+  }
+  p4info->add_digests()->mutable_preamble()->set_id(7);
+  config.mutable_cookie()->set_cookie(1);
+  return config;
+}
+
+TEST(PipelineDiffTest, SamePipelineIsEmpty) {
+  PipelineDiff diff = PipelineDiff::Compute(Pipeline(), Pipeline());
+  EXPECT_TRUE(diff.empty());
+  EXPECT_FALSE(diff.cookie_changed);
+  EXPECT_THAT(diff.tables.unchanged, ElementsAre(1, 2, 3));
+}
+
+TEST(PipelineDiffTest, CookieAloneLeavesTheDiffEmpty) {
+  p4::v1::ForwardingPipelineConfig next = Pipeline();
+  next.mutable_cookie()->set_cookie(2);
+  PipelineDiff diff = PipelineDiff::Compute(Pipeline(), next);
+  EXPECT_TRUE(diff.empty());
+  EXPECT_TRUE(diff.cookie_changed);
+}
+
+TEST(PipelineDiffTest, ClassifiesTables) {
+  p4::v1::ForwardingPipelineConfig next = Pipeline();
+  // Changing action 102 changes table 2, which refers to it.
+  next.mutable_p4info()->mutable_actions(1)->mutable_preamble()->set_name("x");
+  next.mutable_p4info()->mutable_tables()->RemoveLast();
+  next.mutable_p4info()->add_tables()->mutable_preamble()->set_id(4);
+
+  PipelineDiff diff = PipelineDiff::Compute(Pipeline(), next);
+  EXPECT_FALSE(diff.empty());
+  EXPECT_THAT(diff.tables.added, ElementsAre(4));
+  EXPECT_THAT(diff.tables.removed, ElementsAre(3));
+  EXPECT_THAT(diff.tables.modified, ElementsAre(2));
+  EXPECT_THAT(diff.tables.unchanged, ElementsAre(1));
+  EXPECT_THAT(diff.actions.modified, ElementsAre(102));
+  EXPECT_THAT(diff.digests.unchanged, ElementsAre(7));
+  EXPECT_THAT(diff.digests.modified, IsEmpty());
+}
+
+TEST(PipelineDiffTest, PkgInfoAndTypeInfoChanges) {
+  p4::v1::ForwardingPipelineConfig next = Pipeline();
+  next.mutable_p4info()->mutable_pkg_info()->set_arch("v1model");
+  PipelineDiff diff = PipelineDiff::Compute(Pipeline(), next);
+  EXPECT_FALSE(diff.empty());
+  EXPECT_TRUE(diff.pkg_info_changed);
+  EXPECT_FALSE(diff.type_info_changed);
+
+  next = Pipeline();
+  (*next.mutable_p4info()->mutable_type_info()->mutable_new_types())["port_t"]
+      .mutable_translated_type()
+      ->set_uri("p4.org/psa/v1/PortId_t");
+  diff = PipelineDiff::Compute(Pipeline(), next);
+  EXPECT_FALSE(diff.empty());
+  EXPECT_TRUE(diff.type_info_changed);
+  EXPECT_FALSE(diff.pkg_info_changed);
+}
+
+TEST(PipelineDiffTest, DeviceConfigChange) {
+  p4::v1::ForwardingPipelineConfig next = Pipeline();
+  next.set_p4_device_config("bin");
+  PipelineDiff diff = PipelineDiff::Compute(Pipeline(), next);
+  EXPECT_FALSE(diff.empty());
+  EXPECT_TRUE(diff.device_config_changed);
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "absl/memory/memory.h"
+
+namespace p4rt_server{
+namespace {
+
+   // Returns the value of the PacketIn metadata, or nullptr if it is missing.
+   const std::string* FindMetadata(const p4::v1::PacketIn& packet,
+                                   uint32_t metadata_id) {
+     for (const auto& metadata : packet.metadata()) {
+       if (metadata.metadata_id() == metadata_id) return &metadata.value();
+     }
+     return nullptr;
+   }
+
+}  // namespace
+
+TokenBucket::TokenBucket(const RateLimit& limit)
+    : token_interval_ns_(std::max<int64_t>(
+          1, std::llround(1e9 / limit.packets_per_second))),
+      burst_interval_ns_(token_interval_ns_ *
+                         std::max<int64_t>(1, limit.burst)) {}
+
+int64_t TokenBucket::TryTake(int64_t n, int64_t now_ns) {
+  int64_t next_token_ns = next_token_ns_.load(std::memory_order_relaxed);
+  while (true) {
+    // Tokens are not saved up beyond a full bucket.
+    int64_t start_ns = std::max(next_token_ns, now_ns);
+    int64_t available =
+        (now_ns + burst_interval_ns_ - start_ns) / token_interval_ns_;
+    if (available <= 0) return 0;
+    int64_t taken = std::min(n, available);
+    if (next_token_ns_.compare_exchange_weak(
+            next_token_ns, start_ns + taken * token_interval_ns_,
+            std::memory_order_relaxed)) {
+      return taken;
+    }
+  }
+}
+
+StreamRateLimiter::StreamRateLimiter(const StreamRateLimits& limits)
+    : limits_(limits),
+      packet_in_(MakeBucket(limits.packet_in)),
+      packet_out_(MakeBucket(limits.packet_out)) {}
+
+int64_t StreamRateLimiter::NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::unique_ptr<TokenBucket> StreamRateLimiter::MakeBucket(
+    const RateLimit& limit) {
+  if (limit.packets_per_second <= 0) return nullptr;
+  return absl::make_unique<TokenBucket>(limit);
+}
+
+int StreamRateLimiter::AdmitPacketIns(
+    std::vector<OutboundResponse>* packets,
+    std::vector<int>* priorities) {
+  if (!limits_packet_ins() || packets->empty()) return 0;
+  int64_t now_ns = NowNs();
+  std::vector<bool> admitted(packets->size(), true);
+  if (limits_.ingress_port_metadata_id != 0 &&
+      limits_.packet_in_per_port.packets_per_second > 0) {
+    AdmitByPort(*packets, now_ns, &admitted);
+  }
+
+  if (packet_in_ != nullptr) {
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < packets->size(); ++i) {
+      if (admitted[i]) candidates.push_back(i);
+    }
+    size_t taken = packet_in_->TryTake(candidates.size(), now_ns);
+    if (taken < candidates.size()) {
+      if (!priorities->empty()) {
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [priorities](size_t a, size_t b) {
+                           return (*priorities)[a] > (*priorities)[b];
+                         });
+      }
+      for (size_t i = taken; i < candidates.size(); ++i) {
+        admitted[candidates[i]] = false;
+      }
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < packets->size(); ++i) {
+    if (!admitted[i]) continue;
+    if (kept != i) {
+      (*packets)[kept] = std::move((*packets)[i]);
+      if (!priorities->empty()) (*priorities)[kept] = (*priorities)[i];
+    }
+    ++kept;
+  }
+  int removed = packets->size() - kept;
+  packets->erase(packets->begin() + kept, packets->end());
+  if (!priorities->empty()) priorities->resize(kept);
+  return removed;
+}
+
+void StreamRateLimiter::AdmitByPort(
+    const std::vector<OutboundResponse>& packets, int64_t now_ns,
+    std::vector<bool>* admitted) {
+  absl::MutexLock l(&port_lock_);
+  for (size_t i = 0; i < packets.size(); ++i) {
+    const std::string* port =
+        FindMetadata(packets[i].response().packet(),
+                     limits_.ingress_port_metadata_id);
+    if (port == nullptr) continue;
+    auto bucket = port_buckets_.find(*port);
+    if (bucket == port_buckets_.end()) {
+      if (port_buckets_.size() >= kMaxPortBuckets) continue;
+      bucket = port_buckets_
+                   .emplace(*port, absl::make_unique<TokenBucket>(
+                                       limits_.packet_in_per_port))
+                   .first;
+    }
+    if (bucket->second->TryTake(1, now_ns) == 0) (*admitted)[i] = false;
+  }
+}
+
+StreamRateLimiter::PacketOutAdmission StreamRateLimiter::AdmitPacketOut() {
+  if (packet_out_ == nullptr || packet_out_->TryTake(1, NowNs()) == 1) {
+    return PacketOutAdmission::kAdmitted;
+  }
+  return limits_.report_rate_limited_packet_outs
+             ? PacketOutAdmission::kRejected
+             : PacketOutAdmission::kDropped;
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _RATE_LIMITER_H_
+#define _RATE_LIMITER_H_
+
+#include "outbound_response.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+struct RateLimit {
+  // Sustained rate. 0 disables the limit.
+  double packets_per_second = 0;
+  // Packets that may be sent back to back after a quiet period. At least 1.
+  int64_t burst = 1;
+};
+
+// Limits on the stream traffic of one role. See
+// SwitchProviderBase::RateLimitsForRole.
+struct StreamRateLimits {
+  // PacketIns sent to the primary connection of the role.
+  RateLimit packet_in;
+  // PacketOuts received from the primary connection of the role.
+  RateLimit packet_out;
+  // Applied to the PacketIns of every ingress port on top of packet_in, so
+  // one looping port cannot use up the limit of the role. The port is the
+  // value of the PacketIn metadata with this ID; 0 disables the sub-limits.
+  uint32_t ingress_port_metadata_id = 0;
+  RateLimit packet_in_per_port;
+  // Answer PacketOuts over the limit with a RESOURCE_EXHAUSTED StreamError
+  // instead of dropping them silently.
+  bool report_rate_limited_packet_outs = false;
+};
+
+// Token bucket that never blocks and never takes a lock.
+//
+// Implemented as a generic cell rate algorithm: a single atomic holds the
+// time at which the bucket will be full again, and taking tokens moves it
+// forward with one compare-and-swap.
+class TokenBucket {
+ public:
+  explicit TokenBucket(const RateLimit& limit);
+
+  TokenBucket(const TokenBucket&) = delete;
+  TokenBucket& operator=(const TokenBucket&) = delete;
+
+  // Takes up to n tokens. Returns how many were taken.
+  int64_t TryTake(int64_t n, int64_t now_ns);
+
+ private:
+  // Time it takes to earn one token, and to fill the whole bucket.
+  const int64_t token_interval_ns_;
+  const int64_t burst_interval_ns_;
+  // Theoretical arrival time of the next token: the bucket is full once
+  // now_ns reaches it, and empty while now_ns + burst_interval_ns_ is below
+  // it.
+  std::atomic<int64_t> next_token_ns_{0};
+};
+
+// Enforces the StreamRateLimits of one role. Thread-safe.
+class StreamRateLimiter {
+ public:
+  // At most this many ingress ports get a bucket of their own. PacketIns of
+  // further ports are only limited by the limit of the role.
+  static constexpr int kMaxPortBuckets = 4096;
+
+  enum class PacketOutAdmission { kAdmitted, kDropped, kRejected };
+
+  explicit StreamRateLimiter(const StreamRateLimits& limits);
+
+  StreamRateLimiter(const StreamRateLimiter&) = delete;
+  StreamRateLimiter& operator=(const StreamRateLimiter&) = delete;
+
+  // False if AdmitPacketIns would admit every PacketIn.
+  bool limits_packet_ins() const {
+    return packet_in_ != nullptr ||
+           (limits_.ingress_port_metadata_id != 0 &&
+            limits_.packet_in_per_port.packets_per_second > 0);
+  }
+
+  // Removes the PacketIns over the limits from packets, and their priorities
+  // from priorities unless it is empty. When a batch exceeds the limit of the
+  // role the packets with the highest priority are kept. Returns how many
+  // packets were removed.
+  int AdmitPacketIns(std::vector<OutboundResponse>* packets,
+                     std::vector<int>* priorities)
+      ABSL_LOCKS_EXCLUDED(port_lock_);
+
+  // Whether one PacketOut may be sent. A PacketOut over the limit is dropped,
+  // or rejected if it should be reported to the controller.
+  PacketOutAdmission AdmitPacketOut();
+
+ private:
+  static int64_t NowNs();
+
+  // Null for disabled limits.
+  static std::unique_ptr<TokenBucket> MakeBucket(const RateLimit& limit);
+
+  // Marks the PacketIns over the per port limits in admitted.
+  void AdmitByPort(const std::vector<OutboundResponse>& packets, int64_t now_ns,
+                   std::vector<bool>* admitted)
+      ABSL_LOCKS_EXCLUDED(port_lock_);
+
+  const StreamRateLimits limits_;
+  const std::unique_ptr<TokenBucket> packet_in_;
+  const std::unique_ptr<TokenBucket> packet_out_;
+
+  absl::Mutex port_lock_;
+  // Keyed by the ingress port metadata value.
+  absl::flat_hash_map<std::string, std::unique_ptr<TokenBucket>> port_buckets_
+      ABSL_GUARDED_BY(port_lock_);
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _RATE_LIMITER_H_
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "rate_limiter.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+constexpr int64_t kSecondNs = 1000000000;
+
+// PacketIns with payloads "0", "1", ... received on the ingress ports, which
+// are carried in metadata 1.
+std::vector<OutboundResponse> PacketIns(
+    const std::vector<std::string>& ingress_ports) {
+  std::vector<p4::v1::PacketIn> packets(ingress_ports.size());
+  for (size_t i = 0; i < ingress_ports.size(); ++i) {
+    p4::v1::PacketMetadata* metadata = packets[i].add_metadata();
+    metadata->set_metadata_id(1);
+    metadata->set_value(ingress_ports[i]);
+    packets[i].set_payload(std::to_string(i));
+  }
+  return PacketInResponses(std::move(packets));
+}
+
+TEST(TokenBucketTest, StartsFullAndRefillsAtTheRate) {
+  TokenBucket bucket(RateLimit{1000, 10});
+  int64_t now = kSecondNs;
+  EXPECT_EQ(bucket.TryTake(20, now), 10);
+  EXPECT_EQ(bucket.TryTake(1, now), 0);
+  // 1000 tokens per second refill 2 tokens in 2ms.
+  EXPECT_EQ(bucket.TryTake(5, now + 2000000), 2);
+  // Never holds more than the burst.
+  EXPECT_EQ(bucket.TryTake(100, now + kSecondNs), 10);
+}
+
+TEST(StreamRateLimiterTest, DropsPacketInsOverTheRate) {
+  StreamRateLimits limits;
+  limits.packet_in = {1, 3};
+  StreamRateLimiter limiter(limits);
+  ASSERT_TRUE(limiter.limits_packet_ins());
+
+  std::vector<OutboundResponse> packets =
+      PacketIns({"a", "a", "a", "a", "a"});
+  std::vector<int> priorities = {0, 0, 5, 0, 7};
+  EXPECT_EQ(limiter.AdmitPacketIns(&packets, &priorities), 2);
+  ASSERT_EQ(packets.size(), 3);
+  EXPECT_EQ(packets[0].response().packet().payload(), "0");
+  EXPECT_EQ(packets[1].response().packet().payload(), "2");
+  EXPECT_EQ(packets[2].response().packet().payload(), "4");
+  // The priorities of the dropped packets are removed with them.
+  EXPECT_EQ(priorities, std::vector<int>({0, 5, 7}));
+}
+
+TEST(StreamRateLimiterTest, LimitsEveryIngressPortSeparately) {
+  StreamRateLimits limits;
+  limits.ingress_port_metadata_id = 1;
+  limits.packet_in_per_port = {1, 2};
+  StreamRateLimiter limiter(limits);
+
+  std::vector<OutboundResponse> packets =
+      PacketIns({"a", "a", "a", "b", "b", "a"});
+  std::vector<int> priorities;
+  EXPECT_EQ(limiter.AdmitPacketIns(&packets, &priorities), 2);
+  EXPECT_EQ(packets.size(), 4);
+}
+
+TEST(StreamRateLimiterTest, RejectsPacketOutsOverTheRate) {
+  StreamRateLimits limits;
+  limits.packet_out = {1, 1};
+  limits.report_rate_limited_packet_outs = true;
+  StreamRateLimiter limiter(limits);
+  EXPECT_EQ(limiter.AdmitPacketOut(),
+            StreamRateLimiter::PacketOutAdmission::kAdmitted);
+  EXPECT_EQ(limiter.AdmitPacketOut(),
+            StreamRateLimiter::PacketOutAdmission::kRejected);
+}
+
+TEST(StreamRateLimiterTest, UnlimitedByDefault) {
+  StreamRateLimiter limiter((StreamRateLimits()));
+  EXPECT_FALSE(limiter.limits_packet_ins());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(limiter.AdmitPacketOut(),
+              StreamRateLimiter::PacketOutAdmission::kAdmitted);
+  }
+}
+
+}  // namespace
+}  // namespace p4rt_server
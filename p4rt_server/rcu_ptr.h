@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _RCU_PTR_H_
+#define _RCU_PTR_H_
+
+#include <memory>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace p4rt_server{
+
+// Immutable state that is replaced as a whole (RCU style): readers take a
+// reference to the current value and use it without any lock, writers
+// publish a new value.
+//
+// Used instead of std::atomic_load and std::atomic_store on a shared_ptr,
+// which are not lock-free either (libstdc++ hashes the pointer to a mutex)
+// and are deprecated in C++20. Load only holds a reader lock for the copy
+// of the pointer, so readers never wait for a writer to build the next
+// value, and the last reference to a replaced value is dropped outside the
+// lock.
+template <typename T>
+class RcuPtr {
+ public:
+  RcuPtr() = default;
+  explicit RcuPtr(std::shared_ptr<const T> value) : value_(std::move(value)) {}
+
+  RcuPtr(const RcuPtr&) = delete;
+  RcuPtr& operator=(const RcuPtr&) = delete;
+
+  std::shared_ptr<const T> Load() const ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::ReaderMutexLock l(&lock_);
+    return value_;
+  }
+
+  void Store(std::shared_ptr<const T> value) ABSL_LOCKS_EXCLUDED(lock_) {
+    {
+      absl::MutexLock l(&lock_);
+      value_.swap(value);
+    }
+  }
+
+ private:
+  mutable absl::Mutex lock_;
+  std::shared_ptr<const T> value_ ABSL_GUARDED_BY(lock_);
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _RCU_PTR_H_
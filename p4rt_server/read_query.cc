@@ -0,0 +1,169 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "read_query.h"
+
+#include <algorithm>
+
+namespace p4rt_server{
+namespace {
+
+   // Fills in the table part of a query: the table IDs, the key prefix and
+   // the data columns of a table entry filter.
+   void ParseTableEntry(const p4::v1::TableEntry& entry,
+                        const P4InfoIndex* index,
+                        const absl::optional<std::string>& role,
+                        ReadQuery* query) {
+     if (entry.table_id() != 0) {
+       query->ids.push_back(entry.table_id());
+     } else if (index != nullptr) {
+       query->ids = index->TableIds(role);
+     } else {
+       query->every_id = true;
+     }
+     query->default_entry = entry.is_default_action();
+
+     query->match.reserve(entry.match_size());
+     for (const auto& field : entry.match()) query->match.push_back(&field);
+     std::sort(query->match.begin(), query->match.end(),
+               [](const p4::v1::FieldMatch* a, const p4::v1::FieldMatch* b) {
+                 if (a->has_exact() != b->has_exact()) return a->has_exact();
+                 return a->field_id() < b->field_id();
+               });
+     query->exact_match_count = std::count_if(
+         query->match.begin(), query->match.end(),
+         [](const p4::v1::FieldMatch* field) { return field->has_exact(); });
+
+     if (index != nullptr && entry.table_id() != 0 && !entry.match().empty()) {
+       const P4InfoIndex::TableInfo* table = index->FindTable(entry.table_id());
+       query->single_entry =
+           table != nullptr &&
+           static_cast<size_t>(entry.match_size()) ==
+               table->match_fields.size() &&
+           (!table->requires_priority || entry.priority() != 0);
+     }
+
+     query->counter_data = entry.has_counter_data();
+     query->meter_config = entry.has_meter_config();
+     query->time_since_last_hit = entry.has_time_since_last_hit();
+   }
+
+   // Returns the table of a table entry or direct resource, 0 for other
+   // entities.
+   uint32_t TableIdOf(const p4::v1::Entity& entity) {
+     switch (entity.entity_case()) {
+       case p4::v1::Entity::kTableEntry:
+         return entity.table_entry().table_id();
+       case p4::v1::Entity::kDirectCounterEntry:
+         return entity.direct_counter_entry().table_entry().table_id();
+       case p4::v1::Entity::kDirectMeterEntry:
+         return entity.direct_meter_entry().table_entry().table_id();
+       default:
+         return 0;
+     }
+   }
+
+   // Adds the ID of a read filter, 0 being a wildcard.
+   void AddId(uint32_t id, ReadQuery* query) {
+     if (id == 0) {
+       query->every_id = true;
+     } else {
+       query->ids.push_back(id);
+     }
+   }
+
+   // Adds the index of a counter, meter or register filter.
+   template <typename T>
+   void AddIndex(const T& entry, ReadQuery* query) {
+     if (entry.has_index()) query->index = entry.index().index();
+   }
+
+}  // namespace
+
+ReadQuery ParseReadQuery(const p4::v1::Entity& entity,
+                         const P4InfoIndex* index,
+                         const absl::optional<std::string>& role) {
+  ReadQuery query;
+  query.entity = &entity;
+  query.type = entity.entity_case();
+  switch (entity.entity_case()) {
+    case p4::v1::Entity::kTableEntry:
+      ParseTableEntry(entity.table_entry(), index, role, &query);
+      break;
+    case p4::v1::Entity::kDirectCounterEntry:
+      ParseTableEntry(entity.direct_counter_entry().table_entry(), index, role,
+                      &query);
+      query.counter_data = true;
+      break;
+    case p4::v1::Entity::kDirectMeterEntry:
+      ParseTableEntry(entity.direct_meter_entry().table_entry(), index, role,
+                      &query);
+      query.meter_config = true;
+      break;
+    case p4::v1::Entity::kCounterEntry: {
+      const auto& counter = entity.counter_entry();
+      AddId(counter.counter_id(), &query);
+      AddIndex(counter, &query);
+      query.counter_data = true;
+      break;
+    }
+    case p4::v1::Entity::kMeterEntry: {
+      const auto& meter = entity.meter_entry();
+      AddId(meter.meter_id(), &query);
+      AddIndex(meter, &query);
+      query.meter_config = true;
+      break;
+    }
+    case p4::v1::Entity::kRegisterEntry: {
+      const auto& register_entry = entity.register_entry();
+      AddId(register_entry.register_id(), &query);
+      AddIndex(register_entry, &query);
+      break;
+    }
+    case p4::v1::Entity::kActionProfileMember:
+      AddId(entity.action_profile_member().action_profile_id(), &query);
+      break;
+    case p4::v1::Entity::kActionProfileGroup:
+      AddId(entity.action_profile_group().action_profile_id(), &query);
+      break;
+    case p4::v1::Entity::kValueSetEntry:
+      AddId(entity.value_set_entry().value_set_id(), &query);
+      break;
+    case p4::v1::Entity::kDigestEntry:
+      AddId(entity.digest_entry().digest_id(), &query);
+      break;
+    default:
+      break;
+  }
+  return query;
+}
+
+std::vector<ReadQuery> ParseReadQueries(
+    const p4::v1::ReadRequest& request, const P4InfoIndex* index,
+    const absl::optional<std::string>& role) {
+  std::vector<ReadQuery> queries;
+  queries.reserve(request.entities_size());
+  for (const auto& entity : request.entities()) {
+    queries.push_back(ParseReadQuery(entity, index, role));
+  }
+  return queries;
+}
+
+bool QueriesCover(absl::Span<const ReadQuery> queries,
+                  const p4::v1::Entity& entity) {
+  uint32_t table_id = TableIdOf(entity);
+  if (table_id == 0) return true;
+  for (const ReadQuery& query : queries) {
+    if (query.type != entity.entity_case()) continue;
+    if (query.every_id ||
+        std::binary_search(query.ids.begin(), query.ids.end(), table_id)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}//namespace p4rt_server
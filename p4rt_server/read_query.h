@@ -0,0 +1,76 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _READ_QUERY_H_
+#define _READ_QUERY_H_
+
+#include "p4info_index.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// One entity of a ReadRequest in normalized form, so a switch provider can
+// look up what was asked for instead of interpreting the wildcards of the
+// read filter itself.
+struct ReadQuery {
+  // The read filter the query was parsed from.
+  const p4::v1::Entity* entity = nullptr;
+  p4::v1::Entity::EntityCase type = p4::v1::Entity::ENTITY_NOT_SET;
+
+  // Sorted IDs of the tables for table entries and direct counters and
+  // meters, or of the counters, meters, registers, action profiles, value
+  // sets or digests read. Once the P4Info is known, a wildcard table read is
+  // expanded to the tables in the scope of the role.
+  std::vector<uint32_t> ids;
+  // Set instead of ids for wildcard reads that were not expanded.
+  bool every_id = false;
+
+  // Table reads only. The match fields of the filter sorted by field ID,
+  // with the exact matches first: a key prefix for indexed lookups.
+  std::vector<const p4::v1::FieldMatch*> match;
+  int exact_match_count = 0;
+  // Set if the match and priority name a single entry of the table.
+  bool single_entry = false;
+  // Set if only the default entry is read.
+  bool default_entry = false;
+
+  // Counter, meter and register reads only. Unset reads every index.
+  absl::optional<int64_t> index;
+
+  // The data columns to fill in. Table reads only return counter data,
+  // meter configs and idle times if the filter asks for them.
+  bool counter_data = false;
+  bool meter_config = false;
+  bool time_since_last_hit = false;
+};
+
+// Parses a read filter. With no index, table IDs are not expanded and
+// single_entry is never set.
+ReadQuery ParseReadQuery(const p4::v1::Entity& entity,
+                         const P4InfoIndex* index,
+                         const absl::optional<std::string>& role);
+
+// Parses every entity of the request, in order.
+std::vector<ReadQuery> ParseReadQueries(
+    const p4::v1::ReadRequest& request, const P4InfoIndex* index,
+    const absl::optional<std::string>& role);
+
+// Returns true if an entity read from the switch was asked for by one of the
+// queries. Table entries and direct counters and meters must be in a table
+// of a query of their type; other entities are not checked.
+bool QueriesCover(absl::Span<const ReadQuery> queries,
+                  const p4::v1::Entity& entity);
+
+}//namespace p4rt_server
+
+#endif //ifndef _READ_QUERY_H_
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "read_query.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mock_switch_provider.h"
+
+namespace p4rt_server {
+namespace {
+
+using ::testing::ElementsAre;
+
+// Table 1 belongs to role "a" and table 2 to role "b".
+std::shared_ptr<const P4InfoIndex> TwoRoleIndex() {
+  p4::config::v1::P4Info p4info;
+  for (uint32_t id = 1; id <= 2; ++id) {
+    p4::config::v1::Preamble* preamble =
+        p4info.add_tables()->mutable_preamble();
+    preamble->set_id(id);
+    preamble->add_annotations(id == 1 ? "@p4runtime_role(\"a\")"
+                                      : "@p4runtime_role(\"b\")");
+  }
+  auto index = P4InfoIndex::Create(p4info);
+  EXPECT_TRUE(index.ok()) << index.status();
+  return index.value();
+}
+
+p4::v1::ReadRequest WildcardTableRead() {
+  p4::v1::ReadRequest request;
+  request.add_entities()->mutable_table_entry();
+  return request;
+}
+
+// Reads the request through the default DoQueryRead of a provider whose
+// DoRead returns one entry of each table, and returns the table IDs read.
+std::vector<uint32_t> ReadTables(const p4::v1::ReadRequest& request,
+                                 const P4InfoIndex* index,
+                                 const absl::optional<std::string>& role) {
+  MockSwitchProvider::Options options;
+  for (uint32_t id = 1; id <= 2; ++id) {
+    options.read_response.add_entities()->mutable_table_entry()->set_table_id(
+        id);
+  }
+  MockSwitchProvider provider(options);
+  std::vector<ReadQuery> queries = ParseReadQueries(request, index, role);
+  std::vector<uint32_t> tables;
+  absl::Status status = provider.DoQueryRead(
+      &request, queries, [&tables](p4::v1::Entity entity) {
+        tables.push_back(entity.table_entry().table_id());
+        return true;
+      });
+  EXPECT_TRUE(status.ok()) << status;
+  return tables;
+}
+
+TEST(ReadQueryTest, WildcardTableReadsCoverTheTablesOfTheRole) {
+  std::shared_ptr<const P4InfoIndex> index = TwoRoleIndex();
+  p4::v1::ReadRequest request = WildcardTableRead();
+  EXPECT_THAT(ParseReadQueries(request, index.get(), std::string("a"))[0].ids,
+              ElementsAre(1));
+  EXPECT_THAT(ParseReadQueries(request, index.get(), std::string("b"))[0].ids,
+              ElementsAre(2));
+  EXPECT_THAT(ParseReadQueries(request, index.get(), absl::nullopt)[0].ids,
+              ElementsAre(1, 2));
+}
+
+TEST(ReadQueryTest, DefaultQueryReadKeepsWildcardReadsInTheRole) {
+  std::shared_ptr<const P4InfoIndex> index = TwoRoleIndex();
+  p4::v1::ReadRequest request = WildcardTableRead();
+  EXPECT_THAT(ReadTables(request, index.get(), std::string("a")),
+              ElementsAre(1));
+  EXPECT_THAT(ReadTables(request, index.get(), std::string("b")),
+              ElementsAre(2));
+  EXPECT_THAT(ReadTables(request, index.get(), absl::nullopt),
+              ElementsAre(1, 2));
+  // Without a P4Info there is no scope to keep to.
+  EXPECT_THAT(ReadTables(request, nullptr, std::string("a")),
+              ElementsAre(1, 2));
+}
+
+TEST(ReadQueryTest, QueriesCoverOnlyTheirEntityType) {
+  p4::v1::ReadRequest request;
+  request.add_entities()->mutable_table_entry()->set_table_id(1);
+  std::vector<ReadQuery> queries =
+      ParseReadQueries(request, nullptr, absl::nullopt);
+  p4::v1::Entity entity;
+  entity.mutable_direct_counter_entry()->mutable_table_entry()->set_table_id(1);
+  EXPECT_FALSE(QueriesCover(queries, entity));
+  entity.mutable_table_entry()->set_table_id(1);
+  EXPECT_TRUE(QueriesCover(queries, entity));
+  entity.mutable_counter_entry()->set_counter_id(7);
+  EXPECT_TRUE(QueriesCover(queries, entity));
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "read_response_chunker.h"
+
+namespace p4rt_server{
+
+ReadResponseChunker::ReadResponseChunker(ResponseWriter write_response,
+                                         const Options& options)
+    : write_response_(std::move(write_response)), options_(options) {}
+
+bool ReadResponseChunker::Add(p4::v1::Entity entity) {
+  if (write_failed_) return false;
+
+  size_t entity_bytes = entity.ByteSizeLong();
+  // Never leave a chunk empty, even if a single entity is over the budget.
+  if (chunk_.entities_size() > 0 &&
+      chunk_bytes_ + entity_bytes > options_.max_bytes) {
+    if (!WriteChunk()) return false;
+  }
+  chunk_.add_entities()->Swap(&entity);
+  chunk_bytes_ += entity_bytes;
+
+  if (chunk_.entities_size() >= options_.max_entities ||
+      chunk_bytes_ >= options_.max_bytes) {
+    return WriteChunk();
+  }
+  return true;
+}
+
+bool ReadResponseChunker::Finish() {
+  if (write_failed_) return false;
+  if (chunk_.entities_size() > 0 || chunks_written_ == 0) return WriteChunk();
+  return true;
+}
+
+bool ReadResponseChunker::WriteChunk() {
+  write_failed_ = !write_response_(chunk_);
+  ++chunks_written_;
+  chunk_.Clear();
+  chunk_bytes_ = 0;
+  return !write_failed_;
+}
+
+}//namespace p4rt_server
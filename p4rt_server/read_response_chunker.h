@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _READ_RESPONSE_CHUNKER_H_
+#define _READ_RESPONSE_CHUNKER_H_
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// Splits the entities of a Read into ReadResponse messages of bounded size.
+//
+// Entities are added one at a time, and a ReadResponse is written as soon as
+// it holds max_entities entities or max_bytes bytes of serialized entities.
+// Only one chunk is held in memory at a time and no message gets close to the
+// gRPC message size limit. The chunk is a single heap ReadResponse reused for
+// the whole read: clearing it keeps its Entity messages, which the entities of
+// the next chunk are swapped into, so after the first chunk no message is
+// allocated per entity. write_response must be done with the chunk, e.g. have
+// serialized it, when it returns.
+class ReadResponseChunker {
+ public:
+  struct Options {
+    int max_entities = 1000;
+    // Well below the default gRPC limit of 4MB per message.
+    size_t max_bytes = 1 << 20;
+  };
+
+  using ResponseWriter = std::function<bool(const p4::v1::ReadResponse&)>;
+
+  ReadResponseChunker(ResponseWriter write_response,
+                      const Options& options);
+  explicit ReadResponseChunker(ResponseWriter write_response)
+      : ReadResponseChunker(std::move(write_response), Options()) {}
+
+  ReadResponseChunker(const ReadResponseChunker&) = delete;
+  ReadResponseChunker& operator=(const ReadResponseChunker&) = delete;
+
+  // Adds an entity to the current chunk, writing the chunk once it is full.
+  // Returns false once a write failed; the entity is dropped then.
+  bool Add(p4::v1::Entity entity);
+
+  // Writes the last chunk. A Read always gets at least one, possibly empty,
+  // ReadResponse. Returns false if any write failed.
+  bool Finish();
+
+ private:
+  bool WriteChunk();
+
+  const ResponseWriter write_response_;
+  const Options options_;
+
+  p4::v1::ReadResponse chunk_;
+  size_t chunk_bytes_ = 0;
+  int chunks_written_ = 0;
+  bool write_failed_ = false;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _READ_RESPONSE_CHUNKER_H_
@@ -6,7 +6,12 @@
  */
 
 #include "sdn_controller_manager.h"
+#include "tracing.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
 #include "absl/numeric/int128.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_format.h"
@@ -32,28 +37,48 @@ std::string PrettyPrintElectionId(const absl::optional<absl::uint128>& id) {
 }
 
 grpc::Status ValidateConnection(
-    const absl::optional<std::string>& role_name,
     const absl::optional<absl::uint128>& election_id,
-    const std::vector<SdnConnection*>& active_connections) {
+    const std::map<absl::uint128, SdnConnection*>& connections_by_election_id) {
   // If the election ID is not set then the controller is saying this should be
   // a backup connection, and we allow any number of backup connections.
   if (!election_id.has_value()) return grpc::Status::OK;
 
   // Otherwise, we verify the election ID is unique among all active connections
   // for a given role (including the root role).
-  for (const auto& connection : active_connections) {
-    if (connection->GetRoleName() == role_name &&
-        connection->GetElectionId() == election_id) {
-      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                          "Election ID is already used by another connection "
-                          "with the same role.");
-    }
+  if (connections_by_election_id.count(*election_id) > 0) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Election ID is already used by another connection "
+                        "with the same role.");
   }
   return grpc::Status::OK;
 }
 
 }  // namespace
 
+SdnConnection::SdnConnection(
+    grpc::ServerContext* context,
+    grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
+                             p4::v1::StreamMessageRequest>* stream,
+    int max_outbound_queue_size, const StreamMetrics& metrics,
+    const PacketInQueue::Options& packet_in_options)
+    : initialized_(false),
+      grpc_context_(context),
+      grpc_stream_(stream),
+      max_outbound_queue_size_(max_outbound_queue_size),
+      packet_ins_(packet_in_options),
+      metrics_(metrics) {
+  writer_ = std::thread([this]() { WriteOutboundResponses(); });
+}
+
+SdnConnection::~SdnConnection() {
+  if (!writer_.joinable()) return;
+  {
+    absl::MutexLock l(&outbound_lock_);
+    closed_ = true;
+  }
+  writer_.join();
+}
+
 void SdnConnection::SetElectionId(const absl::optional<absl::uint128>& id) {
   election_id_ = id;
 }
@@ -66,27 +91,163 @@ void SdnConnection::SetRoleName(const absl::optional<std::string>& name) {
   role_name_ = name;
 }
 
-absl::optional<std::string> SdnConnection::GetRoleName() const {
+const absl::optional<std::string>& SdnConnection::GetRoleName() const {
   return role_name_;
 }
 
-void SdnConnection::SendStreamMessageResponse(
+bool SdnConnection::SendStreamMessageResponse(
     const p4::v1::StreamMessageResponse& response) {
-  if (!grpc_stream_->Write(response)) {
-    LOG(ERROR) << "Could not send arbitration update response to gRPC conext '"
-               << grpc_context_ << "': " << response.ShortDebugString();
+  std::vector<p4::v1::StreamMessageResponse> responses(1, response);
+  return SendStreamMessageResponses(std::move(responses)) == 1;
+}
+
+int SdnConnection::SendStreamMessageResponses(
+    std::vector<p4::v1::StreamMessageResponse> responses) {
+  std::vector<OutboundResponse> outbound;
+  outbound.reserve(responses.size());
+  for (auto& response : responses) outbound.emplace_back(std::move(response));
+  return QueueResponses(std::move(outbound));
+}
+
+bool SdnConnection::SendSharedStreamMessageResponse(
+    std::shared_ptr<const SharedStreamResponse> response) {
+  if (grpc_stream_ == nullptr) {
+    return SendStreamMessageResponse(response->response());
+  }
+  std::vector<OutboundResponse> responses;
+  responses.emplace_back(std::move(response));
+  return QueueResponses(std::move(responses)) == 1;
+}
+
+int SdnConnection::QueueResponses(std::vector<OutboundResponse> responses) {
+  ScopedSpan::AddCurrentEvent("response_queued");
+  absl::MutexLock l(&outbound_lock_);
+  if (closed_ || write_failed_) return 0;
+
+  int queued = std::min<int>(
+      responses.size(), max_outbound_queue_size_ - outbound_queue_.size());
+  for (int i = 0; i < queued; ++i) {
+    outbound_queue_.push_back(std::move(responses[i]));
+  }
+  if (metrics_.outbound_queue_depth != nullptr) {
+    metrics_.outbound_queue_depth->Add(queued);
+  }
+  if (static_cast<size_t>(queued) < responses.size()) {
+    dropped_responses_ += responses.size() - queued;
+    if (metrics_.dropped_queue_full != nullptr) {
+      metrics_.dropped_queue_full->Increment(responses.size() - queued);
+    }
+    LOG_EVERY_N(WARNING, 1000)
+        << "Outbound queue for gRPC context '" << grpc_context_
+        << "' is full. Dropped " << dropped_responses_
+        << " stream responses so far.";
+  }
+  return queued;
+}
+
+PacketInResult SdnConnection::SendPacketIns(
+    std::vector<OutboundResponse> packets, absl::Span<const int> priorities) {
+  absl::MutexLock l(&outbound_lock_);
+  if (closed_ || write_failed_) {
+    PacketInResult result;
+    result.overflow = packets.size();
+    return result;
+  }
+
+  PacketInResult result = packet_ins_.Push(std::move(packets), priorities);
+  if (metrics_.outbound_queue_depth != nullptr) {
+    metrics_.outbound_queue_depth->Add(result.queued - result.evicted);
+  }
+  if (result.overflow > 0 || result.evicted > 0) {
+    dropped_responses_ += result.overflow + result.evicted;
+    LOG_EVERY_N(WARNING, 1000)
+        << "PacketIn queue for gRPC context '" << grpc_context_
+        << "' is full. Dropped " << dropped_responses_
+        << " stream responses so far.";
+  }
+  return result;
+}
+
+void SdnConnection::WriteOutboundResponses() {
+  auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(outbound_lock_) {
+    return closed_ || !outbound_queue_.empty() || !packet_ins_.empty();
+  };
+  std::deque<OutboundResponse> responses;
+  while (true) {
+    {
+      absl::MutexLock l(&outbound_lock_);
+      outbound_lock_.Await(absl::Condition(&has_work));
+      // On close we still flush whatever was queued before returning.
+      if (outbound_queue_.empty() && packet_ins_.empty()) return;
+      // Arbitration updates and errors go ahead of PacketIns.
+      responses.swap(outbound_queue_);
+      packet_ins_.Pop(kPacketInWriteBatchSize, &responses);
+    }
+
+    // The lock is not held while writing, so a slow controller only delays
+    // its own responses. Everything that was queued together is written with
+    // a buffer hint, so gRPC can coalesce it into as few frames as possible,
+    // and flushed with the last response.
+    while (!responses.empty()) {
+      grpc::WriteOptions options;
+      if (responses.size() > 1) options.set_buffer_hint();
+      // The synchronous stream only takes messages, so a shared response is
+      // serialized by every connection it is written to.
+      if (!grpc_stream_->Write(responses.front().response(), options)) {
+        LOG(ERROR) << "Could not send stream response to gRPC conext '"
+                   << grpc_context_ << "': "
+                   << responses.front().response().ShortDebugString();
+        absl::MutexLock l(&outbound_lock_);
+        write_failed_ = true;
+        int dropped = responses.size() + outbound_queue_.size() +
+                      packet_ins_.Clear();
+        if (metrics_.dropped_write_failed != nullptr) {
+          metrics_.dropped_write_failed->Increment(dropped);
+        }
+        if (metrics_.outbound_queue_depth != nullptr) {
+          metrics_.outbound_queue_depth->Add(-dropped);
+        }
+        responses.clear();
+        outbound_queue_.clear();
+        break;
+      }
+      responses.pop_front();
+      if (metrics_.outbound_queue_depth != nullptr) {
+        metrics_.outbound_queue_depth->Add(-1);
+      }
+    }
   }
 }
 
+SdnControllerManager::SdnControllerManager(
+    std::shared_ptr<MetricsRegistry> metrics, RateLimitsForRole rate_limits,
+    bool mirror_packet_ins, absl::optional<uint64_t> device_id)
+    : metrics_(std::move(metrics)),
+      rate_limits_for_role_(std::move(rate_limits)),
+      mirror_packet_ins_(mirror_packet_ins),
+      stream_metrics_{
+          metrics_->GetCounter("p4rt_stream_responses_dropped_total",
+                               {{"reason", "queue_full"}}),
+          metrics_->GetCounter("p4rt_stream_responses_dropped_total",
+                               {{"reason", "write_failed"}}),
+          metrics_->GetGauge("p4rt_stream_outbound_queue_depth")},
+      arbitration_errors_(
+          metrics_->GetCounter("p4rt_arbitration_errors_total")),
+      lock_hold_time_(metrics_->GetHistogram(
+          "p4rt_controller_manager_lock_hold_seconds")),
+      device_id_fixed_(device_id.has_value()),
+      device_id_(device_id.value_or(183807201)),
+      primary_election_ids_(std::make_shared<PrimaryElectionIds>()) {}
+
 grpc::Status SdnControllerManager::HandleArbitrationUpdate(
     const p4::v1::MasterArbitrationUpdate& update, SdnConnection* controller) {
-  absl::MutexLock l(&lock_);
+  TimedMutexLock l(&lock_, lock_hold_time_);
 
-  // TODO: arbitration should fail with invalid device id.
-  device_id_ = update.device_id();
+  if (!device_id_fixed_) device_id_ = update.device_id();
 
   // Verify the request's device ID is being sent to the correct device.
   if (update.device_id() != device_id_) {
+    arbitration_errors_->Increment();
     return grpc::Status(
         grpc::StatusCode::FAILED_PRECONDITION,
         absl::StrCat("Arbitration request has the wrong device ID '",
@@ -110,6 +271,10 @@ grpc::Status SdnControllerManager::HandleArbitrationUpdate(
                                     update.election_id().low());
   }
 
+  // Verify that this is a valid connection, and wont mess up internal state.
+  int role_id = InternRoleId(role_name);
+  roles_[role_id].metrics.arbitration_updates->Increment();
+
   // If the controller is already initialized we check if the role & election ID
   // match. Assuming nothing has changed then there is nothing we need to do.
   if (controller->IsInitialized() && controller->GetRoleName() == role_name &&
@@ -118,33 +283,49 @@ grpc::Status SdnControllerManager::HandleArbitrationUpdate(
     return grpc::Status::OK;
   }
 
-  // Verify that this is a valid connection, and wont mess up internal state.
   auto valid_connection =
-      ValidateConnection(role_name, election_id, connections_);
+      ValidateConnection(election_id, roles_[role_id].by_election_id);
   if (!valid_connection.ok()) {
+    arbitration_errors_->Increment();
     return valid_connection;
   }
 
-  // Update the connection with the arbitration data and initalize.
+  // Update the connection with the arbitration data and initalize. A
+  // connection that is already initialized is moved out of its old role first.
+  absl::optional<int> old_role_id;
+  bool was_primary = false;
   if (controller->IsInitialized()) {
     LOG(INFO) << absl::StreamFormat(
         "Update SDN connection (%s, %s): %s",
         PrettyPrintRoleName(controller->GetRoleName()),
         PrettyPrintElectionId(controller->GetElectionId()),
         update.ShortDebugString());
+    old_role_id = controller->GetRoleId();
+    was_primary = roles_[*old_role_id].primary == controller;
+    RemoveConnection(controller);
   } else {
     LOG(INFO) << "New SDN connection: " << update.ShortDebugString();
   }
   controller->SetRoleName(role_name);
+  controller->SetRoleId(role_id);
   controller->SetElectionId(election_id);
   controller->Initialize();
-  connections_.push_back(controller);
+  AddConnection(controller);
+
+  // If the connection was the primary of a different role, that role just lost
+  // its primary connection.
+  if (was_primary && old_role_id != role_id) {
+    InformConnectionsAboutPrimaryChange(*old_role_id);
+  }
 
    // If there is a change in the primary connection state we should inform all
   // other connections with the same role. Otherwise, we just respond directly
   // to the calling controller.
-  if (UpdateToPrimaryConnectionState(role_name, election_id)) {
-    InformConnectionsAboutPrimaryChange(role_name);
+  bool primary_changed = UpdateToPrimaryConnectionState(role_id, election_id);
+  RefreshPrimaryConnection(role_id);
+  if (primary_changed) {
+    PublishPrimaryElectionIds();
+    InformConnectionsAboutPrimaryChange(role_id);
   } else {
     // primary connection didn't so inform just this connection that it is a
     // backup.
@@ -157,57 +338,72 @@ grpc::Status SdnControllerManager::HandleArbitrationUpdate(
 }
 
 void SdnControllerManager::Disconnect(SdnConnection* connection) {
-  absl::MutexLock l(&lock_);
+  TimedMutexLock l(&lock_, lock_hold_time_);
 
   // If the connection was never initialized then there is no work needed to
   // disconnect it.
   if (!connection->IsInitialized()) return;
 
-  // Iterate through the list connections and remove this connection.
-  for (auto iter = connections_.begin(); iter != connections_.end(); ++iter) {
-    if (*iter == connection) {
-      LOG(INFO) << "Dropping SDN connection for role "
-                << PrettyPrintRoleName(connection->GetRoleName())
-                << " with election ID "
-                << PrettyPrintElectionId(connection->GetElectionId()) << ".";
-      connections_.erase(iter);
-      break;
-    }
-  }
+  LOG(INFO) << "Dropping SDN connection for role "
+            << PrettyPrintRoleName(connection->GetRoleName())
+            << " with election ID "
+            << PrettyPrintElectionId(connection->GetElectionId()) << ".";
+  int role_id = connection->GetRoleId();
+  bool was_primary = roles_[role_id].primary == connection;
+  RemoveConnection(connection);
 
   // If connection was the primary connection we need to inform all existing
   // connections.
-  if (connection->GetElectionId().has_value() &&
-      (connection->GetElectionId() ==
-      election_id_past_by_role_[connection->GetRoleName()])) {
-    InformConnectionsAboutPrimaryChange(connection->GetRoleName());
+  if (was_primary) {
+    InformConnectionsAboutPrimaryChange(role_id);
   }
 }
 
 grpc::Status SdnControllerManager::AllowRequest(
-    const absl::optional<std::string>& role_name,
+    const PrimaryElectionIds& primary_election_ids, int role_id,
     const absl::optional<absl::uint128>& election_id) {
-  absl::MutexLock l(&lock_);
-
   if (!election_id.has_value()) {
     return grpc::Status(grpc::StatusCode::PERMISSION_DENIED,
                         "Request does not have an election ID.");
   }
 
-  const auto& primary_election_id = election_id_past_by_role_.find(role_name);
-  if (primary_election_id == election_id_past_by_role_.end()) {
+  if (role_id < 0 ||
+      static_cast<size_t>(role_id) >=
+          primary_election_ids.election_id_past.size() ||
+      !primary_election_ids.election_id_past[role_id].has_value()) {
     return grpc::Status(grpc::StatusCode::PERMISSION_DENIED,
                         "Only the primary connection can issue requests, but "
                         "no primary connection has been established.");
   }
 
-  if (election_id != primary_election_id->second) {
+  if (election_id != primary_election_ids.election_id_past[role_id]) {
     return grpc::Status(grpc::StatusCode::PERMISSION_DENIED,
                         "Only the primary connection can issue requests.");
   }
   return grpc::Status::OK;
 }
 
+grpc::Status SdnControllerManager::AllowRequest(
+    const absl::optional<std::string>& role_name,
+    const absl::optional<absl::uint128>& election_id) {
+  std::shared_ptr<const PrimaryElectionIds> primary_election_ids =
+      primary_election_ids_.Load();
+  const auto& role_id = primary_election_ids->role_ids.find(role_name);
+  return AllowRequest(*primary_election_ids,
+                      role_id == primary_election_ids->role_ids.end()
+                          ? -1
+                          : role_id->second,
+                      election_id);
+}
+
+grpc::Status SdnControllerManager::AllowRequest(
+    const SdnConnection& connection) {
+  std::shared_ptr<const PrimaryElectionIds> primary_election_ids =
+      primary_election_ids_.Load();
+  return AllowRequest(*primary_election_ids, connection.GetRoleId(),
+                      connection.GetElectionId());
+}
+
 grpc::Status SdnControllerManager::AllowRequest(
     const p4::v1::WriteRequest& request) {
   absl::optional<std::string> role_name;
@@ -238,16 +434,98 @@ grpc::Status SdnControllerManager::AllowRequest(
   return AllowRequest(role_name, election_id);
 }
 
+int SdnControllerManager::InternRoleId(
+    const absl::optional<std::string>& role_name) {
+  auto inserted = role_ids_.try_emplace(role_name, roles_.size());
+  if (inserted.second) {
+    MetricLabels labels = {{"role", role_name.value_or("")}};
+    MetricLabels sent_labels = {{"role", role_name.value_or("")},
+                                {"result", "sent"}};
+    MetricLabels dropped_labels = {{"role", role_name.value_or("")},
+                                   {"result", "dropped"}};
+    auto packet_in_counter = [&](absl::string_view result) {
+      return metrics_->GetCounter(
+          "p4rt_packet_ins_total",
+          {{"role", role_name.value_or("")}, {"result", std::string(result)}});
+    };
+    RoleMetrics role_metrics = {
+        metrics_->GetCounter("p4rt_arbitration_updates_total", labels),
+        metrics_->GetCounter("p4rt_primary_changes_total", labels),
+        metrics_->GetCounter("p4rt_primary_stream_responses_total",
+                             sent_labels),
+        metrics_->GetCounter("p4rt_primary_stream_responses_total",
+                             dropped_labels),
+        metrics_->GetCounter("p4rt_packet_outs_total", labels),
+        metrics_->GetCounter("p4rt_packet_out_errors_total", labels),
+        packet_in_counter("queued"),
+        packet_in_counter("no_primary"),
+        packet_in_counter("overflow"),
+        packet_in_counter("evicted"),
+        packet_in_counter("rate_limited"),
+        metrics_->GetCounter("p4rt_packet_ins_mirrored_total", labels),
+        metrics_->GetCounter("p4rt_packet_outs_rate_limited_total", labels)};
+    StreamRateLimits limits;
+    if (rate_limits_for_role_) limits = rate_limits_for_role_(role_name);
+    roles_.emplace_back(role_name, role_metrics,
+                        absl::make_unique<StreamRateLimiter>(limits));
+  }
+  return inserted.first->second;
+}
+
+void SdnControllerManager::AddConnection(SdnConnection* connection) {
+  RoleConnections& role = roles_[connection->GetRoleId()];
+  if (connection->GetElectionId().has_value()) {
+    role.by_election_id[*connection->GetElectionId()] = connection;
+  } else {
+    role.without_election_id.insert(connection);
+  }
+}
+
+void SdnControllerManager::RemoveConnection(SdnConnection* connection) {
+  RoleConnections& role = roles_[connection->GetRoleId()];
+  if (connection->GetElectionId().has_value()) {
+    auto iter = role.by_election_id.find(*connection->GetElectionId());
+    if (iter != role.by_election_id.end() && iter->second == connection) {
+      role.by_election_id.erase(iter);
+    }
+  } else {
+    role.without_election_id.erase(connection);
+  }
+  if (role.primary == connection) role.primary = nullptr;
+}
+
+void SdnControllerManager::RefreshPrimaryConnection(int role_id) {
+  RoleConnections& role = roles_[role_id];
+  role.primary = nullptr;
+
+  auto election_id_past = election_id_past_by_role_.find(role.role_name);
+  if (election_id_past == election_id_past_by_role_.end() ||
+      !election_id_past->second.has_value()) {
+    return;
+  }
+  auto primary = role.by_election_id.find(*election_id_past->second);
+  if (primary != role.by_election_id.end()) {
+    role.primary = primary->second;
+  }
+}
+
 bool SdnControllerManager::UpdateToPrimaryConnectionState(
-    const absl::optional<std::string>& role_name,
-    const absl::optional<absl::uint128>& election_id) {
+    int role_id, const absl::optional<absl::uint128>& election_id) {
   VLOG(1) << "Checking for new primary connections.";
+  const RoleConnections& role = roles_[role_id];
+  const absl::optional<std::string>& role_name = role.role_name;
+
   // Find the highest election ID, from the active connections, for the role.
   absl::optional<absl::uint128> max_election_id;
-  for (const auto& connection_ptr : connections_) {
-    if (connection_ptr->GetRoleName() != role_name) continue;
-    max_election_id =
-        std::max(max_election_id, connection_ptr->GetElectionId());
+  if (!role.by_election_id.empty()) {
+    max_election_id = role.by_election_id.rbegin()->first;
+  }
+  // Election IDs below the one restored after a restart cannot be primary.
+  auto election_id_floor = election_id_floor_by_role_.find(role_name);
+  if (max_election_id.has_value() &&
+      election_id_floor != election_id_floor_by_role_.end() &&
+      *max_election_id < election_id_floor->second) {
+    max_election_id = absl::nullopt;
   }
 
   // Get the highest election ID currently seen. This does not need to be from
@@ -285,31 +563,49 @@ bool SdnControllerManager::UpdateToPrimaryConnectionState(
   return false;
 }
 
-void SdnControllerManager::InformConnectionsAboutPrimaryChange(
-    const absl::optional<std::string>& role_name) {
+void SdnControllerManager::InformConnectionsAboutPrimaryChange(int role_id) {
   VLOG(1) << "Informing all connections about primary connection change.";
-  for (const auto& connection : connections_) {
-    if (connection->GetRoleName() == role_name) {
-      SendArbitrationResponse(connection);
+  const RoleConnections& role = roles_[role_id];
+  role.metrics.primary_changes->Increment();
+  if (role.primary != nullptr) SendArbitrationResponse(role.primary);
+
+  // Every backup gets the same update, so it is built and serialized once.
+  std::vector<SdnConnection*> backups = BackupConnections(role);
+  if (backups.size() == 1) {
+    SendArbitrationResponse(backups.front());
+  } else if (!backups.empty()) {
+    auto response = std::make_shared<const SharedStreamResponse>(
+        ArbitrationResponse(*backups.front()));
+    for (SdnConnection* backup : backups) {
+      backup->SendSharedStreamMessageResponse(response);
     }
   }
 }
 
-bool SdnControllerManager::PrimaryConnectionExists(
-    const absl::optional<std::string>& role_name) {
-  absl::optional<absl::uint128> primary_election_id =
-     election_id_past_by_role_[role_name];
-
-  for (const auto& connection : connections_) {
-    if (connection->GetRoleName() == role_name &&
-        connection->GetElectionId() == primary_election_id) {
-      return primary_election_id.has_value();
-    }
+std::vector<SdnConnection*> SdnControllerManager::BackupConnections(
+    const RoleConnections& role) {
+  std::vector<SdnConnection*> backups;
+  backups.reserve(role.by_election_id.size() +
+                  role.without_election_id.size());
+  for (const auto& connection : role.by_election_id) {
+    if (connection.second != role.primary) backups.push_back(connection.second);
   }
-  return false;
+  for (SdnConnection* connection : role.without_election_id) {
+    backups.push_back(connection);
+  }
+  return backups;
+}
+
+bool SdnControllerManager::PrimaryConnectionExists(int role_id) {
+  return roles_[role_id].primary != nullptr;
 }
 
 void SdnControllerManager::SendArbitrationResponse(SdnConnection* connection) {
+  connection->SendStreamMessageResponse(ArbitrationResponse(*connection));
+}
+
+p4::v1::StreamMessageResponse SdnControllerManager::ArbitrationResponse(
+    const SdnConnection& connection) {
   p4::v1::StreamMessageResponse response;
   auto arbitration = response.mutable_arbitration();
 
@@ -317,14 +613,22 @@ void SdnControllerManager::SendArbitrationResponse(SdnConnection* connection) {
   arbitration->set_device_id(device_id_);
 
   // Populate the role only if the connection has set one.
-  if (connection->GetRoleName().has_value()) {
+  if (connection.GetRoleName().has_value()) {
     *arbitration->mutable_role()->mutable_name() =
-        connection->GetRoleName().value();
+        connection.GetRoleName().value();
   }
 
-  // Populate the election ID with the highest accepted value.
+  // Populate the election ID with the highest accepted value. After a restart
+  // that is the restored one, until a controller arbitrates past it.
   absl::optional<absl::uint128> primary_election_id =
-      election_id_past_by_role_[connection->GetRoleName()];
+      election_id_past_by_role_[connection.GetRoleName()];
+  auto election_id_floor =
+      election_id_floor_by_role_.find(connection.GetRoleName());
+  if (election_id_floor != election_id_floor_by_role_.end() &&
+      (!primary_election_id.has_value() ||
+       *primary_election_id < election_id_floor->second)) {
+    primary_election_id = election_id_floor->second;
+  }
   if (primary_election_id.has_value()) {
     arbitration->mutable_election_id()->set_high(
         absl::Uint128High64(primary_election_id.value()));
@@ -334,9 +638,9 @@ void SdnControllerManager::SendArbitrationResponse(SdnConnection* connection) {
 
   // Update connection status for the arbitration response.
   auto status = arbitration->mutable_status();
-  if (PrimaryConnectionExists(connection->GetRoleName())) {
+  if (PrimaryConnectionExists(connection.GetRoleId())) {
     // has primary connection.
-    if (primary_election_id == connection->GetElectionId()) {
+    if (primary_election_id == connection.GetElectionId()) {
       // and this connection is it.
       status->set_code(grpc::StatusCode::OK);
       status->set_message("you are the primary connection.");
@@ -352,40 +656,199 @@ void SdnControllerManager::SendArbitrationResponse(SdnConnection* connection) {
     status->set_message(
         "you are a backup connection, and NO primary connection exists.");
   }
-  connection->SendStreamMessageResponse(response);
+  return response;
+}
+
+std::vector<p4::v1::MasterArbitrationUpdate>
+SdnControllerManager::ElectionIds() {
+  TimedMutexLock l(&lock_, lock_hold_time_);
+  // Floors nobody arbitrated past yet are kept for the next restart.
+  absl::flat_hash_map<absl::optional<std::string>, absl::uint128> highest =
+      election_id_floor_by_role_;
+  for (const auto& election_id_past : election_id_past_by_role_) {
+    if (!election_id_past.second.has_value()) continue;
+    absl::uint128& election_id = highest[election_id_past.first];
+    election_id = std::max(election_id, *election_id_past.second);
+  }
+  std::vector<p4::v1::MasterArbitrationUpdate> election_ids;
+  for (const auto& role_election_id : highest) {
+    p4::v1::MasterArbitrationUpdate election_id;
+    election_id.set_device_id(device_id_);
+    if (role_election_id.first.has_value()) {
+      election_id.mutable_role()->set_name(*role_election_id.first);
+    }
+    election_id.mutable_election_id()->set_high(
+        absl::Uint128High64(role_election_id.second));
+    election_id.mutable_election_id()->set_low(
+        absl::Uint128Low64(role_election_id.second));
+    election_ids.push_back(std::move(election_id));
+  }
+  // Sorted, so the same election IDs always give the same snapshot.
+  std::sort(election_ids.begin(), election_ids.end(),
+            [](const p4::v1::MasterArbitrationUpdate& a,
+               const p4::v1::MasterArbitrationUpdate& b) {
+              return std::make_pair(a.has_role(), a.role().name()) <
+                     std::make_pair(b.has_role(), b.role().name());
+            });
+  return election_ids;
+}
+
+void SdnControllerManager::RestoreElectionIds(
+    const std::vector<p4::v1::MasterArbitrationUpdate>& election_ids) {
+  TimedMutexLock l(&lock_, lock_hold_time_);
+  for (const auto& election_id : election_ids) {
+    absl::optional<std::string> role_name;
+    if (election_id.has_role()) role_name = election_id.role().name();
+    absl::uint128 restored = absl::MakeUint128(
+        election_id.election_id().high(), election_id.election_id().low());
+    absl::uint128& election_id_floor = election_id_floor_by_role_[role_name];
+    election_id_floor = std::max(election_id_floor, restored);
+  }
+}
+
+void SdnControllerManager::PublishPrimaryElectionIds() {
+  auto primary_election_ids = std::make_shared<PrimaryElectionIds>();
+  primary_election_ids->role_ids = role_ids_;
+  primary_election_ids->election_id_past.resize(roles_.size());
+  for (size_t role_id = 0; role_id < roles_.size(); ++role_id) {
+    primary_election_ids->role_metrics.push_back(roles_[role_id].metrics);
+    primary_election_ids->rate_limiters.push_back(
+        roles_[role_id].rate_limiter.get());
+    auto election_id_past =
+        election_id_past_by_role_.find(roles_[role_id].role_name);
+    if (election_id_past != election_id_past_by_role_.end()) {
+      primary_election_ids->election_id_past[role_id] =
+          election_id_past->second;
+    }
+  }
+  primary_election_ids_.Store(std::move(primary_election_ids));
 }
 
 bool SdnControllerManager::SendStreamMessageToPrimary(
     const absl::optional<std::string>& role_name,
     const p4::v1::StreamMessageResponse& response) {
-  absl::MutexLock l(&lock_);
+  TimedMutexLock l(&lock_, lock_hold_time_);
+  // Roles that were never seen have no primary connection, nor metrics.
+  auto role_id = role_ids_.find(role_name);
+  if (role_id == role_ids_.end()) return false;
+  const RoleConnections& role = roles_[role_id->second];
+
+  bool sent = role.primary != nullptr &&
+              role.primary->SendStreamMessageResponse(response);
+  if (sent) {
+    role.metrics.responses_sent->Increment();
+  } else {
+    role.metrics.responses_dropped->Increment();
+  }
+  return sent;
+}
 
-  // Get the primary election ID for the controller role.
-  absl::optional<absl::uint128> primary_election_id =
-      election_id_past_by_role_[role_name];
+int SdnControllerManager::SendStreamMessagesToPrimary(
+    const absl::optional<std::string>& role_name,
+    std::vector<p4::v1::StreamMessageResponse> responses) {
+  TimedMutexLock l(&lock_, lock_hold_time_);
+  // Roles that were never seen have no primary connection, nor metrics.
+  auto role_id = role_ids_.find(role_name);
+  if (role_id == role_ids_.end()) return 0;
+  const RoleConnections& role = roles_[role_id->second];
+
+  int num_responses = responses.size();
+  int sent = role.primary == nullptr
+                 ? 0
+                 : role.primary->SendStreamMessageResponses(
+                       std::move(responses));
+  role.metrics.responses_sent->Increment(sent);
+  if (sent < num_responses) {
+    role.metrics.responses_dropped->Increment(num_responses - sent);
+  }
+  return sent;
+}
 
-  // If there is no election ID set, then there is no primary connection.
-  if (!primary_election_id.has_value()) return false;
+PacketInResult SdnControllerManager::SendPacketInsToPrimary(
+    const absl::optional<std::string>& role_name,
+    std::vector<OutboundResponse> packets,
+    absl::Span<const int> priorities) {
+  PacketInResult result;
+  TimedMutexLock l(&lock_, lock_hold_time_);
+  // Roles that were never seen have no primary connection, nor metrics.
+  auto role_id = role_ids_.find(role_name);
+  if (role_id == role_ids_.end()) {
+    result.no_primary = packets.size();
+    return result;
+  }
+  const RoleConnections& role = roles_[role_id->second];
 
-  // Otherwise find the primary connection.
-  SdnConnection* primary_connection = nullptr;
-  for (const auto& connection : connections_) {
-    if (connection->GetRoleName() == role_name &&
-        connection->GetElectionId() == primary_election_id) {
-      primary_connection = connection;
+  if (role.primary == nullptr) {
+    result.no_primary = packets.size();
+    role.metrics.packet_ins_no_primary->Increment(result.no_primary);
+    return result;
+  }
+
+  int rate_limited = 0;
+  std::vector<int> admitted_priorities;
+  if (role.rate_limiter->limits_packet_ins()) {
+    admitted_priorities.assign(priorities.begin(), priorities.end());
+    rate_limited =
+        role.rate_limiter->AdmitPacketIns(&packets, &admitted_priorities);
+    priorities = admitted_priorities;
+  }
+  if (!packets.empty()) {
+    std::vector<SdnConnection*> backups;
+    if (mirror_packet_ins_) backups = BackupConnections(role);
+    if (!backups.empty()) {
+      // The primary and every backup share one copy of each packet.
+      for (auto& packet : packets) packet = std::move(packet).Share();
+      for (SdnConnection* backup : backups) {
+        role.metrics.packet_ins_mirrored->Increment(
+            backup->SendPacketIns(packets, priorities).queued);
+      }
     }
+    result = role.primary->SendPacketIns(std::move(packets), priorities);
   }
+  result.rate_limited = rate_limited;
+  role.metrics.packet_ins_queued->Increment(result.queued);
+  if (result.rate_limited > 0) {
+    role.metrics.packet_ins_rate_limited->Increment(result.rate_limited);
+  }
+  if (result.overflow > 0) {
+    role.metrics.packet_ins_overflow->Increment(result.overflow);
+  }
+  if (result.evicted > 0) {
+    role.metrics.packet_ins_evicted->Increment(result.evicted);
+  }
+  return result;
+}
 
-  if (primary_connection == nullptr) {
-    LOG(ERROR) << "Found an election ID '"
-               << PrettyPrintElectionId(primary_election_id)
-               << "' for the primary connection, but could not find the "
-               << "connection itself?";
-    return false;
+StreamRateLimiter::PacketOutAdmission SdnControllerManager::AdmitPacketOut(
+    const SdnConnection& connection) {
+  auto primary_election_ids = primary_election_ids_.Load();
+  int role_id = connection.GetRoleId();
+  if (role_id < 0 ||
+      static_cast<size_t>(role_id) >=
+          primary_election_ids->rate_limiters.size()) {
+    return StreamRateLimiter::PacketOutAdmission::kAdmitted;
   }
+  auto admission =
+      primary_election_ids->rate_limiters[role_id]->AdmitPacketOut();
+  if (admission != StreamRateLimiter::PacketOutAdmission::kAdmitted) {
+    primary_election_ids->role_metrics[role_id]
+        .packet_outs_rate_limited->Increment();
+  }
+  return admission;
+}
 
-  primary_connection->SendStreamMessageResponse(response);
-  return true;
+void SdnControllerManager::RecordPacketOuts(const SdnConnection& connection,
+                                            int packets, int errors) {
+  auto primary_election_ids = primary_election_ids_.Load();
+  int role_id = connection.GetRoleId();
+  if (role_id < 0 ||
+      static_cast<size_t>(role_id) >=
+          primary_election_ids->role_metrics.size()) {
+    return;
+  }
+  const RoleMetrics& metrics = primary_election_ids->role_metrics[role_id];
+  metrics.packet_outs->Increment(packets);
+  if (errors > 0) metrics.packet_out_errors->Increment(errors);
 }
 
 }  // namespace p4rt_app
@@ -8,20 +8,75 @@
 #ifndef _SDN_CONTROLLER_MANAGER_H_
 #define _SDN_CONTROLLER_MANAGER_H_
 
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "outbound_response.h"
+#include "packet_in_queue.h"
+#include "rate_limiter.h"
+#include "rcu_ptr.h"
+
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/numeric/int128.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "p4/v1/p4runtime.grpc.pb.h"
 #include "p4/v1/p4runtime.pb.h"
 
 namespace p4rt_server{
 
+// Metrics shared by every connection of a server. Null metrics are not
+// recorded.
+struct StreamMetrics {
+  // Responses dropped because the outbound queue was full, or because the
+  // stream could no longer be written to.
+  Counter* dropped_queue_full = nullptr;
+  Counter* dropped_write_failed = nullptr;
+  // Responses queued on all connections.
+  Gauge* outbound_queue_depth = nullptr;
+};
+
 // A connection between a controller and p4rt server.
+//
+// Responses are not written to the gRPC stream by the caller. They are queued
+// on a bounded per-connection queue and written by a dedicated writer thread,
+// so a slow controller never blocks the thread sending the response (typically
+// while holding the SdnControllerManager lock).
+//
+// PacketIns have a queue of their own (see PacketInQueue), so a PacketIn storm
+// can neither delay nor push out arbitration updates and errors.
 class SdnConnection {
  public:
+  // Maximum number of responses waiting to be written to a controller. Once
+  // the limit is reached new responses are dropped.
+  static constexpr int kDefaultMaxOutboundQueueSize = 1024;
+
+  // Maximum number of PacketIns the writer thread takes out of the PacketIn
+  // queue at once. Keeps the rest subject to the overflow policy while the
+  // batch is written.
+  static constexpr int kPacketInWriteBatchSize = 64;
+
   SdnConnection(grpc::ServerContext* context,
                 grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
-                                         p4::v1::StreamMessageRequest>* stream)
-      : initialized_(false), grpc_context_(context), grpc_stream_(stream) {}
+                                         p4::v1::StreamMessageRequest>* stream,
+                int max_outbound_queue_size = kDefaultMaxOutboundQueueSize,
+                const StreamMetrics& metrics = StreamMetrics(),
+                const PacketInQueue::Options& packet_in_options =
+                    PacketInQueue::Options());
+
+  // Writes any queued responses and stops the writer thread. The gRPC stream
+  // must still be open.
+  virtual ~SdnConnection();
+
+  SdnConnection(const SdnConnection&) = delete;
+  SdnConnection& operator=(const SdnConnection&) = delete;
 
   void Initialize() { initialized_ = true; }
   bool IsInitialized() const { return initialized_; }
@@ -30,12 +85,63 @@ class SdnConnection {
   absl::optional<absl::uint128> GetElectionId() const;
 
   void SetRoleName(const absl::optional<std::string>& name);
-  absl::optional<std::string> GetRoleName() const;
+  const absl::optional<std::string>& GetRoleName() const;
 
-  // Sends back StreamMessageResponse to this controller.
-  void SendStreamMessageResponse(const p4::v1::StreamMessageResponse& response);
+  // Interned ID of the role name, assigned by the SdnControllerManager during
+  // arbitration. Lets per-packet lookups avoid hashing the role name.
+  void SetRoleId(int id) { role_id_ = id; }
+  int GetRoleId() const { return role_id_; }
+
+  const StreamMetrics& metrics() const { return metrics_; }
+
+  // Queues a StreamMessageResponse for this controller. Never blocks on the
+  // gRPC stream. Returns false if the response was dropped because the queue
+  // is full or the stream can no longer be written to.
+  virtual bool SendStreamMessageResponse(
+      const p4::v1::StreamMessageResponse& response)
+      ABSL_LOCKS_EXCLUDED(outbound_lock_);
+
+  // Queues a batch of responses, in order, with a single lock acquisition.
+  // Returns how many were queued; the tail of the batch is dropped if the
+  // queue fills up.
+  virtual int SendStreamMessageResponses(
+      std::vector<p4::v1::StreamMessageResponse> responses)
+      ABSL_LOCKS_EXCLUDED(outbound_lock_);
+
+  // Queues a response that is also sent to other connections, without
+  // copying it. Connections that are not backed by a synchronous gRPC stream
+  // and do not override this are sent a copy with SendStreamMessageResponse.
+  virtual bool SendSharedStreamMessageResponse(
+      std::shared_ptr<const SharedStreamResponse> response)
+      ABSL_LOCKS_EXCLUDED(outbound_lock_);
+
+  // Queues responses carrying PacketIns on the PacketIn queue. priorities[i]
+  // is the priority of packets[i], or empty for all 0. Never blocks; packets
+  // the queue cannot take are dropped according to its overflow policy.
+  virtual PacketInResult SendPacketIns(std::vector<OutboundResponse> packets,
+                                       absl::Span<const int> priorities)
+      ABSL_LOCKS_EXCLUDED(outbound_lock_);
+
+ protected:
+  // Used by connections that are not backed by a synchronous gRPC stream (e.g.
+  // the AsyncP4RtServer). Such connections must override
+  // SendStreamMessageResponse, SendStreamMessageResponses and SendPacketIns,
+  // and no writer thread is started.
+  explicit SdnConnection(grpc::ServerContext* context,
+                         const StreamMetrics& metrics = StreamMetrics())
+      : initialized_(false), grpc_context_(context), grpc_stream_(nullptr),
+        max_outbound_queue_size_(0), packet_ins_(PacketInQueue::Options()),
+        metrics_(metrics) {}
 
  private:
+  // Queues responses on outbound_queue_. Returns how many were queued.
+  int QueueResponses(std::vector<OutboundResponse> responses)
+      ABSL_LOCKS_EXCLUDED(outbound_lock_);
+
+  // Drains outbound_queue_ and packet_ins_ into grpc_stream_ until the
+  // connection is closed.
+  void WriteOutboundResponses() ABSL_LOCKS_EXCLUDED(outbound_lock_);
+
   // The SDN connection should be initialized through arbitration before it can
   // be used.
   bool initialized_;
@@ -45,6 +151,7 @@ class SdnConnection {
   // If no role is specified then the connection is assumed to be root, and has
   // access to all tables.
   absl::optional<std::string> role_name_;
+  int role_id_ = -1;
 
   // Multiple connections can be established per role, but only one connection
   // (i.e. the primary connection) is allowed to modify state. The primary
@@ -57,12 +164,45 @@ class SdnConnection {
   grpc::ServerReaderWriter<p4::v1::StreamMessageResponse,
                            p4::v1::StreamMessageRequest>*
       grpc_stream_;  // not owned.
+
+  // Responses waiting for the writer thread. Only the writer thread touches
+  // grpc_stream_ for writing.
+  absl::Mutex outbound_lock_;
+  std::deque<OutboundResponse> outbound_queue_ ABSL_GUARDED_BY(outbound_lock_);
+  const int max_outbound_queue_size_;
+  PacketInQueue packet_ins_ ABSL_GUARDED_BY(outbound_lock_);
+  int64_t dropped_responses_ ABSL_GUARDED_BY(outbound_lock_) = 0;
+  bool closed_ ABSL_GUARDED_BY(outbound_lock_) = false;
+  bool write_failed_ ABSL_GUARDED_BY(outbound_lock_) = false;
+  const StreamMetrics metrics_;
+  std::thread writer_;
 };
 
 class SdnControllerManager {
  public:
+  // Returns the stream rate limits of a role. Called once per role, when the
+  // role is first seen, while holding lock_.
+  using RateLimitsForRole =
+      std::function<StreamRateLimits(const absl::optional<std::string>&)>;
+
   // TODO: Set device ID through gNMI.
-  SdnControllerManager() : device_id_(183807201) {}
+  //
+  // With mirror_packet_ins every PacketIn sent to the primary connection of a
+  // role is also sent to the backup connections of the role, e.g. read-only
+  // monitoring sessions. The connections share one copy, and one
+  // serialization, of each PacketIn.
+  //
+  // Arbitration updates for a device other than device_id are rejected. If
+  // it is not set, the device ID of the last arbitration update is used.
+  explicit SdnControllerManager(std::shared_ptr<MetricsRegistry> metrics =
+                                    std::make_shared<MetricsRegistry>(),
+                                RateLimitsForRole rate_limits = nullptr,
+                                bool mirror_packet_ins = false,
+                                absl::optional<uint64_t> device_id =
+                                    absl::nullopt);
+
+  // Metrics to hand to every new SdnConnection.
+  const StreamMetrics& stream_metrics() const { return stream_metrics_; }
 
   grpc::Status HandleArbitrationUpdate(
       const p4::v1::MasterArbitrationUpdate& update, SdnConnection* controller)
@@ -72,59 +212,208 @@ class SdnControllerManager {
   void Disconnect(SdnConnection* connection) ABSL_LOCKS_EXCLUDED(lock_);
   // G3_WARN ABSL_EXCLUSIVE_LOCKS_REQUIRED(P4RuntimeImpl::server_state_lock_);
 
+  // The highest election ID accepted for every role that had a primary
+  // connection, one arbitration update per role, e.g. to persist across
+  // restarts.
+  std::vector<p4::v1::MasterArbitrationUpdate> ElectionIds()
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Restores the highest accepted election ID of every role, e.g. saved
+  // before a restart, as a floor for the next election: a connection only
+  // becomes primary with an election ID at least as high, and arbitration
+  // responses report it as the highest election ID until then. The restored
+  // IDs do not make a primary, so no request is allowed until a controller
+  // arbitrates again.
+  void RestoreElectionIds(
+      const std::vector<p4::v1::MasterArbitrationUpdate>& election_ids)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Only the primary connection of a role may modify state. This runs for
+  // every Write, SetForwardingPipelineConfig and PacketOut, so it never takes
+  // lock_ and instead reads the latest published election snapshot.
   grpc::Status AllowRequest(const absl::optional<std::string>& role_name,
                             const absl::optional<absl::uint128>& election_id)
       ABSL_LOCKS_EXCLUDED(lock_);
 
+  // Same as above for requests received on the connection's own stream (e.g.
+  // PacketOuts). Looks the role up by its interned ID.
+  grpc::Status AllowRequest(const SdnConnection& connection)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
   grpc::Status AllowRequest(const p4::v1::WriteRequest& request);
   grpc::Status AllowRequest(
       const p4::v1::SetForwardingPipelineConfigRequest& request);
 
+  // Queues the response on the primary connection for the role. Returns false
+  // if there is no primary connection, or its outbound queue is full.
   bool SendStreamMessageToPrimary(const absl::optional<std::string>& role_name,
                                   const p4::v1::StreamMessageResponse& response)
       ABSL_LOCKS_EXCLUDED(lock_);
 
+  // Queues a batch of responses on the primary connection for the role, with
+  // one lookup for the whole batch. Returns how many responses were queued.
+  int SendStreamMessagesToPrimary(
+      const absl::optional<std::string>& role_name,
+      std::vector<p4::v1::StreamMessageResponse> responses)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Queues PacketIns on the PacketIn queue of the primary connection for the
+  // role, after dropping those over the rate limits of the role. priorities[i]
+  // is the priority of packets[i], or empty for all 0.
+  PacketInResult SendPacketInsToPrimary(
+      const absl::optional<std::string>& role_name,
+      std::vector<OutboundResponse> packets,
+      absl::Span<const int> priorities) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Applies the PacketOut rate limit of the connection's role to one
+  // PacketOut. Never takes lock_.
+  StreamRateLimiter::PacketOutAdmission AdmitPacketOut(
+      const SdnConnection& connection) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Counts PacketOuts received on the connection, and how many of them the
+  // switch provider failed to send, under the connection's role. Never takes
+  // lock_.
+  void RecordPacketOuts(const SdnConnection& connection, int packets,
+                        int errors) ABSL_LOCKS_EXCLUDED(lock_);
+
  private:
-    // Goes through the current list of active connections, and determines if
-  // there has been a change to the primary connection. If there is a change to
-  // the primary connection it will return true. Otherwise it will return false.
+  // Counters of one role, labeled with the role name.
+  struct RoleMetrics {
+    Counter* arbitration_updates;
+    Counter* primary_changes;
+    // Responses sent with SendStreamMessage(s)ToPrimary (PacketIns, digests,
+    // ...), and those dropped because there was no primary connection or its
+    // queue was full.
+    Counter* responses_sent;
+    Counter* responses_dropped;
+    Counter* packet_outs;
+    Counter* packet_out_errors;
+    // PacketIns sent with SendPacketInsToPrimary, by PacketInResult field.
+    Counter* packet_ins_queued;
+    Counter* packet_ins_no_primary;
+    Counter* packet_ins_overflow;
+    Counter* packet_ins_evicted;
+    Counter* packet_ins_rate_limited;
+    // PacketIns queued on backup connections by mirror_packet_ins.
+    Counter* packet_ins_mirrored;
+    Counter* packet_outs_rate_limited;
+  };
+
+  // Arbitration state of the active connections for one role.
+  struct RoleConnections {
+    RoleConnections(const absl::optional<std::string>& name,
+                    const RoleMetrics& role_metrics,
+                    std::unique_ptr<StreamRateLimiter> limiter)
+        : role_name(name), metrics(role_metrics),
+          rate_limiter(std::move(limiter)) {}
+
+    absl::optional<std::string> role_name;
+    RoleMetrics metrics;
+    std::unique_ptr<StreamRateLimiter> rate_limiter;
+
+    // Connections that have an election ID, keyed by it. Election IDs are
+    // unique within a role, so the last entry is the connection with the
+    // highest election ID.
+    std::map<absl::uint128, SdnConnection*> by_election_id;
+
+    // Connections without an election ID. These can never be primary.
+    absl::flat_hash_set<SdnConnection*> without_election_id;
+
+    // The connection whose election ID matches the election_id_past for the
+    // role, or nullptr if that connection is not active. Every other
+    // connection of the role is a backup.
+    SdnConnection* primary = nullptr;
+  };
+
+  // Published arbitration state read by AllowRequest without taking lock_.
+  struct PrimaryElectionIds {
+    // See role_ids_.
+    absl::flat_hash_map<absl::optional<std::string>, int> role_ids;
+    // The election_id_past for each role, indexed by role ID.
+    std::vector<absl::optional<absl::uint128>> election_id_past;
+    // The metrics and rate limiters of each role, indexed by role ID. Roles
+    // are never removed, so the rate limiters outlive every snapshot.
+    std::vector<RoleMetrics> role_metrics;
+    std::vector<StreamRateLimiter*> rate_limiters;
+  };
+
+  static grpc::Status AllowRequest(
+      const PrimaryElectionIds& primary_election_ids, int role_id,
+      const absl::optional<absl::uint128>& election_id);
+
+  // Returns the ID for the role name, and allocates state for the role the
+  // first time it is seen.
+  int InternRoleId(const absl::optional<std::string>& role_name)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Adds or removes an initialized connection from the state of its role.
+  void AddConnection(SdnConnection* connection)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void RemoveConnection(SdnConnection* connection)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Recomputes the cached primary connection of a role. Must be called after
+  // the election_id_past or the active connections of the role change.
+  void RefreshPrimaryConnection(int role_id)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Goes through the active connections of a role, and determines if there has
+  // been a change to the primary connection. If there is a change to the
+  // primary connection it will return true. Otherwise it will return false.
   //
   // If the election_id argument equals the `election_id_past` for the role this
   // methods will return true (e.g. if the primary connection was disconneded
   // and is now reconnecting). If the current primary connection sends an
   // update, without changing its election ID, this method should NOT be called.
   bool UpdateToPrimaryConnectionState(
-      const absl::optional<std::string>& role_name,
-      const absl::optional<absl::uint128>& election_id)
+      int role_id, const absl::optional<absl::uint128>& election_id)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
-  // Goes through the current list of active connections, and returns if one of
-  // them is currently the primary.
-  bool PrimaryConnectionExists(const absl::optional<std::string>& role_name)
+  // Returns if one of the active connections of a role is currently the
+  // primary.
+  bool PrimaryConnectionExists(int role_id)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
   // Sends an arbitration update to all active connections for a role about the
   // current primary connection.
-  void InformConnectionsAboutPrimaryChange(
-      const absl::optional<std::string>& role_name)
+  void InformConnectionsAboutPrimaryChange(int role_id)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
   // Sends an arbitration update to a specific connection.
   void SendArbitrationResponse(SdnConnection* connection)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  p4::v1::StreamMessageResponse ArbitrationResponse(
+      const SdnConnection& connection) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
-  // Lock for protecting SdnControllerManager member fields.
+  // Every connection of a role except its primary.
+  std::vector<SdnConnection*> BackupConnections(const RoleConnections& role)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Publishes role_ids_ and election_id_past_by_role_ for AllowRequest. Must
+  // be called whenever election_id_past_by_role_ changes.
+  void PublishPrimaryElectionIds() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  const std::shared_ptr<MetricsRegistry> metrics_;
+  const RateLimitsForRole rate_limits_for_role_;
+  const bool mirror_packet_ins_;
+  const StreamMetrics stream_metrics_;
+  Counter* const arbitration_errors_;
+  // How long lock_ is held, which bounds how long a PacketIn waits for it.
+  Histogram* const lock_hold_time_;
+
+  // Lock for protecting SdnControllerManager member fields. Acquired with
+  // TimedMutexLock.
   absl::Mutex lock_;
 
   // Device ID is used to ensure all requests are connecting to the intended
-  // place.
+  // place. Only checked if it was passed to the constructor.
+  const bool device_id_fixed_;
   uint64_t device_id_;
 
-  // We maintain a list of all active connections. The P4 runtime spec requires
-  // a number of edge cases based on values existing or not that makes
-  // maintaining these connections any other container difficult. However, we
-  // don't expect a large number of connections so performance shouldn't be
-  // affected.
+  // Active connections are indexed by role, so that finding the primary
+  // connection of a role (e.g. for every PacketIn) does not depend on the
+  // number of backup connections. The P4 runtime spec requires a number of edge
+  // cases based on values existing or not:
   //
   // Requirements for roles:
   //  * Each role can have it's own set of primary & backup connections.
@@ -136,7 +425,12 @@ class SdnControllerManager {
   //  * If no election ID is given (NOTE: different than 0) the connection is
   //    valid, but it cannot ever be primary (i.e. the controller can force a
   //    connection to be a backup).
-  std::vector<SdnConnection*> connections_ ABSL_GUARDED_BY(lock_);
+  //
+  // Role names are interned: role_ids_ maps every role name that has been
+  // seen to an index into roles_. Roles are never removed.
+  absl::flat_hash_map<absl::optional<std::string>, int> role_ids_
+      ABSL_GUARDED_BY(lock_);
+  std::vector<RoleConnections> roles_ ABSL_GUARDED_BY(lock_);
 
   // We maintain a map of the highest election IDs that have been selected for
   // the primary connection of a role. Once an election ID is set all new
@@ -149,6 +443,16 @@ class SdnControllerManager {
   absl::flat_hash_map<absl::optional<std::string>,
                       absl::optional<absl::uint128>>
       election_id_past_by_role_ ABSL_GUARDED_BY(lock_);
+
+  // Election IDs restored by RestoreElectionIds. A connection of the role
+  // needs an election ID at least this high to become primary.
+  absl::flat_hash_map<absl::optional<std::string>, absl::uint128>
+      election_id_floor_by_role_ ABSL_GUARDED_BY(lock_);
+
+  // Immutable snapshot of role_ids_ and election_id_past_by_role_, replaced as
+  // a whole on arbitration changes. Readers never block arbitration, writers
+  // store it while holding lock_.
+  RcuPtr<PrimaryElectionIds> primary_election_ids_;
 };
 
 }  // namespace p4rt_app
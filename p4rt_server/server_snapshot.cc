@@ -0,0 +1,211 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "server_snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <utility>
+
+#include "absl/strings/strip.h"
+#include "glog/logging.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "gutil/io.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+namespace {
+
+   using ::google::protobuf::internal::WireFormatLite;
+
+   // Changes whenever the format does.
+   constexpr absl::string_view kMagic = "p4rt-server-snapshot-1\n";
+
+   // Field numbers of the snapshot.
+   enum Field {
+     kPipelineConfig = 1,
+     kTableEntries = 2,
+     kElectionId = 3,
+   };
+
+   void WriteMessage(int field, const google::protobuf::Message& message,
+                     google::protobuf::io::CodedOutputStream* output) {
+     output->WriteTag(WireFormatLite::MakeTag(
+         field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+     output->WriteVarint32(message.ByteSizeLong());
+     message.SerializeWithCachedSizes(output);
+   }
+
+   bool ReadMessage(google::protobuf::io::CodedInputStream* input,
+                    google::protobuf::Message* message) {
+     uint32_t size;
+     if (!input->ReadVarint32(&size)) return false;
+     auto limit = input->PushLimit(size);
+     bool parsed = message->ParseFromCodedStream(input) &&
+                   input->ConsumedEntireMessage();
+     input->PopLimit(limit);
+     return parsed;
+   }
+
+   // Replaces the file atomically with the data. The data is on disk before
+   // the rename, and the rename before we return, so after a crash the path
+   // holds either the previous snapshot or the complete new one.
+   absl::Status ReplaceFile(const std::string& data, const std::string& path) {
+     std::string temporary_path = path + ".tmp";
+     RETURN_IF_ERROR(gutil::WriteFileAndSync(data, temporary_path));
+     if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+       return gutil::InternalErrorBuilder()
+              << "Cannot replace snapshot " << path << ".";
+     }
+     std::string directory = ".";
+     std::string::size_type slash = path.rfind('/');
+     if (slash != std::string::npos) {
+       directory = path.substr(0, std::max<std::string::size_type>(slash, 1));
+     }
+     return gutil::SyncDirectory(directory);
+   }
+
+}  // namespace
+
+std::string ServerSnapshot::Serialize() const {
+  std::string data(kMagic);
+  {
+    google::protobuf::io::StringOutputStream stream(&data);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    if (pipeline_config.has_value()) {
+      WriteMessage(kPipelineConfig, *pipeline_config, &output);
+    }
+    for (const auto& chunk : table_entries) {
+      WriteMessage(kTableEntries, chunk, &output);
+    }
+    for (const auto& election_id : election_ids) {
+      WriteMessage(kElectionId, election_id, &output);
+    }
+  }
+  return data;
+}
+
+absl::StatusOr<ServerSnapshot> ServerSnapshot::Parse(absl::string_view data) {
+  if (!absl::ConsumePrefix(&data, kMagic)) {
+    return gutil::InvalidArgumentErrorBuilder()
+           << "Not a p4rt_server snapshot, or one of another version.";
+  }
+  google::protobuf::io::CodedInputStream input(
+      reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  input.SetTotalBytesLimit(std::numeric_limits<int>::max());
+  ServerSnapshot snapshot;
+  while (uint32_t tag = input.ReadTag()) {
+    bool parsed;
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    if (field >= kPipelineConfig && field <= kElectionId &&
+        WireFormatLite::GetTagWireType(tag) !=
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      field = 0;
+    }
+    switch (field) {
+      case kPipelineConfig:
+        snapshot.pipeline_config.emplace();
+        parsed = ReadMessage(&input, &*snapshot.pipeline_config);
+        break;
+      case kTableEntries:
+        snapshot.table_entries.emplace_back();
+        parsed = ReadMessage(&input, &snapshot.table_entries.back());
+        break;
+      case kElectionId:
+        snapshot.election_ids.emplace_back();
+        parsed = ReadMessage(&input, &snapshot.election_ids.back());
+        break;
+      case 0:
+        parsed = false;
+        break;
+      default:
+        // Written by a newer server; what we know is still valid.
+        parsed = WireFormatLite::SkipField(&input, tag);
+        break;
+    }
+    if (!parsed) {
+      return gutil::InvalidArgumentErrorBuilder()
+             << "Snapshot is truncated or corrupt.";
+    }
+  }
+  if (!input.ConsumedEntireMessage()) {
+    return gutil::InvalidArgumentErrorBuilder()
+           << "Snapshot is truncated or corrupt.";
+  }
+  return snapshot;
+}
+
+absl::Status WriteServerSnapshot(const ServerSnapshot& snapshot,
+                                 const std::string& path) {
+  return ReplaceFile(snapshot.Serialize(), path);
+}
+
+absl::StatusOr<ServerSnapshot> ReadServerSnapshot(const std::string& path) {
+  ASSIGN_OR_RETURN(gutil::MappedFile file, gutil::MapFile(path));
+  return ServerSnapshot::Parse(file.contents());
+}
+
+SnapshotWriter::SnapshotWriter(const WarmRestartOptions& options,
+                               TakeSnapshot take_snapshot)
+    : options_(options), take_snapshot_(std::move(take_snapshot)) {
+  if (options_.snapshot_interval > absl::ZeroDuration()) {
+    writer_ = std::thread([this]() { RunWriter(); });
+  }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  {
+    absl::MutexLock l(&lock_);
+    shutdown_ = true;
+  }
+  if (writer_.joinable()) writer_.join();
+  absl::Status status = Write();
+  if (!status.ok()) LOG(ERROR) << "Could not write snapshot: " << status;
+}
+
+absl::Status SnapshotWriter::Write() {
+  // Taken under the lock, so an older snapshot never replaces a newer one.
+  absl::MutexLock l(&write_lock_);
+  std::string data = take_snapshot_().Serialize();
+  if (data == last_written_) return absl::OkStatus();
+  RETURN_IF_ERROR(ReplaceFile(data, options_.snapshot_path));
+  last_written_ = std::move(data);
+  return absl::OkStatus();
+}
+
+void SnapshotWriter::RunWriter() {
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    auto stopped = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return shutdown_;
+    };
+    while (true) {
+      {
+        absl::MutexLock l(&lock_);
+        if (lock_.AwaitWithDeadline(absl::Condition(&stopped),
+                                    absl::Now() + options_.snapshot_interval)) {
+          return;
+        }
+      }
+      absl::Status status = Write();
+      if (!status.ok()) {
+        LOG_EVERY_N(WARNING, 10) << "Could not write snapshot: " << status;
+      }
+    }
+#ifdef __EXCEPTIONS
+  } catch (const std::exception& e) {
+    LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
+  } catch (...) {
+    LOG(FATAL) << "Unknown exception caught in " << __func__;
+  }
+#endif
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _SERVER_SNAPSHOT_H_
+#define _SERVER_SNAPSHOT_H_
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+struct WarmRestartOptions {
+  // Where the snapshot is kept. Empty disables warm restart.
+  std::string snapshot_path;
+  // How often the snapshot is written while serving; it is also written
+  // when the server shuts down. 0 only writes it on shutdown.
+  absl::Duration snapshot_interval = absl::Seconds(30);
+};
+
+// The state a restarted server needs to serve the pipeline the switch still
+// runs: the committed pipeline config, the installed table entries, and the
+// highest election ID accepted for every role.
+struct ServerSnapshot {
+  // Not set if no pipeline was committed.
+  absl::optional<p4::v1::ForwardingPipelineConfig> pipeline_config;
+  // Table entries of the entity store, in chunks.
+  std::vector<p4::v1::ReadResponse> table_entries;
+  // One per role: the role, unset for the default role, and its election ID.
+  std::vector<p4::v1::MasterArbitrationUpdate> election_ids;
+
+  // Compact binary form, the protobuf wire format of the fields behind a
+  // magic prefix.
+  std::string Serialize() const;
+  static absl::StatusOr<ServerSnapshot> Parse(absl::string_view data);
+};
+
+// Replaces the file atomically and durably, so a crash while writing keeps
+// the previous snapshot, and one after it keeps the new one.
+absl::Status WriteServerSnapshot(const ServerSnapshot& snapshot,
+                                 const std::string& path);
+
+// Returns NOT_FOUND if there is no snapshot.
+absl::StatusOr<ServerSnapshot> ReadServerSnapshot(const std::string& path);
+
+// Writes the snapshot returned by take_snapshot every snapshot_interval, if
+// it changed, and once more on destruction.
+class SnapshotWriter {
+ public:
+  using TakeSnapshot = std::function<ServerSnapshot()>;
+
+  SnapshotWriter(const WarmRestartOptions& options, TakeSnapshot take_snapshot);
+  ~SnapshotWriter();
+
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+  // Takes and writes a snapshot now.
+  absl::Status Write() ABSL_LOCKS_EXCLUDED(write_lock_);
+
+ private:
+  void RunWriter();
+
+  const WarmRestartOptions options_;
+  const TakeSnapshot take_snapshot_;
+
+  // Held while a snapshot is taken and written, so snapshots reach the file
+  // in the order they were taken. Writes that would not change the file are
+  // skipped.
+  absl::Mutex write_lock_;
+  std::string last_written_ ABSL_GUARDED_BY(write_lock_);
+
+  absl::Mutex lock_;
+  bool shutdown_ ABSL_GUARDED_BY(lock_) = false;
+  std::thread writer_;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _SERVER_SNAPSHOT_H_
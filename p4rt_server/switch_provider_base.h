@@ -8,12 +8,30 @@
 #ifndef SWITCH_PROVIDER_BASE_
 #define SWITCH_PROVIDER_BASE_
 
+#include "admission_controller.h"
+#include "counter_cache.h"
+#include "digest_manager.h"
+#include "entity_store.h"
+#include "p4info_index.h"
+#include "packet_out_dispatcher.h"
+#include "pipeline_diff.h"
+#include "rate_limiter.h"
+#include "rcu_ptr.h"
+#include "read_query.h"
 #include "sdn_controller_manager.h"
+#include "server_snapshot.h"
+#include "tracing.h"
+#include "write_group_committer.h"
 
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "p4/v1/p4runtime.grpc.pb.h"
 
 /*
@@ -27,13 +45,98 @@ namespace switch_provider{
   class SwitchProviderBase{
     private:
       std::shared_ptr<p4rt_server::SdnControllerManager> controller_manager_;
+      std::shared_ptr<p4rt_server::DigestManager> digest_manager_;
+      p4rt_server::RcuPtr<p4rt_server::P4InfoIndex> p4info_index_;
     protected:
       /*
-       * SwitchProviderBase::SendPacketIn 
-       * Provided for subclass to send PacketIns to the P4Runtime Controller Application
+       * SwitchProviderBase::TrySendPacketIns
+       * Provided for subclass to send a burst of PacketIns to the primary
+       * P4Runtime Controller application of a role (absl::nullopt for the
+       * default role). The packets are moved, not copied, onto the bounded
+       * PacketIn queue of the primary connection, which is looked up and
+       * locked once for the whole batch. The responses of a batch share one
+       * arena, freed once the last of them is written or dropped. Never blocks on a slow controller:
+       * packets that do not fit are dropped according to PacketInQueueOptions
+       * and PacketInPriority, and the result says what happened to them.
+       */
+      p4rt_server::PacketInResult TrySendPacketIns(
+          const absl::optional<std::string>& role_name,
+          std::vector<p4::v1::PacketIn> packets){
+        std::vector<int> priorities(packets.size());
+        for (size_t i = 0; i < packets.size(); ++i) {
+          priorities[i] = PacketInPriority(packets[i]);
+        }
+        return controller_manager_->SendPacketInsToPrimary(
+            role_name, p4rt_server::PacketInResponses(std::move(packets)),
+            priorities);
+      }
+
+      /*
+       * SwitchProviderBase::TrySendPacketIn
+       * Sends a single PacketIn, see TrySendPacketIns.
+       */
+      p4rt_server::PacketInResult TrySendPacketIn(
+          const absl::optional<std::string>& role_name,
+          p4::v1::PacketIn packet){
+        std::vector<p4::v1::PacketIn> packets(1);
+        packets[0].Swap(&packet);
+        return TrySendPacketIns(role_name, std::move(packets));
+      }
+
+      /*
+       * SwitchProviderBase::SendPacketIns
+       * Same as TrySendPacketIns, returns the number of packets queued for
+       * the controller.
+       */
+      int SendPacketIns(const absl::optional<std::string>& role_name,
+                        std::vector<p4::v1::PacketIn> packets){
+        return TrySendPacketIns(role_name, std::move(packets)).queued;
+      }
+
+      /*
+       * SwitchProviderBase::SendPacketIn
+       * Sends a single PacketIn, see SendPacketIns.
+       */
+      bool SendPacketIn(const absl::optional<std::string>& role_name,
+                        p4::v1::PacketIn packet){
+        return TrySendPacketIn(role_name, std::move(packet)).queued == 1;
+      }
+
+      /*
+       * SwitchProviderBase::SendPacketIn
+       * Deprecated: use SendPacketIns. An empty role_name is the default role.
        */
       void SendPacketIn (std::string role_name, std::shared_ptr<p4::v1::StreamMessageResponse> response){
-        controller_manager_->SendStreamMessageToPrimary(role_name, *response);
+        absl::optional<std::string> role;
+        if (!role_name.empty()) role = std::move(role_name);
+        if (response->has_packet()) {
+          TrySendPacketIn(role, response->packet());
+          return;
+        }
+        controller_manager_->SendStreamMessageToPrimary(role, *response);
+      }
+
+      /*
+       * SwitchProviderBase::SendDigests
+       * Provided for subclass to report digest data (e.g. learned MACs) of a
+       * digest. p4rt_server batches the data into DigestLists according to
+       * the DigestEntry written by the controller, and suppresses data that
+       * is still waiting for the controller's ack. Data of digests that no
+       * controller enabled is dropped.
+       * Returns the number of digests accepted.
+       */
+      int SendDigests(uint32_t digest_id, std::vector<p4::v1::P4Data> data){
+        return digest_manager_->AddDigests(digest_id, std::move(data));
+      }
+
+      /*
+       * SwitchProviderBase::SendDigest
+       * Reports a single digest, see SendDigests.
+       */
+      bool SendDigest(uint32_t digest_id, p4::v1::P4Data data){
+        std::vector<p4::v1::P4Data> digests(1);
+        digests[0].Swap(&data);
+        return SendDigests(digest_id, std::move(digests)) == 1;
       }
     public:
       /*
@@ -45,6 +148,33 @@ namespace switch_provider{
          controller_manager_=controller_manager;
       }
 
+      /*
+       * SwitchProviderBase::AddDigestManager
+       * p4rt_server will pass in a shared_ptr to its DigestManager
+       * to allow subclass to send digests to P4Runtime Controller application
+       */
+      void AddDigestManager(std::shared_ptr<p4rt_server::DigestManager> digest_manager){
+         digest_manager_=digest_manager;
+      }
+
+      /*
+       * SwitchProviderBase::GetP4InfoIndex
+       * Returns the index of the P4Info of the pipeline being pushed by
+       * SetForwardingPipelineConfig, or of the committed one at any other
+       * time. nullptr until p4rt_server knows a P4Info.
+       */
+      std::shared_ptr<const p4rt_server::P4InfoIndex> GetP4InfoIndex() const {
+        return p4info_index_.Load();
+      }
+
+      /*
+       * SwitchProviderBase::SetP4InfoIndex
+       * p4rt_server passes in the index it built from the P4Info
+       */
+      void SetP4InfoIndex(std::shared_ptr<const p4rt_server::P4InfoIndex> index){
+        p4info_index_.Store(std::move(index));
+      }
+
       SwitchProviderBase(){}
       virtual ~SwitchProviderBase(){}
       
@@ -60,6 +190,333 @@ namespace switch_provider{
       virtual absl::StatusOr<p4::v1::ForwardingPipelineConfig>  
         GetForwardingPipelineConfig()=0;
 
+      /*
+       * optional virtual functions, the defaults keep the behavior of the
+       * functions above
+       */
+
+      /*
+       * SwitchProviderBase::WriteUpdateParallelism
+       * Return a value greater than 0 to have CONTINUE_ON_ERROR WriteRequests
+       * executed one update at a time through DoWriteUpdate, with up to that
+       * many updates in flight for independent tables. Each failed update is
+       * then reported to the controller individually. By default the whole
+       * request is handed to DoWrite.
+       */
+      virtual int WriteUpdateParallelism() const { return 0; }
+
+      /*
+       * SwitchProviderBase::WriteGroupCommitOptions
+       * Set a window to have concurrent WriteRequests handed to DoWrite
+       * coalesced into groups committed with one DoWrites call: the first
+       * request of a group waits up to the window for more to arrive.
+       * Requests keep their arrival order, and only CONTINUE_ON_ERROR
+       * requests of the same role and election ID are grouped. Every
+       * request blocks its handler thread while it waits, so a group holds
+       * at most as many requests as there are Writes running at once: in
+       * AsyncP4RtServer, at most num_unary_threads. Read once when
+       * p4rt_server is constructed; disabled by default.
+       */
+      virtual p4rt_server::WriteGroupCommitter::Options
+      WriteGroupCommitOptions() const {
+        return p4rt_server::WriteGroupCommitter::Options();
+      }
+
+      /*
+       * SwitchProviderBase::DoWrites
+       * Applies a group of WriteRequests in order, for group commit, and
+       * returns one status per request. The default calls DoWrite once per
+       * request, so each request gets its own status. Override to commit the
+       * group in one transaction.
+       */
+      virtual std::vector<absl::Status> DoWrites(
+          absl::Span<const p4::v1::WriteRequest* const> requests){
+        std::vector<absl::Status> statuses;
+        statuses.reserve(requests.size());
+        for (const p4::v1::WriteRequest* request : requests) {
+          statuses.push_back(DoWrite(request));
+        }
+        return statuses;
+      }
+
+      /*
+       * SwitchProviderBase::PreValidateWrites
+       * Return true to have p4rt_server check every batch handed to DoWrite
+       * in one pass before the call: malformed updates and updates writing
+       * the same entity as an earlier update of the batch are rejected with
+       * per-update errors, and the batch is not executed. Saves rolling back
+       * a partially programmed batch. CONTINUE_ON_ERROR batches only fail
+       * the rejected updates, and DoWrite gets the others. Read once when
+       * p4rt_server is constructed.
+       */
+      virtual bool PreValidateWrites() const { return false; }
+
+      /*
+       * SwitchProviderBase::DoWriteUpdate
+       * Applies a single update. Called concurrently for updates that do not
+       * depend on each other once WriteUpdateParallelism is greater than 1.
+       */
+      virtual absl::Status DoWriteUpdate(const p4::v1::Update& /*update*/){
+        return absl::UnimplementedError("DoWriteUpdate is not implemented.");
+      }
+
+      /*
+       * SwitchProviderBase::DoStreamingRead
+       * Reads the requested entities and passes them one at a time to
+       * write_entity, which sends them to the controller in chunks. Stop
+       * reading once write_entity returns false. Override to avoid building
+       * the whole ReadResponse in memory; the default calls DoRead.
+       */
+      virtual absl::Status DoStreamingRead(const p4::v1::ReadRequest* request,
+          const std::function<bool(p4::v1::Entity)>& write_entity){
+        auto response = DoRead(request);
+        if (!response.ok()) return response.status();
+        for (auto& entity : *response.value().mutable_entities()) {
+          if (!write_entity(std::move(entity))) break;
+        }
+        return absl::OkStatus();
+      }
+
+      /*
+       * SwitchProviderBase::DoQueryRead
+       * DoStreamingRead with every entity of the request already parsed,
+       * queries[i] being the ReadQuery of request->entities(i): the table
+       * IDs a wildcard covers within the role's scope, the match fields as
+       * a key prefix, and the counter and meter data asked for. Override to
+       * look entries up by table and key instead of filtering a full dump,
+       * and to skip the data columns nobody asked for. Every read of the
+       * switch goes through here. The default calls DoStreamingRead and
+       * drops the entries of tables outside the queries, so wildcard reads
+       * stay within the scope of the role.
+       */
+      virtual absl::Status DoQueryRead(const p4::v1::ReadRequest* request,
+          absl::Span<const p4rt_server::ReadQuery> queries,
+          const std::function<bool(p4::v1::Entity)>& write_entity){
+        return DoStreamingRead(
+            request, [queries, &write_entity](p4::v1::Entity entity) {
+              if (!p4rt_server::QueriesCover(queries, entity)) return true;
+              return write_entity(std::move(entity));
+            });
+      }
+
+      /*
+       * SwitchProviderBase::UseEntityStore
+       * Return true to have p4rt_server remember every table entry that was
+       * written successfully and answer table entry reads from memory instead
+       * of calling DoRead.
+       */
+      virtual bool UseEntityStore() const { return false; }
+
+      /*
+       * SwitchProviderBase::ReadFromEntityStore
+       * Called for every entity of a ReadRequest once UseEntityStore returns
+       * true. Return false to read the entity from the switch with DoRead.
+       * By default table entry reads are served from memory unless they ask
+       * for direct counter or meter data or the default entry; every other
+       * entity type (counters, meters, ...) is read with DoRead.
+       */
+      virtual bool ReadFromEntityStore(const p4::v1::Entity& entity) const {
+        return p4rt_server::EntityStore::CanServe(entity);
+      }
+
+      /*
+       * SwitchProviderBase::CounterCacheOptions
+       * Set a poll_interval to have p4rt_server read every counter, direct
+       * counter, meter and direct meter with one wildcard DoQueryRead
+       * per interval, and answer reads of those entities from the result
+       * while it is at most max_staleness old. Clients can still read from
+       * the switch by sending the "p4rt-counter-cache: bypass" metadata.
+       * Read once when p4rt_server is constructed; disabled by default.
+       */
+      virtual p4rt_server::CounterCacheOptions CounterCacheOptions() const {
+        return p4rt_server::CounterCacheOptions();
+      }
+
+      /*
+       * SwitchProviderBase::TracingOptions
+       * Set sample_one_in and a sink to have p4rt_server trace one in that
+       * many RPCs and StreamChannel messages: a span per request, with child
+       * spans for the arbitration checks and every call into the provider.
+       * Provider calls run inside their span, so providers can break their
+       * work down with p4rt_server::ScopedSpan. Read once when p4rt_server
+       * is constructed; disabled by default.
+       */
+      virtual p4rt_server::TracingOptions TracingOptions() const {
+        return p4rt_server::TracingOptions();
+      }
+
+      /*
+       * SwitchProviderBase::SendPacketOuts
+       * Sends a batch of PacketOuts received from the primary controller, in
+       * order. Returns one status per packet. Override when the switch can
+       * transmit a burst more cheaply than one packet at a time; the default
+       * calls SendPacketOut for every packet.
+       */
+      virtual std::vector<absl::Status> SendPacketOuts(
+          absl::Span<const p4::v1::PacketOut> packets){
+        std::vector<absl::Status> statuses;
+        statuses.reserve(packets.size());
+        for (const auto& packet : packets) {
+          statuses.push_back(SendPacketOut(packet));
+        }
+        return statuses;
+      }
+
+      /*
+       * SwitchProviderBase::UsePacketOutBuffers
+       * Return true to receive PacketOuts with SendPacketOutBuffers instead
+       * of SendPacketOuts. Read once when p4rt_server is constructed;
+       * disabled by default.
+       */
+      virtual bool UsePacketOutBuffers() const { return false; }
+
+      /*
+       * SwitchProviderBase::SendPacketOutBuffers
+       * SendPacketOuts with the packets handed over by ownership: every
+       * payload is moved out of the StreamChannel message without a copy,
+       * and the provider may keep it after returning, e.g. queued on a DMA
+       * TX ring until the switch has sent it. Return one status per packet,
+       * once it is queued. Override together with UsePacketOutBuffers; the
+       * default copies the packets back for SendPacketOuts.
+       */
+      virtual std::vector<absl::Status> SendPacketOutBuffers(
+          std::vector<p4rt_server::PacketOutBuffer> packets){
+        std::vector<p4::v1::PacketOut> packet_outs;
+        packet_outs.reserve(packets.size());
+        for (const auto& packet : packets) {
+          packet_outs.push_back(packet.ToPacketOut());
+        }
+        return SendPacketOuts(packet_outs);
+      }
+
+      /*
+       * SwitchProviderBase::PacketOutDispatcherOptions
+       * Batching of the PacketOuts received on every StreamChannel: the
+       * largest batch handed to SendPacketOuts, how long a partial batch
+       * waits to fill, and how many packets are queued before the stream
+       * stops reading. queue_depth is set by p4rt_server. Read once when
+       * p4rt_server is constructed.
+       */
+      virtual p4rt_server::PacketOutDispatcher::Options
+      PacketOutDispatcherOptions() const {
+        return p4rt_server::PacketOutDispatcher::Options();
+      }
+
+      /*
+       * SwitchProviderBase::PacketInQueueOptions
+       * Size and overflow policy of the PacketIn queue of every controller
+       * connection. Read once when p4rt_server is constructed.
+       */
+      virtual p4rt_server::PacketInQueue::Options PacketInQueueOptions() const {
+        return p4rt_server::PacketInQueue::Options();
+      }
+
+      /*
+       * SwitchProviderBase::PacketInPriority
+       * Priority of a PacketIn, e.g. by its ingress port metadata or its
+       * EtherType. Once a PacketIn queue is full, packets of higher priority
+       * displace those of lower priority, so e.g. LACP and BGP punts can be
+       * kept over an ARP flood. Called for every PacketIn; all packets have
+       * priority 0 by default.
+       */
+      virtual int PacketInPriority(const p4::v1::PacketIn& /*packet*/) const {
+        return 0;
+      }
+
+      /*
+       * SwitchProviderBase::RateLimitsForRole
+       * Token bucket limits on the PacketIns sent to, and the PacketOuts
+       * received from, the primary controller of a role, with optional per
+       * ingress port sub-limits on PacketIns. Packets over a limit are
+       * counted and dropped. Called once per role, when a controller first
+       * uses it, from inside arbitration: must not send PacketIns. Unlimited
+       * by default.
+       */
+      virtual p4rt_server::StreamRateLimits RateLimitsForRole(
+          const absl::optional<std::string>& /*role_name*/) const {
+        return p4rt_server::StreamRateLimits();
+      }
+
+      /*
+       * SwitchProviderBase::AdmissionControlOptions
+       * Set max_concurrent_requests to bound the Writes, Reads, pipeline
+       * config RPCs and PacketOut batches that run at once. The others wait
+       * for a slot in the order of AdmissionLimitsFor, and are rejected with
+       * RESOURCE_EXHAUSTED once they waited too long. Read once when
+       * p4rt_server is constructed; disabled by default.
+       */
+      virtual p4rt_server::AdmissionControlOptions AdmissionControlOptions()
+          const {
+        return p4rt_server::AdmissionControlOptions();
+      }
+
+      /*
+       * SwitchProviderBase::AdmissionLimitsFor
+       * Priority, concurrency limit and queue delay budget of the requests
+       * of a type and role. Reads carry no election ID, so give monitoring
+       * tools a role of their own, listed in AdmissionControlOptions roles,
+       * to schedule their Reads apart from those of the primary. The other
+       * roles share the limits of the empty role name. Called when
+       * p4rt_server is constructed, and must not call into p4rt_server.
+       * DefaultAdmissionLimits by default.
+       */
+      virtual p4rt_server::AdmissionLimits AdmissionLimitsFor(
+          p4rt_server::RequestType type,
+          const absl::optional<std::string>& /*role_name*/) const {
+        return p4rt_server::DefaultAdmissionLimits(type);
+      }
+
+      /*
+       * SwitchProviderBase::MirrorPacketInsToBackups
+       * Return true to also send every PacketIn to the backup connections of
+       * its role, e.g. read-only monitoring sessions that connect without an
+       * election ID. The mirrored packets are not copied per connection, and
+       * the AsyncP4RtServer serializes each of them once for all streams.
+       * Read once when p4rt_server is constructed.
+       */
+      virtual bool MirrorPacketInsToBackups() const { return false; }
+
+      /*
+       * SwitchProviderBase::ReconcileForwardingPipelineConfig
+       * Applies a RECONCILE_AND_COMMIT of a config that differs from the
+       * committed one. diff tells which tables, actions and other P4 entities
+       * were added, removed or modified; the switch should only reprogram
+       * those and keep the entries of the unchanged tables, which p4rt_server
+       * keeps in its entity store too. Not called when the config only
+       * differs in its cookie. The default reloads the whole config with
+       * SetForwardingPipelineConfig.
+       */
+      virtual absl::Status ReconcileForwardingPipelineConfig(
+          const p4::v1::ForwardingPipelineConfig& config,
+          const p4rt_server::PipelineDiff& /*diff*/){
+        return SetForwardingPipelineConfig(config);
+      }
+
+      /*
+       * SwitchProviderBase::WarmRestartOptions
+       * Set a snapshot_path to have p4rt_server persist the committed pipeline
+       * config, the entity store and the highest election ID of every role,
+       * and reload them when it is constructed again, e.g. after the agent
+       * restarted while the switch kept forwarding. Read once when
+       * p4rt_server is constructed; disabled by default.
+       */
+      virtual p4rt_server::WarmRestartOptions WarmRestartOptions() const {
+        return p4rt_server::WarmRestartOptions();
+      }
+
+      /*
+       * SwitchProviderBase::RestoreForwardingPipelineConfig
+       * Called on a warm restart with the pipeline config of the snapshot,
+       * instead of SetForwardingPipelineConfig, since the switch still runs
+       * it: set up what the provider needs to serve the pipeline without
+       * reprogramming the switch. Return an error if the switch does not run
+       * this config any more; the snapshot is then ignored.
+       */
+      virtual absl::Status RestoreForwardingPipelineConfig(
+          const p4::v1::ForwardingPipelineConfig& /*config*/){
+        return absl::OkStatus();
+      }
+
   };
 }
 
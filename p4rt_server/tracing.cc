@@ -0,0 +1,182 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "tracing.h"
+
+#include <memory>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+
+namespace p4rt_server{
+
+// The trace of a sampled request while its spans are recorded, possibly by
+// several threads. Exported once the last reference is dropped.
+class ActiveTrace : public std::enable_shared_from_this<ActiveTrace> {
+ public:
+  ActiveTrace(Tracer* tracer, uint64_t trace_id) : tracer_(tracer) {
+    trace_.trace_id = trace_id;
+  }
+
+  ~ActiveTrace() { tracer_->Export(std::move(trace_)); }
+
+  ActiveTrace(const ActiveTrace&) = delete;
+  ActiveTrace& operator=(const ActiveTrace&) = delete;
+
+  // Returns the position of the new span.
+  int StartSpan(int parent, absl::string_view name) ABSL_LOCKS_EXCLUDED(lock_) {
+    Trace::Span span;
+    span.name = std::string(name);
+    span.parent = parent;
+    span.start = absl::Now();
+    absl::MutexLock l(&lock_);
+    trace_.spans.push_back(std::move(span));
+    return trace_.spans.size() - 1;
+  }
+
+  void EndSpan(int span) ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::Time now = absl::Now();
+    absl::MutexLock l(&lock_);
+    trace_.spans[span].end = now;
+  }
+
+  void AddEvent(int span, absl::string_view name) ABSL_LOCKS_EXCLUDED(lock_) {
+    Trace::Event event{std::string(name), absl::Now()};
+    absl::MutexLock l(&lock_);
+    trace_.spans[span].events.push_back(std::move(event));
+  }
+
+ private:
+  Tracer* const tracer_;
+  absl::Mutex lock_;
+  Trace trace_ ABSL_GUARDED_BY(lock_);
+};
+
+namespace {
+
+   // The span the calling thread is in, if it is tracing a request. Whoever
+   // set it keeps the trace alive.
+   struct CurrentSpan {
+     ActiveTrace* trace = nullptr;
+     int span = -1;
+   };
+   thread_local CurrentSpan current_span;
+
+   // Formats a duration in microseconds, e.g. "+125us".
+   std::string Micros(absl::Duration duration) {
+     return absl::StrCat(absl::ToInt64Microseconds(duration), "us");
+   }
+
+}  // namespace
+
+void RingBufferTraceSink::Export(Trace trace) {
+  if (capacity_ == 0) return;
+  absl::MutexLock l(&lock_);
+  if (traces_.size() == capacity_) traces_.pop_front();
+  traces_.push_back(std::move(trace));
+}
+
+std::vector<Trace> RingBufferTraceSink::Dump() const {
+  absl::MutexLock l(&lock_);
+  return std::vector<Trace>(traces_.begin(), traces_.end());
+}
+
+std::string RingBufferTraceSink::DumpText() const {
+  std::string text;
+  for (const Trace& trace : Dump()) {
+    if (trace.spans.empty()) continue;
+    absl::Time trace_start = trace.spans[0].start;
+    absl::StrAppend(&text, "trace ", trace.trace_id, " at ",
+                    absl::FormatTime(trace_start), "\n");
+    for (const Trace::Span& span : trace.spans) {
+      int depth = 1;
+      for (int parent = span.parent; parent >= 0;
+           parent = trace.spans[parent].parent) {
+        ++depth;
+      }
+      absl::StrAppend(&text, std::string(2 * depth, ' '), span.name, " +",
+                      Micros(span.start - trace_start), " ",
+                      Micros(span.end - span.start));
+      for (const Trace::Event& event : span.events) {
+        absl::StrAppend(&text, " ", event.name, "@+",
+                        Micros(event.time - span.start));
+      }
+      text += "\n";
+    }
+  }
+  return text;
+}
+
+Tracer::Tracer(const TracingOptions& options)
+    : options_(options),
+      next_trace_id_(static_cast<uint64_t>(absl::ToUnixNanos(absl::Now()))) {}
+
+bool Tracer::Sample() {
+  if (options_.sample_one_in <= 0 || options_.sink == nullptr) return false;
+  return requests_.fetch_add(1, std::memory_order_relaxed) %
+             options_.sample_one_in ==
+         0;
+}
+
+ScopedSpan::ScopedSpan(Tracer* tracer, absl::string_view name)
+    : previous_trace_(current_span.trace), previous_span_(current_span.span) {
+  // Children of a request that is not sampled are not traced either.
+  current_span = CurrentSpan();
+  if (tracer == nullptr || !tracer->Sample()) return;
+  root_ = std::make_shared<ActiveTrace>(tracer, tracer->NextTraceId());
+  Start(root_.get(), -1, name);
+}
+
+ScopedSpan::ScopedSpan(absl::string_view name)
+    : previous_trace_(current_span.trace), previous_span_(current_span.span) {
+  if (previous_trace_ != nullptr) Start(previous_trace_, previous_span_, name);
+}
+
+ScopedSpan::~ScopedSpan() {
+  if (trace_ != nullptr) trace_->EndSpan(span_);
+  current_span.trace = previous_trace_;
+  current_span.span = previous_span_;
+}
+
+void ScopedSpan::Start(ActiveTrace* trace, int parent, absl::string_view name) {
+  trace_ = trace;
+  span_ = trace->StartSpan(parent, name);
+  current_span.trace = trace_;
+  current_span.span = span_;
+}
+
+void ScopedSpan::AddEvent(absl::string_view name) {
+  if (trace_ == nullptr) return;
+  trace_->AddEvent(span_, name);
+}
+
+void ScopedSpan::AddCurrentEvent(absl::string_view name) {
+  if (current_span.trace == nullptr) return;
+  current_span.trace->AddEvent(current_span.span, name);
+}
+
+SpanContext ScopedSpan::CurrentContext() {
+  SpanContext context;
+  if (current_span.trace == nullptr) return context;
+  context.trace_ = current_span.trace->shared_from_this();
+  context.span_ = current_span.span;
+  return context;
+}
+
+ScopedSpanContext::ScopedSpanContext(SpanContext context)
+    : previous_trace_(current_span.trace),
+      previous_span_(current_span.span),
+      context_(std::move(context)) {
+  current_span.trace = context_.trace_.get();
+  current_span.span = context_.span_;
+}
+
+ScopedSpanContext::~ScopedSpanContext() {
+  current_span.trace = previous_trace_;
+  current_span.span = previous_span_;
+}
+
+}//namespace p4rt_server
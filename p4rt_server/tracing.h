@@ -0,0 +1,203 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _TRACING_H_
+#define _TRACING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace p4rt_server{
+
+// The spans of one sampled request, e.g. a Write RPC or one StreamChannel
+// message, root span first.
+struct Trace {
+  struct Event {
+    std::string name;
+    absl::Time time;
+  };
+  struct Span {
+    std::string name;
+    // Position of the parent span in spans, -1 for the root span.
+    int parent = -1;
+    absl::Time start;
+    absl::Time end;
+    std::vector<Event> events;
+  };
+
+  uint64_t trace_id = 0;
+  std::vector<Span> spans;
+};
+
+// Receives every finished trace, e.g. to export it to OpenTelemetry. Export
+// is called on the thread that ends the last span of the request, usually
+// the one that served it, so it should not block.
+class TraceSink {
+ public:
+  virtual ~TraceSink() = default;
+  virtual void Export(Trace trace) = 0;
+};
+
+// Keeps the last traces in memory, to be dumped on demand.
+class RingBufferTraceSink : public TraceSink {
+ public:
+  explicit RingBufferTraceSink(size_t capacity) : capacity_(capacity) {}
+
+  RingBufferTraceSink(const RingBufferTraceSink&) = delete;
+  RingBufferTraceSink& operator=(const RingBufferTraceSink&) = delete;
+
+  void Export(Trace trace) override ABSL_LOCKS_EXCLUDED(lock_);
+
+  // The kept traces, oldest first.
+  std::vector<Trace> Dump() const ABSL_LOCKS_EXCLUDED(lock_);
+
+  // The kept traces in a human readable form, one indented line per span with
+  // its duration and the offsets of its events.
+  std::string DumpText() const ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  const size_t capacity_;
+  mutable absl::Mutex lock_;
+  std::deque<Trace> traces_ ABSL_GUARDED_BY(lock_);
+};
+
+struct TracingOptions {
+  // One in this many requests is traced; 0 disables tracing.
+  int sample_one_in = 0;
+  std::shared_ptr<TraceSink> sink;
+};
+
+// Decides which requests are traced and hands their traces to the sink.
+class Tracer {
+ public:
+  explicit Tracer(const TracingOptions& options);
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  // Returns true if the next request should be traced.
+  bool Sample();
+
+  uint64_t NextTraceId() {
+    return next_trace_id_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Export(Trace trace) { options_.sink->Export(std::move(trace)); }
+
+ private:
+  const TracingOptions options_;
+  std::atomic<uint64_t> requests_{0};
+  std::atomic<uint64_t> next_trace_id_;
+};
+
+// A trace that is still recorded. Defined in tracing.cc.
+class ActiveTrace;
+
+// The current span of a thread, captured to continue the trace on another
+// thread, e.g. by a task handed to a worker. The trace is exported once the
+// root span and every captured context are gone. Empty if the thread was not
+// tracing a sampled request, in which case copying it costs nothing.
+class SpanContext {
+ public:
+  SpanContext() = default;
+
+  bool empty() const { return trace_ == nullptr; }
+
+ private:
+  friend class ScopedSpan;
+  friend class ScopedSpanContext;
+
+  std::shared_ptr<ActiveTrace> trace_;
+  int span_ = -1;
+};
+
+// Times one span of a trace from construction to destruction, and makes it
+// the current span of the calling thread while it lives.
+//
+// Spans of requests that are not sampled, and child spans opened on a thread
+// that is not tracing a request, record nothing and cost one thread local
+// read. Switch providers open child spans the same way to break their own
+// work down, e.g.
+//   absl::Status DoWrite(const p4::v1::WriteRequest* request) override {
+//     p4rt_server::ScopedSpan span("sdk_commit");
+//     ...
+//   }
+class ScopedSpan {
+ public:
+  // Starts the trace of a request, if the tracer samples it. A null tracer
+  // traces nothing.
+  ScopedSpan(Tracer* tracer, absl::string_view name);
+
+  // Starts a child of the current span of the calling thread, if any.
+  explicit ScopedSpan(absl::string_view name);
+
+  ~ScopedSpan();
+
+  ScopedSpan(const ScopedSpan&) = delete;
+  ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+  // Stamps an event, e.g. "response_written", on the span.
+  void AddEvent(absl::string_view name);
+
+  // Stamps an event on the current span of the calling thread, if any.
+  static void AddCurrentEvent(absl::string_view name);
+
+  // The current span of the calling thread, to be restored with a
+  // ScopedSpanContext where the work continues.
+  static SpanContext CurrentContext();
+
+  bool recording() const { return trace_ != nullptr; }
+
+ private:
+  void Start(ActiveTrace* trace, int parent, absl::string_view name);
+
+  // The current span of the thread before this one, restored on destruction.
+  ActiveTrace* const previous_trace_;
+  const int previous_span_;
+
+  // Set for root spans of sampled requests, which share their trace with the
+  // contexts captured from it.
+  std::shared_ptr<ActiveTrace> root_;
+
+  ActiveTrace* trace_ = nullptr;
+  int span_ = -1;
+};
+
+// Makes a captured span the current span of the calling thread while it
+// lives, so the spans and events of work that hopped threads land in the
+// trace of the request it belongs to, e.g.
+//   SpanContext context = ScopedSpan::CurrentContext();
+//   workers->Schedule([context]() {
+//     ScopedSpanContext scoped_context(context);
+//     ...
+//   });
+// Spans may then be recorded by several threads at once.
+class ScopedSpanContext {
+ public:
+  explicit ScopedSpanContext(SpanContext context);
+  ~ScopedSpanContext();
+
+  ScopedSpanContext(const ScopedSpanContext&) = delete;
+  ScopedSpanContext& operator=(const ScopedSpanContext&) = delete;
+
+ private:
+  ActiveTrace* const previous_trace_;
+  const int previous_span_;
+  // Keeps the trace alive while it is current.
+  const SpanContext context_;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _TRACING_H_
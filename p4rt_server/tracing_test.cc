@@ -0,0 +1,106 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "tracing.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+class TracingTest : public testing::Test {
+ protected:
+  TracingTest() : sink_(std::make_shared<RingBufferTraceSink>(10)) {
+    TracingOptions options;
+    options.sample_one_in = 1;
+    options.sink = sink_;
+    tracer_ = absl::make_unique<Tracer>(options);
+  }
+
+  std::shared_ptr<RingBufferTraceSink> sink_;
+  std::unique_ptr<Tracer> tracer_;
+};
+
+TEST_F(TracingTest, ChildSpansNestUnderTheCurrentSpan) {
+  {
+    ScopedSpan root(tracer_.get(), "Write");
+    {
+      ScopedSpan child("DoWrites");
+      ScopedSpan::AddCurrentEvent("applied");
+    }
+    root.AddEvent("done");
+  }
+  std::vector<Trace> traces = sink_->Dump();
+  ASSERT_EQ(traces.size(), 1u);
+  ASSERT_EQ(traces[0].spans.size(), 2u);
+  EXPECT_EQ(traces[0].spans[1].name, "DoWrites");
+  EXPECT_EQ(traces[0].spans[1].parent, 0);
+  EXPECT_EQ(traces[0].spans[1].events.size(), 1u);
+  EXPECT_EQ(traces[0].spans[0].events.size(), 1u);
+}
+
+TEST_F(TracingTest, RestoredContextContinuesTheTraceOnAnotherThread) {
+  {
+    ScopedSpan root(tracer_.get(), "Write");
+    SpanContext context = ScopedSpan::CurrentContext();
+    ASSERT_FALSE(context.empty());
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; ++i) {
+      workers.emplace_back([&context]() {
+        ScopedSpanContext scoped_context(context);
+        ScopedSpan lane("DoWriteUpdate");
+        EXPECT_TRUE(lane.recording());
+      });
+    }
+    for (auto& worker : workers) worker.join();
+    // The worker's context does not leak into the calling thread.
+    ScopedSpan child("RecordUpdates");
+  }
+  std::vector<Trace> traces = sink_->Dump();
+  ASSERT_EQ(traces.size(), 1u);
+  ASSERT_EQ(traces[0].spans.size(), 6u);
+  for (const Trace::Span& span : traces[0].spans) {
+    if (span.name != "Write") {
+      EXPECT_EQ(span.parent, 0);
+    }
+  }
+}
+
+TEST_F(TracingTest, TraceIsExportedOnceTheLastContextIsDropped) {
+  SpanContext context;
+  {
+    ScopedSpan root(tracer_.get(), "StreamChannel.PacketOut");
+    context = ScopedSpan::CurrentContext();
+  }
+  EXPECT_TRUE(sink_->Dump().empty());
+  {
+    ScopedSpanContext scoped_context(std::move(context));
+    ScopedSpan dispatch("DispatchPacketOuts");
+  }
+  std::vector<Trace> traces = sink_->Dump();
+  ASSERT_EQ(traces.size(), 1u);
+  ASSERT_EQ(traces[0].spans.size(), 2u);
+  EXPECT_EQ(traces[0].spans[1].name, "DispatchPacketOuts");
+}
+
+TEST_F(TracingTest, UnsampledRequestsHaveNoContext) {
+  TracingOptions options;
+  Tracer tracer(options);
+  ScopedSpan root(&tracer, "Write");
+  EXPECT_FALSE(root.recording());
+  EXPECT_TRUE(ScopedSpan::CurrentContext().empty());
+  ScopedSpanContext scoped_context{SpanContext()};
+  ScopedSpan child("DoWrites");
+  EXPECT_FALSE(child.recording());
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "worker_pool.h"
+
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace p4rt_server{
+
+WorkerPool::WorkerPool(int num_threads) {
+  if (num_threads < 1) num_threads = 1;
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back([this]() { RunTasks(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    absl::MutexLock l(&lock_);
+    shutdown_ = true;
+  }
+  for (auto& worker : workers_) worker.join();
+}
+
+void WorkerPool::Schedule(std::function<void()> task) {
+  absl::MutexLock l(&lock_);
+  tasks_.push_back(std::move(task));
+}
+
+void WorkerPool::RunTasks() {
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return shutdown_ || !tasks_.empty();
+    };
+    while (true) {
+      std::function<void()> task;
+      {
+        absl::MutexLock l(&lock_);
+        lock_.Await(absl::Condition(&has_work));
+        if (tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+#ifdef __EXCEPTIONS
+  } catch (const std::exception& e) {
+    LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
+  } catch (...) {
+    LOG(FATAL) << "Unknown exception caught in " << __func__;
+  }
+#endif
+}
+
+}//namespace p4rt_server
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace p4rt_server{
+
+// A fixed set of threads running scheduled tasks in the order they were
+// scheduled. Lets the AsyncP4RtServer move work that waits, such as reading
+// the next chunk of a Read once the previous one was written, off its
+// completion queue threads without a thread per call.
+class WorkerPool {
+ public:
+  explicit WorkerPool(int num_threads);
+
+  // Runs the tasks already scheduled, then joins the threads.
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  void Schedule(std::function<void()> task) ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  void RunTasks() ABSL_LOCKS_EXCLUDED(lock_);
+
+  absl::Mutex lock_;
+  std::deque<std::function<void()>> tasks_ ABSL_GUARDED_BY(lock_);
+  bool shutdown_ ABSL_GUARDED_BY(lock_) = false;
+
+  std::vector<std::thread> workers_;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _WORKER_POOL_H_
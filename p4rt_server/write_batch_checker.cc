@@ -0,0 +1,166 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "write_batch_checker.h"
+
+#include <cstdint>
+
+#include "entity_store.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+namespace {
+
+   void AppendId(uint64_t id, std::string* key) {
+     key->append(reinterpret_cast<const char*>(&id), sizeof(id));
+   }
+
+   // IDs of an indexed entity; an unset index writes every index.
+   void AppendIndex(uint32_t id, bool has_index, int64_t index,
+                    std::string* key) {
+     AppendId(id, key);
+     AppendId(has_index ? 1 : 0, key);
+     AppendId(index, key);
+   }
+
+   absl::Status CheckTableEntry(const p4::v1::TableEntry& entry,
+                                p4::v1::Update::Type type) {
+     if (entry.table_id() == 0) {
+       return gutil::InvalidArgumentErrorBuilder()
+              << "Table entry has no table ID.";
+     }
+     // MODIFY of a default entry without an action restores the initial
+     // default action.
+     if (type != p4::v1::Update::DELETE && !entry.is_default_action() &&
+         !entry.has_action()) {
+       return gutil::InvalidArgumentErrorBuilder()
+              << "Table entry of table ID " << entry.table_id()
+              << " has no action.";
+     }
+     for (const auto& match : entry.match()) {
+       if (match.field_match_type_case() ==
+           p4::v1::FieldMatch::FIELD_MATCH_TYPE_NOT_SET) {
+         return gutil::InvalidArgumentErrorBuilder()
+                << "Match field ID " << match.field_id() << " of table ID "
+                << entry.table_id() << " has no value.";
+       }
+     }
+     return absl::OkStatus();
+   }
+
+   absl::Status CheckFormat(const p4::v1::Update& update) {
+     if (update.type() == p4::v1::Update::UNSPECIFIED) {
+       return gutil::InvalidArgumentErrorBuilder()
+              << "Update type is unspecified.";
+     }
+     const p4::v1::Entity& entity = update.entity();
+     switch (entity.entity_case()) {
+       case p4::v1::Entity::ENTITY_NOT_SET:
+         return gutil::InvalidArgumentErrorBuilder() << "Update has no entity.";
+       case p4::v1::Entity::kTableEntry:
+         return CheckTableEntry(entity.table_entry(), update.type());
+       case p4::v1::Entity::kActionProfileMember: {
+         const auto& member = entity.action_profile_member();
+         if (member.action_profile_id() == 0) {
+           return gutil::InvalidArgumentErrorBuilder()
+                  << "Action profile member has no action profile ID.";
+         }
+         return absl::OkStatus();
+       }
+       case p4::v1::Entity::kActionProfileGroup: {
+         const auto& group = entity.action_profile_group();
+         if (group.action_profile_id() == 0) {
+           return gutil::InvalidArgumentErrorBuilder()
+                  << "Action profile group has no action profile ID.";
+         }
+         return absl::OkStatus();
+       }
+       default:
+         return absl::OkStatus();
+     }
+   }
+
+   // Returns a key that is equal for updates writing the same entity, or an
+   // empty key for entities that are not checked for duplicates.
+   std::string EntityKey(const p4::v1::Entity& entity) {
+     std::string key;
+     AppendId(entity.entity_case(), &key);
+     switch (entity.entity_case()) {
+       case p4::v1::Entity::kTableEntry: {
+         const p4::v1::TableEntry& entry = entity.table_entry();
+         AppendId(entry.table_id(), &key);
+         AppendId(entry.is_default_action() ? 1 : 0, &key);
+         if (!entry.is_default_action()) {
+           key.append(EntityStore::MatchKey(entry));
+         }
+         return key;
+       }
+       case p4::v1::Entity::kActionProfileMember:
+         AppendId(entity.action_profile_member().action_profile_id(), &key);
+         AppendId(entity.action_profile_member().member_id(), &key);
+         return key;
+       case p4::v1::Entity::kActionProfileGroup:
+         AppendId(entity.action_profile_group().action_profile_id(), &key);
+         AppendId(entity.action_profile_group().group_id(), &key);
+         return key;
+       case p4::v1::Entity::kCounterEntry: {
+         const auto& counter = entity.counter_entry();
+         AppendIndex(counter.counter_id(), counter.has_index(),
+                     counter.index().index(), &key);
+         return key;
+       }
+       case p4::v1::Entity::kMeterEntry: {
+         const auto& meter = entity.meter_entry();
+         AppendIndex(meter.meter_id(), meter.has_index(),
+                     meter.index().index(), &key);
+         return key;
+       }
+       case p4::v1::Entity::kRegisterEntry: {
+         const auto& entry = entity.register_entry();
+         AppendIndex(entry.register_id(), entry.has_index(),
+                     entry.index().index(), &key);
+         return key;
+       }
+       case p4::v1::Entity::kPacketReplicationEngineEntry: {
+         const auto& entry = entity.packet_replication_engine_entry();
+         AppendId(entry.type_case(), &key);
+         AppendId(entry.has_multicast_group_entry()
+                      ? entry.multicast_group_entry().multicast_group_id()
+                      : entry.clone_session_entry().session_id(),
+                  &key);
+         return key;
+       }
+       case p4::v1::Entity::kDigestEntry:
+         AppendId(entity.digest_entry().digest_id(), &key);
+         return key;
+       default:
+         return "";
+     }
+   }
+
+}  // namespace
+
+WriteBatchChecker::WriteBatchChecker(int num_updates) {
+  first_update_by_key_.reserve(num_updates);
+}
+
+absl::Status WriteBatchChecker::Check(const p4::v1::Update& update) {
+  int update_index = next_update_++;
+  absl::Status status = CheckFormat(update);
+  if (!status.ok()) return status;
+
+  std::string key = EntityKey(update.entity());
+  if (key.empty()) return absl::OkStatus();
+  auto inserted = first_update_by_key_.emplace(std::move(key), update_index);
+  if (!inserted.second) {
+    return gutil::InvalidArgumentErrorBuilder()
+           << "Update writes the same entity as update "
+           << inserted.first->second << " of the batch.";
+  }
+  return absl::OkStatus();
+}
+
+}//namespace p4rt_server
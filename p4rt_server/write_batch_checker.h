@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _WRITE_BATCH_CHECKER_H_
+#define _WRITE_BATCH_CHECKER_H_
+
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// Pre-validates the updates of one WriteRequest, in request order, before the
+// batch reaches the switch provider. See
+// SwitchProviderBase::PreValidateWrites.
+//
+// Updates must be well formed whether or not a P4Info is known: an update
+// type and entity are set, table entries name a table and carry an action
+// unless they are deleted, and every match field has a value. No two updates
+// of a batch may write the same entity (same table and canonical match key,
+// same action profile member, same counter index, ...), since the outcome of
+// e.g. an INSERT and a DELETE of the same entry in one batch depends on the
+// order the switch applies them in.
+class WriteBatchChecker {
+ public:
+  explicit WriteBatchChecker(int num_updates);
+
+  WriteBatchChecker(const WriteBatchChecker&) = delete;
+  WriteBatchChecker& operator=(const WriteBatchChecker&) = delete;
+
+  // Checks the next update of the batch.
+  absl::Status Check(const p4::v1::Update& update);
+
+ private:
+  // Index of the first update that wrote each entity, by entity key.
+  absl::flat_hash_map<std::string, int> first_update_by_key_;
+  int next_update_ = 0;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _WRITE_BATCH_CHECKER_H_
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "write_executor.h"
+#include "tracing.h"
+
+#include <algorithm>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "glog/logging.h"
+#include "google/rpc/status.pb.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+namespace{
+  // Returns the table an update writes to, or 0 for entities that are not
+  // part of a table. Any table entry may reference one of those, e.g. the
+  // multicast group of the action flooding to it or the member of an action
+  // profile.
+  uint32_t LaneTableId(const p4::v1::Entity& entity) {
+    switch (entity.entity_case()) {
+      case p4::v1::Entity::kTableEntry:
+        return entity.table_entry().table_id();
+      case p4::v1::Entity::kDirectCounterEntry:
+        return entity.direct_counter_entry().table_entry().table_id();
+      case p4::v1::Entity::kDirectMeterEntry:
+        return entity.direct_meter_entry().table_entry().table_id();
+      default:
+        return 0;
+    }
+  }
+
+  // Splits the updates into phases that run one after the other, each a set
+  // of lanes of update indices in request order. An update of an entity that
+  // is not part of a table is a phase of its own, so it runs after every
+  // update before it and before every update after it. The table updates in
+  // between get one lane per table.
+  std::vector<std::vector<std::vector<int>>> PartitionUpdates(
+      const p4::v1::WriteRequest& request) {
+    std::vector<std::vector<std::vector<int>>> phases;
+    absl::flat_hash_map<uint32_t, int> lane_by_table;
+    // Whether the last phase still takes table updates.
+    bool open = false;
+    for (int i = 0; i < request.updates_size(); ++i) {
+      uint32_t table_id = LaneTableId(request.updates(i).entity());
+      if (table_id == 0) {
+        phases.push_back({{i}});
+        open = false;
+        continue;
+      }
+      if (!open) {
+        phases.emplace_back();
+        lane_by_table.clear();
+        open = true;
+      }
+      std::vector<std::vector<int>>& lanes = phases.back();
+      auto inserted = lane_by_table.emplace(table_id, lanes.size());
+      if (inserted.second) lanes.emplace_back();
+      lanes[inserted.first->second].push_back(i);
+    }
+    return phases;
+  }
+}
+
+WriteExecutor::WriteExecutor(int max_parallelism) {
+  // The calling thread runs one lane itself.
+  for (int i = 1; i < max_parallelism; ++i) {
+    workers_.emplace_back([this]() { RunTasks(); });
+  }
+}
+
+WriteExecutor::~WriteExecutor() {
+  {
+    absl::MutexLock l(&lock_);
+    shutdown_ = true;
+  }
+  for (auto& worker : workers_) worker.join();
+}
+
+std::vector<absl::Status> WriteExecutor::Execute(
+    const p4::v1::WriteRequest& request, const UpdateWriter& write_update) {
+  std::vector<absl::Status> statuses(request.updates_size());
+  for (auto& lanes : PartitionUpdates(request)) {
+    RunLanes(request, write_update, &lanes, &statuses);
+  }
+  return statuses;
+}
+
+void WriteExecutor::RunLanes(const p4::v1::WriteRequest& request,
+                             const UpdateWriter& write_update,
+                             std::vector<std::vector<int>>* lanes,
+                             std::vector<absl::Status>* statuses) {
+  // Every lane writes a disjoint set of statuses.
+  auto run_lane = [&request, &write_update, statuses](
+                      const std::vector<int>& lane) {
+    for (int i : lane) (*statuses)[i] = write_update(request.updates(i));
+  };
+  if (lanes->size() == 1 || workers_.empty()) {
+    for (const auto& lane : *lanes) run_lane(lane);
+    return;
+  }
+
+  // Larger lanes first, so the longest one is not started last.
+  std::sort(lanes->begin(), lanes->end(),
+            [](const std::vector<int>& a, const std::vector<int>& b) {
+              return a.size() > b.size();
+            });
+  absl::BlockingCounter pending_lanes(lanes->size() - 1);
+  // The workers record their spans in the trace of the request.
+  SpanContext span_context = ScopedSpan::CurrentContext();
+  {
+    absl::MutexLock l(&lock_);
+    for (size_t i = 1; i < lanes->size(); ++i) {
+      tasks_.push_back([&run_lane, &pending_lanes, &span_context,
+                        &lane = (*lanes)[i]]() {
+        {
+          ScopedSpanContext scoped_context(span_context);
+          run_lane(lane);
+        }
+        pending_lanes.DecrementCount();
+      });
+    }
+  }
+  run_lane((*lanes)[0]);
+  pending_lanes.Wait();
+}
+
+void WriteExecutor::RunTasks() {
+#ifdef __EXCEPTIONS
+  try {
+#endif
+    auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return shutdown_ || !tasks_.empty();
+    };
+    while (true) {
+      std::function<void()> task;
+      {
+        absl::MutexLock l(&lock_);
+        lock_.Await(absl::Condition(&has_work));
+        // Queued lanes always run, Execute is waiting for them.
+        if (tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+#ifdef __EXCEPTIONS
+  } catch (const std::exception& e) {
+    LOG(FATAL) << "Exception caught in " << __func__ << ", error:" << e.what();
+  } catch (...) {
+    LOG(FATAL) << "Unknown exception caught in " << __func__;
+  }
+#endif
+}
+
+grpc::Status WriteStatusesToGrpcStatus(
+    const std::vector<absl::Status>& statuses) {
+  int failures = std::count_if(
+      statuses.begin(), statuses.end(),
+      [](const absl::Status& status) { return !status.ok(); });
+  if (failures == 0) return grpc::Status::OK;
+
+  std::string message = absl::StrCat(failures, " of ", statuses.size(),
+                                     " updates in the batch failed.");
+  google::rpc::Status details;
+  details.set_code(static_cast<int>(grpc::StatusCode::UNKNOWN));
+  details.set_message(message);
+  for (const auto& status : statuses) {
+    grpc::Status update_status = gutil::AbslStatusToGrpcStatus(status);
+    p4::v1::Error error;
+    error.set_canonical_code(update_status.error_code());
+    error.set_message(update_status.error_message());
+    details.add_details()->PackFrom(error);
+  }
+  return grpc::Status(grpc::StatusCode::UNKNOWN, message,
+                      details.SerializeAsString());
+}
+
+}//namespace p4rt_server
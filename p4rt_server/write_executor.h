@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _WRITE_EXECUTOR_H_
+#define _WRITE_EXECUTOR_H_
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "grpcpp/grpcpp.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// Executes the updates of a WriteRequest one at a time, running independent
+// updates in parallel.
+//
+// Updates are split into lanes. Every lane is executed in request order, and
+// lanes run concurrently on a shared worker pool (plus the calling thread).
+// Table entries, and their direct counters and meters, only depend on earlier
+// updates to the same table, and each table gets its own lane. Any table entry
+// may reference the other entity types (multicast and clone sessions, action
+// profile members and groups, ...), so each of their updates waits for every
+// update before it, and the updates after it wait for it.
+class WriteExecutor {
+ public:
+  using UpdateWriter = std::function<absl::Status(const p4::v1::Update&)>;
+
+  // Runs up to max_parallelism lanes at the same time; one of them on the
+  // thread calling Execute.
+  explicit WriteExecutor(int max_parallelism);
+
+  // Finishes queued lanes and joins the worker threads.
+  ~WriteExecutor();
+
+  WriteExecutor(const WriteExecutor&) = delete;
+  WriteExecutor& operator=(const WriteExecutor&) = delete;
+
+  // Passes every update of the request to write_update, which may be called
+  // concurrently for updates in different lanes. Returns one status per
+  // update, in request order.
+  std::vector<absl::Status> Execute(const p4::v1::WriteRequest& request,
+                                    const UpdateWriter& write_update)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  // Runs the lanes of one phase of the request and waits for them.
+  void RunLanes(const p4::v1::WriteRequest& request,
+                const UpdateWriter& write_update,
+                std::vector<std::vector<int>>* lanes,
+                std::vector<absl::Status>* statuses)
+      ABSL_LOCKS_EXCLUDED(lock_);
+  void RunTasks() ABSL_LOCKS_EXCLUDED(lock_);
+
+  absl::Mutex lock_;
+  std::deque<std::function<void()>> tasks_ ABSL_GUARDED_BY(lock_);
+  bool shutdown_ ABSL_GUARDED_BY(lock_) = false;
+
+  std::vector<std::thread> workers_;
+};
+
+// Builds the status of a Write RPC from its per-update statuses, as required
+// by the P4Runtime spec: OK if every update succeeded, otherwise UNKNOWN with
+// a google.rpc.Status in the error details holding one p4.v1.Error per update.
+grpc::Status WriteStatusesToGrpcStatus(
+    const std::vector<absl::Status>& statuses);
+
+}//namespace p4rt_server
+
+#endif //ifndef _WRITE_EXECUTOR_H_
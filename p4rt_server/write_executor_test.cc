@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "write_executor.h"
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "google/rpc/status.pb.h"
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+// Adds an update of a table entry; the priority identifies the update.
+void AddTableEntry(p4::v1::WriteRequest* request, uint32_t table_id,
+                   int priority) {
+  p4::v1::TableEntry* entry =
+      request->add_updates()->mutable_entity()->mutable_table_entry();
+  entry->set_table_id(table_id);
+  entry->set_priority(priority);
+  entry->mutable_action()->mutable_action()->set_action_id(1);
+}
+
+TEST(WriteExecutorTest, ReturnsOneStatusPerUpdateInTableOrder) {
+  WriteExecutor executor(4);
+  p4::v1::WriteRequest request;
+  for (int i = 0; i < 1000; ++i) AddTableEntry(&request, i % 7, i);
+  for (int i = 0; i < 10; ++i) {
+    request.add_updates()->mutable_entity()
+        ->mutable_action_profile_member()->set_member_id(i);
+  }
+
+  absl::Mutex lock;
+  std::map<uint32_t, int> last_priority;
+  bool ordered = true;
+  std::atomic<int> calls{0};
+  std::vector<absl::Status> statuses =
+      executor.Execute(request, [&](const p4::v1::Update& update) {
+        calls++;
+        if (!update.entity().has_table_entry()) return absl::OkStatus();
+        const p4::v1::TableEntry& entry = update.entity().table_entry();
+        absl::MutexLock l(&lock);
+        auto it = last_priority.find(entry.table_id());
+        if (it != last_priority.end() && it->second > entry.priority()) {
+          ordered = false;
+        }
+        last_priority[entry.table_id()] = entry.priority();
+        if (entry.priority() == 500) {
+          return absl::InvalidArgumentError("bad entry");
+        }
+        return absl::OkStatus();
+      });
+
+  EXPECT_EQ(calls, 1010);
+  // Updates of the same table are applied in request order.
+  EXPECT_TRUE(ordered);
+  ASSERT_EQ(statuses.size(), 1010);
+  EXPECT_FALSE(statuses[500].ok());
+  EXPECT_TRUE(statuses[499].ok());
+  EXPECT_TRUE(statuses[501].ok());
+}
+
+TEST(WriteExecutorTest, NonTableEntitiesAreBarriers) {
+  WriteExecutor executor(4);
+  p4::v1::WriteRequest request;
+  for (int i = 0; i < 300; ++i) {
+    if (i == 150) {
+      request.add_updates()->mutable_entity()
+          ->mutable_packet_replication_engine_entry()
+          ->mutable_multicast_group_entry()->set_multicast_group_id(1);
+      continue;
+    }
+    AddTableEntry(&request, i % 5, i);
+  }
+
+  std::atomic<int> before{0};
+  std::atomic<int> after{0};
+  std::atomic<bool> barrier_ordered{true};
+  executor.Execute(request, [&](const p4::v1::Update& update) {
+    if (update.entity().has_packet_replication_engine_entry()) {
+      if (before != 150 || after != 0) barrier_ordered = false;
+      return absl::OkStatus();
+    }
+    if (update.entity().table_entry().priority() < 150) {
+      before++;
+    } else {
+      after++;
+    }
+    return absl::OkStatus();
+  });
+  // The multicast group waits for the updates before it and holds back the
+  // updates after it.
+  EXPECT_TRUE(barrier_ordered);
+  EXPECT_EQ(before, 150);
+  EXPECT_EQ(after, 149);
+}
+
+TEST(WriteStatusesToGrpcStatusTest, ReportsEveryUpdate) {
+  std::vector<absl::Status> statuses(3);
+  statuses[1] = absl::InvalidArgumentError("bad entry");
+  grpc::Status status = WriteStatusesToGrpcStatus(statuses);
+  EXPECT_EQ(status.error_code(), grpc::StatusCode::UNKNOWN);
+
+  google::rpc::Status details;
+  ASSERT_TRUE(details.ParseFromString(status.error_details()));
+  ASSERT_EQ(details.details_size(), 3);
+  p4::v1::Error error;
+  ASSERT_TRUE(details.details(1).UnpackTo(&error));
+  EXPECT_EQ(error.canonical_code(), grpc::StatusCode::INVALID_ARGUMENT);
+  ASSERT_TRUE(details.details(0).UnpackTo(&error));
+  EXPECT_EQ(error.canonical_code(), grpc::StatusCode::OK);
+}
+
+TEST(WriteStatusesToGrpcStatusTest, OkIfEveryUpdateSucceeded) {
+  EXPECT_TRUE(WriteStatusesToGrpcStatus(std::vector<absl::Status>(3)).ok());
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "write_group_committer.h"
+
+#include "google/protobuf/util/message_differencer.h"
+#include "gutil/status.h"
+
+namespace p4rt_server{
+
+WriteGroupCommitter::WriteGroupCommitter(const Options& options,
+                                         CommitGroup commit_group)
+    : options_(options), commit_group_(std::move(commit_group)) {}
+
+bool WriteGroupCommitter::CanJoin(const Group& group,
+                                  const p4::v1::WriteRequest& request) {
+  if (!group.shared ||
+      request.atomicity() != p4::v1::WriteRequest::CONTINUE_ON_ERROR) {
+    return false;
+  }
+  const p4::v1::WriteRequest& first = *group.requests.front();
+  return request.role() == first.role() &&
+         google::protobuf::util::MessageDifferencer::Equals(
+             request.election_id(), first.election_id());
+}
+
+absl::Status WriteGroupCommitter::Commit(const p4::v1::WriteRequest& request) {
+  SpanContext span_context = ScopedSpan::CurrentContext();
+  lock_.Lock();
+  std::shared_ptr<Group> group;
+  if (!groups_.empty() && CanJoin(*groups_.back(), request) &&
+      groups_.back()->num_updates + request.updates_size() <=
+          options_.max_updates) {
+    group = groups_.back();
+  } else {
+    group = std::make_shared<Group>();
+    group->shared =
+        request.atomicity() == p4::v1::WriteRequest::CONTINUE_ON_ERROR;
+    group->deadline = absl::Now() + options_.window;
+    groups_.push_back(group);
+  }
+  size_t position = group->requests.size();
+  group->requests.push_back(&request);
+  group->num_updates += request.updates_size();
+  if (group->span_context.empty()) {
+    group->span_context = std::move(span_context);
+  }
+
+  // The first caller of a group commits it once the groups opened before it
+  // are committed, the others wait for its status.
+  bool leader = position == 0;
+  auto my_turn = [this, &group,
+                  leader]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    if (!leader) return group->committed;
+    return !committing_ && groups_.front() == group;
+  };
+  lock_.Await(absl::Condition(&my_turn));
+  if (leader) {
+    auto full = [this, &group]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return !group->shared || group->num_updates >= options_.max_updates;
+    };
+    lock_.AwaitWithDeadline(absl::Condition(&full), group->deadline);
+    // Closed: later requests open a new group.
+    groups_.pop_front();
+    committing_ = true;
+    SpanContext group_span_context = std::move(group->span_context);
+    lock_.Unlock();
+
+    std::vector<absl::Status> statuses;
+    {
+      ScopedSpanContext scoped_context(std::move(group_span_context));
+      statuses = commit_group_(group->requests);
+    }
+    if (statuses.size() != group->requests.size()) {
+      statuses.assign(group->requests.size(),
+                      gutil::InternalErrorBuilder()
+                          << "Group commit returned " << statuses.size()
+                          << " statuses for " << group->requests.size()
+                          << " requests.");
+    }
+
+    lock_.Lock();
+    group->statuses = std::move(statuses);
+    group->committed = true;
+    committing_ = false;
+  }
+  absl::Status status = group->statuses[position];
+  lock_.Unlock();
+  return status;
+}
+
+void WriteGroupCommitter::CommitAlone(const std::function<void()>& commit) {
+  lock_.Lock();
+  auto group = std::make_shared<Group>();
+  group->shared = false;
+  groups_.push_back(group);
+  auto my_turn = [this, &group]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return !committing_ && groups_.front() == group;
+  };
+  lock_.Await(absl::Condition(&my_turn));
+  groups_.pop_front();
+  committing_ = true;
+  lock_.Unlock();
+
+  commit();
+
+  lock_.Lock();
+  committing_ = false;
+  lock_.Unlock();
+}
+
+}//namespace p4rt_server
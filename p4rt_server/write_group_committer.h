@@ -0,0 +1,96 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _WRITE_GROUP_COMMITTER_H_
+#define _WRITE_GROUP_COMMITTER_H_
+
+#include "tracing.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4rt_server{
+
+// Coalesces concurrent WriteRequests into groups that are committed with one
+// call, the way a database amortizes one log flush over many transactions.
+//
+// The first request of a group waits up to the commit window for more
+// requests to join, then commits the group on its own thread while the other
+// callers wait for their status. Groups are committed one at a time, in the
+// order they were opened, and the requests of a group keep their arrival
+// order. The group is committed in the span context of its first traced
+// request, so a sampled request that joined an untraced leader still records
+// the commit in its trace. Only CONTINUE_ON_ERROR requests of the same role and election ID
+// share a group; requests with other atomicity modes are committed alone.
+// Since every caller blocks, a group never holds more requests than there are
+// threads calling Commit.
+class WriteGroupCommitter {
+ public:
+  struct Options {
+    // How long the first request of a group waits for more requests. 0
+    // disables group commit.
+    absl::Duration window = absl::ZeroDuration();
+    // A group is committed right away once it holds this many updates.
+    int max_updates = 4096;
+  };
+
+  // Commits the requests of a group, in order. Returns one status per
+  // request.
+  using CommitGroup = std::function<std::vector<absl::Status>(
+      absl::Span<const p4::v1::WriteRequest* const> requests)>;
+
+  WriteGroupCommitter(const Options& options, CommitGroup commit_group);
+
+  WriteGroupCommitter(const WriteGroupCommitter&) = delete;
+  WriteGroupCommitter& operator=(const WriteGroupCommitter&) = delete;
+
+  // Adds the request to a group and blocks until the group is committed.
+  // Returns the status of the request.
+  absl::Status Commit(const p4::v1::WriteRequest& request)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Runs commit on the calling thread in the place of a request that is
+  // committed alone: after the groups opened before it, and before any group
+  // opened after it. For requests that are not committed through CommitGroup.
+  void CommitAlone(const std::function<void()>& commit)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  struct Group {
+    std::vector<const p4::v1::WriteRequest*> requests;
+    int num_updates = 0;
+    // Only requests that may share a group with this one join it.
+    bool shared = true;
+    absl::Time deadline;
+    bool committed = false;
+    std::vector<absl::Status> statuses;
+    // Of the first request that was traced, if any.
+    SpanContext span_context;
+  };
+
+  // Returns true if the request may join the group.
+  static bool CanJoin(const Group& group, const p4::v1::WriteRequest& request);
+
+  const Options options_;
+  const CommitGroup commit_group_;
+
+  absl::Mutex lock_;
+  // Groups that are still open or wait for their commit, oldest first.
+  std::deque<std::shared_ptr<Group>> groups_ ABSL_GUARDED_BY(lock_);
+  bool committing_ ABSL_GUARDED_BY(lock_) = false;
+};
+
+}//namespace p4rt_server
+
+#endif //ifndef _WRITE_GROUP_COMMITTER_H_
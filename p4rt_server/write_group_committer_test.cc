@@ -0,0 +1,136 @@
+/*
+ * Copyright 2020-present Open Networking Foundation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "write_group_committer.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "gtest/gtest.h"
+
+namespace p4rt_server {
+namespace {
+
+// Requests with one update each; the priority of the update identifies the
+// request.
+std::vector<p4::v1::WriteRequest> Requests(int count) {
+  std::vector<p4::v1::WriteRequest> requests(count);
+  for (int i = 0; i < count; ++i) {
+    requests[i].set_atomicity(p4::v1::WriteRequest::CONTINUE_ON_ERROR);
+    requests[i].add_updates()->mutable_entity()->mutable_table_entry()
+        ->set_priority(i);
+  }
+  return requests;
+}
+
+int RequestNumber(const p4::v1::WriteRequest& request) {
+  return request.updates(0).entity().table_entry().priority();
+}
+
+class WriteGroupCommitterTest : public testing::Test {
+ protected:
+  WriteGroupCommitterTest()
+      : committer_(Options(),
+                   [this](absl::Span<const p4::v1::WriteRequest* const>
+                              requests) { return CommitGroup(requests); }) {}
+
+  static WriteGroupCommitter::Options Options() {
+    WriteGroupCommitter::Options options;
+    options.window = absl::Milliseconds(20);
+    options.max_updates = 1000;
+    return options;
+  }
+
+  // Fails every request whose number is a multiple of 5.
+  std::vector<absl::Status> CommitGroup(
+      absl::Span<const p4::v1::WriteRequest* const> requests) {
+    if (in_commit_++ != 0) overlapped_ = true;
+    std::vector<absl::Status> statuses;
+    {
+      absl::MutexLock l(&lock_);
+      group_sizes_.push_back(requests.size());
+      for (const p4::v1::WriteRequest* request : requests) {
+        statuses.push_back(RequestNumber(*request) % 5 == 0
+                               ? absl::InvalidArgumentError("bad request")
+                               : absl::OkStatus());
+      }
+    }
+    absl::SleepFor(absl::Milliseconds(2));
+    in_commit_--;
+    return statuses;
+  }
+
+  std::vector<int> GroupSizes() {
+    absl::MutexLock l(&lock_);
+    return group_sizes_;
+  }
+
+  std::atomic<int> in_commit_{0};
+  std::atomic<bool> overlapped_{false};
+  absl::Mutex lock_;
+  std::vector<int> group_sizes_ ABSL_GUARDED_BY(lock_);
+  WriteGroupCommitter committer_;
+};
+
+TEST_F(WriteGroupCommitterTest, FansOutTheStatusOfEveryRequest) {
+  constexpr int kRequests = 64;
+  std::vector<p4::v1::WriteRequest> requests = Requests(kRequests);
+  requests[10].set_atomicity(p4::v1::WriteRequest::ROLLBACK_ON_ERROR);
+
+  std::vector<absl::Status> statuses(kRequests);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kRequests; ++i) {
+    threads.emplace_back(
+        [&, i] { statuses[i] = committer_.Commit(requests[i]); });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  EXPECT_FALSE(overlapped_);
+  for (int i = 0; i < kRequests; ++i) {
+    EXPECT_EQ(statuses[i].ok(), i % 5 != 0) << "request " << i;
+  }
+  std::vector<int> group_sizes = GroupSizes();
+  int committed = 0;
+  for (int size : group_sizes) committed += size;
+  EXPECT_EQ(committed, kRequests);
+  // Concurrent requests were committed in groups.
+  EXPECT_LT(group_sizes.size(), kRequests / 2);
+}
+
+TEST_F(WriteGroupCommitterTest, GroupsAreBoundedByTheCallingThreads) {
+  constexpr int kThreads = 4;
+  constexpr int kRequestsPerThread = 8;
+  std::vector<p4::v1::WriteRequest> requests =
+      Requests(kThreads * kRequestsPerThread);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kRequestsPerThread; ++i) {
+        committer_.Commit(requests[t * kRequestsPerThread + i]).IgnoreError();
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  int committed = 0;
+  for (int size : GroupSizes()) {
+    EXPECT_LE(size, kThreads);
+    committed += size;
+  }
+  EXPECT_EQ(committed, kThreads * kRequestsPerThread);
+}
+
+TEST_F(WriteGroupCommitterTest, SequentialRequestsAreCommittedAlone) {
+  std::vector<p4::v1::WriteRequest> requests = Requests(4);
+  for (int i = 1; i < 4; ++i) EXPECT_TRUE(committer_.Commit(requests[i]).ok());
+  EXPECT_EQ(GroupSizes(), std::vector<int>({1, 1, 1}));
+}
+
+}  // namespace
+}  // namespace p4rt_server
@@ -25,6 +25,12 @@ def p4rt_server_deps():
             strip_prefix = "googletest-release-1.10.0",
             sha256 = "9dc9157a9a1551ec7a7e43daea9a694a0bb5fb8bec81235d8a1e6ef64c716dcb",
         )
+    if not native.existing_rule("com_github_google_benchmark"):
+        http_archive(
+            name = "com_github_google_benchmark",
+            urls = ["https://github.com/google/benchmark/archive/refs/tags/v1.5.5.tar.gz"],
+            strip_prefix = "benchmark-1.5.5",
+        )
     if not native.existing_rule("com_google_protobuf"):
         http_archive(
             name = "com_google_protobuf",